@@ -0,0 +1,114 @@
+#include "arena.h"
+
+#include <string.h>
+
+#include "../util/dbg/debug.h"
+
+/**
+ * @brief Get pointer to the first byte of the chunk content.
+ * 
+ * @param chunk
+ * @return char* 
+ */
+static inline char* chunk_data(ArenaChunk* chunk);
+
+/**
+ * @brief Allocate new chunk and put it on top of the arena.
+ * 
+ * @param arena
+ * @param size minimal capacity of the chunk
+ * @param err_code variable to use as errno
+ * @return ArenaChunk* new chunk
+ */
+static ArenaChunk* add_chunk(Arena* arena, size_t size, int* const err_code);
+
+static const size_t CHUNK_HEADER_SIZE = (sizeof(ArenaChunk) + alignof(max_align_t) - 1) & ~(alignof(max_align_t) - 1);
+
+void Arena_ctor(Arena* arena, size_t chunk_size, int* const err_code) {
+    _LOG_FAIL_CHECK_(arena, "error", ERROR_REPORTS, return, err_code, EINVAL);
+
+    arena->last = NULL;
+    arena->chunk_size = chunk_size ? chunk_size : ARENA_DEFAULT_CHUNK_SIZE;
+}
+
+void Arena_dtor(Arena* arena) {
+    if (!arena) return;
+
+    while (arena->last) {
+        ArenaChunk* prev = arena->last->prev;
+        free(arena->last);
+        arena->last = prev;
+    }
+}
+
+void* Arena_alloc(Arena* arena, size_t size, size_t alignment, int* const err_code) {
+    _LOG_FAIL_CHECK_(arena, "error", ERROR_REPORTS, return NULL, err_code, EINVAL);
+    _LOG_FAIL_CHECK_(alignment && !(alignment & (alignment - 1)), "error", ERROR_REPORTS, return NULL, err_code, EINVAL);
+
+    ArenaChunk* chunk = arena->last;
+    size_t offset = chunk ? (chunk->used + alignment - 1) & ~(alignment - 1) : 0;
+
+    if (!chunk || offset + size > chunk->size) {
+        chunk = add_chunk(arena, size + alignment, err_code);
+        if (!chunk) return NULL;
+        offset = 0;
+    }
+
+    chunk->used = offset + size;
+    return chunk_data(chunk) + offset;
+}
+
+char* Arena_strndup(Arena* arena, const char* str, size_t length, int* const err_code) {
+    _LOG_FAIL_CHECK_(str, "error", ERROR_REPORTS, return NULL, err_code, EINVAL);
+
+    char* copy = (char*) Arena_alloc(arena, length + 1, 1, err_code);
+    if (!copy) return NULL;
+
+    memcpy(copy, str, length);
+    copy[length] = '\0';
+
+    return copy;
+}
+
+void Arena_merge(Arena* arena, Arena* source) {
+    if (!arena || !source || !source->last || arena == source) return;
+
+    ArenaChunk* oldest = source->last;
+    while (oldest->prev) oldest = oldest->prev;
+
+    // Merged chunks go under the current one, so allocations keep using its free space.
+    if (arena->last) {
+        oldest->prev = arena->last->prev;
+        arena->last->prev = source->last;
+    } else {
+        arena->last = source->last;
+    }
+
+    source->last = NULL;
+}
+
+static inline char* chunk_data(ArenaChunk* chunk) {
+    return (char*)chunk + CHUNK_HEADER_SIZE;
+}
+
+static ArenaChunk* add_chunk(Arena* arena, size_t size, int* const err_code) {
+    if (!arena->chunk_size) arena->chunk_size = ARENA_DEFAULT_CHUNK_SIZE;
+    if (size < arena->chunk_size) size = arena->chunk_size;
+
+    ArenaChunk* chunk = (ArenaChunk*) calloc(1, CHUNK_HEADER_SIZE + size);
+    _LOG_FAIL_CHECK_(chunk, "error", ERROR_REPORTS, return NULL, err_code, ENOMEM);
+
+    chunk->size = size;
+    chunk->used = 0;
+
+    // Oversized blocks get their own chunk under the current one, so the rest of it stays usable.
+    if (arena->last && size > arena->chunk_size) {
+        chunk->prev = arena->last->prev;
+        arena->last->prev = chunk;
+    } else {
+        chunk->prev = arena->last;
+        arena->last = chunk;
+    }
+
+    return chunk;
+}
@@ -0,0 +1,82 @@
+/**
+ * @file arena.h
+ * @author Kudryashov Ilya (kudriashov.it@phystech.edu)
+ * @brief Chunk-based arena allocator.
+ * @version 0.1
+ * @date 2022-11-14
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdlib.h>
+#include <stddef.h>
+
+const size_t ARENA_DEFAULT_CHUNK_SIZE = 1 << 16;
+
+struct ArenaChunk {
+    ArenaChunk* prev = NULL;
+    size_t size = 0;
+    size_t used = 0;
+};
+
+/**
+ * @brief Allocator that hands out memory from large chunks and frees all of it at once.
+ * Zero-initialized arena is ready to use.
+ */
+struct Arena {
+    ArenaChunk* last = NULL;
+    size_t chunk_size = ARENA_DEFAULT_CHUNK_SIZE;
+};
+
+/**
+ * @brief Initialize the arena.
+ * 
+ * @param arena
+ * @param chunk_size default size of allocated chunks (0 = ARENA_DEFAULT_CHUNK_SIZE)
+ * @param err_code variable to use as errno
+ */
+void Arena_ctor(Arena* arena, size_t chunk_size = 0, int* const err_code = NULL);
+
+/**
+ * @brief Free all chunks of the arena.
+ * 
+ * @param arena
+ */
+void Arena_dtor(Arena* arena);
+
+/**
+ * @brief Get zero-filled block of memory from the arena.
+ * 
+ * @param arena
+ * @param size size of the block
+ * @param alignment block alignment (power of 2)
+ * @param err_code variable to use as errno
+ * @return void* pointer to the block, NULL on failure
+ */
+void* Arena_alloc(Arena* arena, size_t size, size_t alignment = alignof(max_align_t), int* const err_code = NULL);
+
+/**
+ * @brief Copy string into the arena.
+ * 
+ * @param arena
+ * @param str string to copy
+ * @param length number of characters to copy (zero terminator is added automatically)
+ * @param err_code variable to use as errno
+ * @return char* zero-terminated copy of the string, NULL on failure
+ */
+char* Arena_strndup(Arena* arena, const char* str, size_t length, int* const err_code = NULL);
+
+/**
+ * @brief Move all chunks of the source arena into the destination arena.
+ * Blocks allocated from the source stay valid and are freed together with the destination.
+ * 
+ * @param arena destination arena
+ * @param source arena to take chunks from (empty after the call)
+ */
+void Arena_merge(Arena* arena, Arena* source);
+
+#endif
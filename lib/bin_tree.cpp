@@ -1,41 +1,182 @@
 #include "bin_tree.h"
 
 #include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <cstring>
 #include <time.h>
 
 #include "util/dbg/debug.h"
 #include "file_helper.h"
+#include "tree_journal.h"
+#include "flat_tree.h"
+#include "util/parallel.h"
 
 #include "tree_config.h"
 
 /**
- * @brief Destroy node of the tree with all of its children.
- * 
- * @param node node to destroy
+ * @brief Subtree of the text file that is parsed separately from the rest of the tree.
+ */
+struct ParseTask {
+    const char* start = NULL;   // <- Opening brace of the subtree.
+    const char* end = NULL;     // <- Matching closing brace.
+    TreeNode* node = NULL;
+    Arena arena = {};
+    int err_code = 0;
+};
+
+/**
+ * @brief List of independent subtrees of the text file in the order of their appearance.
  */
-static void recursive_dtor(TreeNode* node);
+struct ParsePlan {
+    ParseTask* tasks = NULL;
+    size_t size = 0;
+    size_t capacity = 0;
+};
 
 /**
- * @brief Read single node from the stream.
+ * @brief Read single node from the buffer.
  * 
+ * @param arena arena to allocate the node content in
  * @param node node to put the result in
- * @param file stream to read from
+ * @param cursor position to start reading from
+ * @param end end of the buffer
+ * @param plan subtrees to skip, their nodes are created but their content is left to the tasks (can be NULL)
+ * @param err_code variable to use as errno
+ * @return const char* position right after the node, NULL on failure
+ */
+static const char* read_node(Arena* arena, TreeNode* node, const char* cursor, const char* const end, ParsePlan* plan,
+                             int* const err_code = NULL);
+
+/**
+ * @brief Find the largest subtrees of the buffer that are not longer than the given size by matching braces.
+ * The root of the tree is never selected.
+ * 
+ * @param plan list to put the subtrees in
+ * @param start start of the buffer
+ * @param end end of the buffer
+ * @param max_size maximal length of the subtree in bytes
+ * @return false if the buffer is not well-formed or there is not enough memory
+ */
+static bool plan_subtrees(ParsePlan* plan, const char* start, const char* const end, size_t max_size);
+
+/**
+ * @brief Parse single subtree of the plan.
+ * 
+ * @param index index of the task
+ * @param plan ParsePlan* with the task list
+ */
+static void parse_task(size_t index, void* plan);
+
+/**
+ * @brief Free the plan and move task allocations into the arena.
+ * 
+ * @param plan
+ * @param arena arena to pass task allocations to
+ */
+static void ParsePlan_dtor(ParsePlan* plan, Arena* arena);
+
+/**
+ * @brief Stack of nodes for traversals that can not rely on parent pointers.
+ */
+struct NodeStack {
+    const TreeNode** data = NULL;
+    size_t size = 0;
+    size_t capacity = 0;
+};
+
+/**
+ * @brief Push the node onto the stack.
+ * 
+ * @param stack
+ * @param node
+ * @return false if the stack could not be extended
+ */
+static bool NodeStack_push(NodeStack* stack, const TreeNode* node);
+
+/**
+ * @brief Free the stack.
+ * 
+ * @param stack
+ */
+static void NodeStack_dtor(NodeStack* stack);
+
+/**
+ * @brief Check connections of the node with its parent and children.
+ * 
+ * @param node
+ * @return BinaryTree_status_t node connection status (0 = OK)
+ */
+static BinaryTree_status_t local_status(const TreeNode* node);
+
+/**
+ * @brief Forget all changes of the tree.
+ * 
+ * @param tree
+ */
+static void clear_dirty(const BinaryTree* tree);
+
+/**
+ * @brief Remove the node from the list of changed nodes.
+ * 
+ * @param tree
+ * @param node node that is no longer in the tree
+ */
+static void forget_dirty(const BinaryTree* tree, const TreeNode* node);
+
+/**
+ * @brief Put the retired node to the list of free nodes (EpochList reclaim function).
+ * 
+ * @param node TreeNode* no one can see anymore
+ * @param tree BinaryTree* the node belonged to
+ */
+static void reclaim_node(void* node, void* tree);
+
+/**
+ * @brief Write node content to the buffer in text format.
+ * 
+ * @param node tree node to write
+ * @param out write destination
+ * @param shift depth of the node
+ * @param compact do not put line breaks and indentation
+ * @param version tree version to write
+ */
+static void write_text(const TreeNode* node, WriteBuffer* out, int shift, bool compact,
+                       uint64_t version = TREE_LATEST_VERSION);
+
+/**
+ * @brief Write tree content to the buffer in binary format.
+ * 
+ * @param root root of the tree to write
+ * @param version tree version to write
+ * @param out write destination
  * @param err_code variable to use as errno
+ * @return false if the tree was not written (the buffer may hold part of it)
+ */
+static bool write_binary(const TreeNode* root, uint64_t version, WriteBuffer* out, int* const err_code);
+
+/**
+ * @brief Make the rename of the file durable by syncing the directory it is in.
+ * 
+ * @param file_name name of the file
+ * @return false if the directory was not synced
  */
-static void read_node(TreeNode* node, FILE* file, int* const err_code = NULL);
+static bool sync_directory(const char* file_name);
 
 void TreeNode_ctor(TreeNode* node, char* value, bool free_value, TreeNode* parent, bool is_right, int* const err_code) {
     _LOG_FAIL_CHECK_(node,  "error", ERROR_REPORTS, return, err_code, EINVAL);
 
     node->value = value;
     node->free_value = free_value;
+    node->is_right = parent && is_right;
     if (parent) {
         _LOG_FAIL_CHECK_((is_right ? parent->right : parent->left) == NULL, 
                          "error", ERROR_REPORTS, return, err_code, EINVAL);
         (is_right ? parent->right : parent->left) = node;
         node->parent = parent;
     }
+
+    TreeNode_link_ancestry(node);
 }
 
 void TreeNode_dtor(TreeNode* node) {
@@ -55,115 +196,385 @@ void TreeNode_dtor(TreeNode* node) {
     if (node->right) node->right->parent = NULL;
 }
 
+void TreeNode_link_ancestry(TreeNode* node) {
+    if (!node) return;
+
+    TreeNode* parent = node->parent;
+
+    if (!parent) {
+        node->depth = 0;
+        node->jump = node;
+        return;
+    }
+
+    node->depth = parent->depth + 1;
+
+    // Jumps of equal length are merged into one twice as long (skew-binary jump pointers),
+    // so any ancestor is reachable in a logarithmic number of steps.
+    TreeNode* jump = parent->jump;
+    if (jump->jump && parent->depth - jump->depth == jump->depth - jump->jump->depth) {
+        node->jump = jump->jump;
+    } else {
+        node->jump = parent;
+    }
+}
+
+const TreeNode* TreeNode_ancestor(const TreeNode* node, size_t depth) {
+    if (!node || depth > node->depth) return NULL;
+
+    while (node->depth > depth) {
+        node = node->jump->depth >= depth ? node->jump : node->parent;
+    }
+
+    return node;
+}
+
+const TreeNode* TreeNode_common_ancestor(const TreeNode* node_a, const TreeNode* node_b) {
+    if (!node_a || !node_b) return NULL;
+
+    if (node_a->depth > node_b->depth) node_a = TreeNode_ancestor(node_a, node_b->depth);
+    else node_b = TreeNode_ancestor(node_b, node_a->depth);
+
+    // Jump targets depend only on the depth, so both nodes stay on the same level.
+    while (node_a != node_b) {
+        if (!node_a->depth) return NULL;
+
+        if (node_a->jump != node_b->jump) {
+            node_a = node_a->jump;
+            node_b = node_b->jump;
+        } else {
+            node_a = node_a->parent;
+            node_b = node_b->parent;
+        }
+    }
+
+    return node_a;
+}
+
 void BinaryTree_ctor(BinaryTree* const tree, int* const err_code) {
     _LOG_FAIL_CHECK_(tree, "error", ERROR_REPORTS, return, err_code, EINVAL);
+
+    Arena_ctor(&tree->arena, TREE_ARENA_CHUNK_SIZE, err_code);
     
-    tree->root = (TreeNode*) calloc(1, sizeof(*tree->root));
+    tree->root = BinaryTree_new_node(tree, err_code);
     _LOG_FAIL_CHECK_(tree->root, "error", ERROR_REPORTS, return, err_code, ENOMEM);
 
     TreeNode_ctor(tree->root, NULL, false, NULL, false, err_code);
+
+    WordIndex_ctor(&tree->index, 0, err_code);
+
+    BinaryTree_mark_dirty(tree, NULL);
 }
 
 void BinaryTree_dtor(BinaryTree* const tree) {
-    recursive_dtor(tree->root);
+    // Retired nodes are a part of the arena.
+    EpochList_dtor(&tree->retired);
+    tree->free_nodes = NULL;
+
+    Arena_dtor(&tree->arena);
     tree->root = NULL;
+
+    WordIndex_dtor(&tree->index);
+
+    free(tree->dirty.nodes);
+    tree->dirty = {};
+
+    unmap_file(tree->source, tree->source_size, tree->source_mapped);
+    tree->source = NULL;
+    tree->source_size = 0;
+}
+
+void BinaryTree_lock_shared(const BinaryTree* const tree) {
+    if (tree) pthread_rwlock_rdlock(&tree->lock);
+}
+
+void BinaryTree_lock(const BinaryTree* const tree) {
+    if (tree) pthread_rwlock_wrlock(&tree->lock);
+}
+
+void BinaryTree_unlock(const BinaryTree* const tree) {
+    if (tree) pthread_rwlock_unlock(&tree->lock);
+}
+
+bool BinaryTree_is_linked(const BinaryTree* const tree, const TreeNode* node) {
+    if (!tree || !node) return false;
+
+    // Nodes of the tree replaced by a rebuild still link to each other, so the whole path is checked.
+    // Depths of the path decrease, so stale parents of reclaimed nodes can not loop the walk.
+    while (node->parent) {
+        const TreeNode* parent = node->parent;
+        if (parent->depth + 1 != node->depth || TreeNode_child(parent, node->is_right) != node) return false;
+
+        node = parent;
+    }
+
+    return BinaryTree_root(tree) == node;
+}
+
+TreeNode* BinaryTree_new_node(BinaryTree* const tree, int* const err_code) {
+    _LOG_FAIL_CHECK_(tree, "error", ERROR_REPORTS, return NULL, err_code, EINVAL);
+
+    if (!tree->free_nodes) return (TreeNode*) Arena_alloc(&tree->arena, sizeof(TreeNode), alignof(TreeNode), err_code);
+
+    TreeNode* node = tree->free_nodes;
+    tree->free_nodes = node->left;
+
+    *node = {};
+    return node;
+}
+
+char* BinaryTree_new_value(BinaryTree* const tree, const char* value, size_t length, int* const err_code) {
+    _LOG_FAIL_CHECK_(tree, "error", ERROR_REPORTS, return NULL, err_code, EINVAL);
+
+    return Arena_strndup(&tree->arena, value, length, err_code);
 }
 
 void BinaryTree_read(BinaryTree* const tree, FILE* file, int* const err_code) {
     _LOG_FAIL_CHECK_(tree, "error", ERROR_REPORTS, return, err_code, EINVAL);
     _LOG_FAIL_CHECK_(file, "error", ERROR_REPORTS, return, err_code, EINVAL);
 
-    tree->root = (TreeNode*) calloc(1, sizeof(*tree->root));
+    Arena_ctor(&tree->arena, TREE_ARENA_CHUNK_SIZE, err_code);
+
+    tree->source = map_file(file, &tree->source_size, &tree->source_mapped, err_code);
+    _LOG_FAIL_CHECK_(tree->source, "error", ERROR_REPORTS, return, err_code, ENOMEM);
+
+    tree->root = BinaryTree_new_node(tree, err_code);
     _LOG_FAIL_CHECK_(tree->root, "error", ERROR_REPORTS, return, err_code, ENOMEM);
 
-    read_node(tree->root, file, err_code);
+    BinaryTree_mark_dirty(tree, NULL);
+
+    const char* const end = tree->source + tree->source_size;
+    size_t thread_count = parallel_thread_count();
+
+    ParsePlan plan = {};
+
+    // Large files are split into independent subtrees which are parsed in parallel after the rest of the tree.
+    if (thread_count > 1 && tree->source_size >= TREE_PARALLEL_MIN_SIZE &&
+        !plan_subtrees(&plan, tree->source, end, tree->source_size / (thread_count * TREE_PARALLEL_TASKS_PER_THREAD))) {
+        plan.size = 0;
+    }
+
+    if (!read_node(&tree->arena, tree->root, tree->source, end, &plan, err_code)) {
+        ParsePlan_dtor(&plan, &tree->arena);
+        return;
+    }
+
+    parallel_for(plan.size, parse_task, &plan, thread_count);
+
+    for (size_t id = 0; id < plan.size; ++id) {
+        if (!plan.tasks[id].err_code) continue;
+
+        log_printf(ERROR_REPORTS, "error", "Failed to read subtree at byte %lu.\n", (unsigned long)(plan.tasks[id].start - tree->source));
+        if (err_code) *err_code = plan.tasks[id].err_code;
+
+        ParsePlan_dtor(&plan, &tree->arena);
+        return;
+    }
+
+    ParsePlan_dtor(&plan, &tree->arena);
+
+    // Values are copied to the arena, so the text is not needed anymore.
+    unmap_file(tree->source, tree->source_size, tree->source_mapped);
+    tree->source = NULL;
+    tree->source_size = 0;
+
+    BinaryTree_build_index(tree, err_code);
 }
 
-void TreeNode_graph_dump(const TreeNode* node, FILE* file) {
-    if (!node || !file) return;
-    fprintf(file, "\tV%p [label=\"%s\"]\n", node, node->value ? node->value : "NULL");
+void BinaryTree_build_index(BinaryTree* const tree, int* const err_code) {
+    _LOG_FAIL_CHECK_(tree, "error", ERROR_REPORTS, return, err_code, EINVAL);
 
-    if (node->parent) {
-        fprintf(file, "\tV%p -> V%p [color=\"%s\"]\n", node->parent, node, 
-                node == node->parent->left ? "darkgreen" : "darkred");
+    // Parents are visited before their children, so ancestry is linked in the same pass.
+    size_t leaf_count = 0;
+    foreach_node(node, tree->root) {
+        ((TreeNode*)node)->is_right = node->parent && node->parent->right == node;
+        TreeNode_link_ancestry((TreeNode*)node);
+        if (!node->left) ++leaf_count;
     }
 
-    if (node->left) TreeNode_graph_dump(node->left, file);
-    if (node->right) TreeNode_graph_dump(node->right, file);
+    WordIndex_dtor(&tree->index);
+    WordIndex_ctor(&tree->index, leaf_count, err_code);
+
+    for (const TreeNode* node = tree->root; node; node = TreeNode_next_preorder(node, tree->root)) {
+        if (node->left || !node->value || WordIndex_find(&tree->index, node->value)) continue;
+        WordIndex_insert(&tree->index, node->value, (TreeNode*)node, err_code);
+    }
 }
 
-static size_t PictCount = 0;
+void BinaryTree_split_leaf(BinaryTree* const tree, TreeNode* leaf, char* question, char* word, int* const err_code) {
+    _LOG_FAIL_CHECK_(tree, "error", ERROR_REPORTS, return, err_code, EINVAL);
+    _LOG_FAIL_CHECK_(leaf && !leaf->left && !leaf->right, "error", ERROR_REPORTS, return, err_code, EINVAL);
+    _LOG_FAIL_CHECK_(BinaryTree_is_linked(tree, leaf), "error", ERROR_REPORTS, return, err_code, EINVAL);
+    _LOG_FAIL_CHECK_(question, "error", ERROR_REPORTS, return, err_code, EINVAL);
+    _LOG_FAIL_CHECK_(word, "error", ERROR_REPORTS, return, err_code, EINVAL);
 
-void _BinaryTree_dump_graph(const BinaryTree* const tree, unsigned int importance) {
-    BinaryTree_status_t status = BinaryTree_status(tree);
-    _log_printf(importance, "tree_dump", "\tTree at %p (status = %d):\n", tree, status);
-    if (status) {
-        for (size_t error_id = 0; error_id < TREE_REPORT_COUNT; ++error_id) {
-            if (status & (1 << error_id)) {
-                _log_printf(importance, "tree_dump", "\t%s\n", TREE_STATUS_DESCR[error_id]);
-            }
+    TreeNode* question_node = BinaryTree_new_node(tree, err_code);
+    _LOG_FAIL_CHECK_(question_node, "error", ERROR_REPORTS, return, err_code, ENOMEM);
+
+    TreeNode* yes_node = BinaryTree_new_node(tree, err_code);
+    _LOG_FAIL_CHECK_(yes_node, "error", ERROR_REPORTS, return, err_code, ENOMEM);
+
+    TreeNode* no_node = BinaryTree_new_node(tree, err_code);
+    _LOG_FAIL_CHECK_(no_node, "error", ERROR_REPORTS, return, err_code, ENOMEM);
+
+    uint64_t version = tree->version + 1;
+
+    // The question takes place of the leaf, the leaf itself is copied as its NO answer.
+    // Older versions find the leaf through the replaced pointers.
+    question_node->value = question;
+    question_node->parent = leaf->parent;
+    question_node->is_right = leaf->is_right;
+    question_node->version = version;
+    question_node->replaced = leaf;
+    TreeNode_link_ancestry(question_node);
+
+    // Games that ended at the leaf passed through the place of the question. They stay on the question
+    // (see TreeNode_ended_games) instead of moving to the old word, which is one question deeper now.
+    question_node->visits = __atomic_load_n(&leaf->visits, __ATOMIC_RELAXED);
+
+    TreeNode_ctor(yes_node, word, false, question_node, false, err_code);
+    yes_node->version = version;
+
+    TreeNode_ctor(no_node, leaf->value, leaf->free_value, question_node, true, err_code);
+    no_node->version = version;
+    no_node->replaced = leaf;
+    no_node->lookups = __atomic_load_n(&leaf->lookups, __ATOMIC_RELAXED);
+
+    // The index gets the new leaves first: snapshots of the new version must not find the replaced leaf,
+    // while older ones get from the new leaves to it through the replaced pointers.
+    WordIndex_insert(&tree->index, word, yes_node, err_code);
+    if (no_node->value) WordIndex_insert(&tree->index, no_node->value, no_node, err_code);
+
+    TreeNode** link = leaf->parent ? (leaf->is_right ? &leaf->parent->right : &leaf->parent->left) : &tree->root;
+    __atomic_store_n(link, question_node, __ATOMIC_RELEASE);
+    __atomic_store_n(&tree->version, version, __ATOMIC_RELEASE);
+
+    forget_dirty(tree, leaf);
+
+    if (question_node->parent) BinaryTree_mark_dirty(tree, question_node->parent);
+    BinaryTree_mark_dirty(tree, question_node);
+    BinaryTree_mark_dirty(tree, yes_node);
+    BinaryTree_mark_dirty(tree, no_node);
+
+    if (tree->journal) TreeJournal_record(tree->journal, question_node, no_node->value ? no_node->value : "", word, err_code);
+
+    // Readers that found the leaf before the store and snapshots of older versions may still be looking at it.
+    EpochList_retire(&tree->retired, leaf, err_code);
+    EpochList_collect(&tree->retired, reclaim_node, tree);
+}
+
+void BinaryTree_mark_dirty(const BinaryTree* const tree, const TreeNode* node) {
+    if (!tree) return;
+
+    DirtyList* dirty = &tree->dirty;
+    if (dirty->everything) return;
+
+    if (!node || dirty->size >= TREE_MAX_DIRTY_NODES) {
+        dirty->everything = true;
+        dirty->size = 0;
+        return;
+    }
+
+    if (dirty->size == dirty->capacity) {
+        size_t capacity = dirty->capacity ? 2 * dirty->capacity : TREE_STACK_MIN_CAPACITY;
+
+        const TreeNode** nodes = (const TreeNode**) realloc(dirty->nodes, capacity * sizeof(*nodes));
+        if (!nodes) {
+            dirty->everything = true;
+            return;
         }
+
+        dirty->nodes = nodes;
+        dirty->capacity = capacity;
+    }
+
+    dirty->nodes[dirty->size++] = node;
+}
+
+TreeFormat BinaryTree_get_format(FILE* file) {
+    if (!file) return TREE_FORMAT_TEXT;
+
+    char magic[TREE_BINARY_MAGIC_LENGTH] = "";
+    if (pread(fileno(file), magic, TREE_BINARY_MAGIC_LENGTH, 0) != (ssize_t)TREE_BINARY_MAGIC_LENGTH) {
+        return TREE_FORMAT_TEXT;
     }
 
-    if (status & ~TREE_INV_CONNECTIONS) return;
+    return memcmp(magic, TREE_BINARY_MAGIC, TREE_BINARY_MAGIC_LENGTH) == 0 ? TREE_FORMAT_BINARY : TREE_FORMAT_TEXT;
+}
 
-    FILE* temp_file = fopen(TREE_TEMP_DOT_FNAME, "w");
-    
-    _LOG_FAIL_CHECK_(temp_file, "error", ERROR_REPORTS, return, NULL, 0);
+void BinaryTree_read_binary(BinaryTree* const tree, FILE* file, int* const err_code) {
+    _LOG_FAIL_CHECK_(tree, "error", ERROR_REPORTS, return, err_code, EINVAL);
+    _LOG_FAIL_CHECK_(file, "error", ERROR_REPORTS, return, err_code, EINVAL);
 
-    fputs("digraph G {\n", temp_file);
-    fputs(  "\trankdir=TB\n"
-            "\tlayout=dot\n"
-            , temp_file);
+    Arena_ctor(&tree->arena, TREE_ARENA_CHUNK_SIZE, err_code);
 
-    if (tree->root) TreeNode_graph_dump(tree->root, temp_file);
+    tree->source = map_file(file, &tree->source_size, &tree->source_mapped, err_code);
+    _LOG_FAIL_CHECK_(tree->source, "error", ERROR_REPORTS, return, err_code, ENOMEM);
 
-    fputc('}', temp_file);
-    fclose(temp_file);
+    _LOG_FAIL_CHECK_(tree->source_size >= sizeof(BinaryTreeHeader), "error", ERROR_REPORTS, return, err_code, EINVAL);
 
-    if (system("mkdir -p " TREE_LOG_ASSET_FOLD_NAME)) return;
+    const BinaryTreeHeader* header = (const BinaryTreeHeader*) tree->source;
 
-    time_t raw_time = 0;
-    time(&raw_time);
+    _LOG_FAIL_CHECK_(memcmp(header->magic, TREE_BINARY_MAGIC, TREE_BINARY_MAGIC_LENGTH) == 0,
+                     "error", ERROR_REPORTS, return, err_code, EINVAL);
+    _LOG_FAIL_CHECK_(header->version == TREE_BINARY_VERSION, "error", ERROR_REPORTS, return, err_code, EINVAL);
+    _LOG_FAIL_CHECK_(header->node_count > 0, "error", ERROR_REPORTS, return, err_code, EINVAL);
 
-    char pict_name[TREE_PICT_NAME_SIZE] = "";
-    sprintf(pict_name, TREE_LOG_ASSET_FOLD_NAME "/pict%04ld_%ld.png", (long int)++PictCount, raw_time);
+    size_t node_count = header->node_count;
+    size_t strings_offset = sizeof(*header) + node_count * sizeof(BinaryTreeRecord);
 
-    char draw_request[TREE_DRAW_REQUEST_SIZE] = "";
-    sprintf(draw_request, "dot -Tpng -o %s " TREE_TEMP_DOT_FNAME, pict_name);
+    _LOG_FAIL_CHECK_(header->strings_size > 0 && strings_offset + header->strings_size <= tree->source_size,
+                     "error", ERROR_REPORTS, return, err_code, EINVAL);
 
-    if (system(draw_request)) return;
+    const BinaryTreeRecord* records = (const BinaryTreeRecord*) (tree->source + sizeof(*header));
+    const char* strings = tree->source + strings_offset;
 
-    _log_printf(importance, "tree_dump",
-                "\n<details><summary>Graph</summary><img src=\"%s\"></details>\n", pict_name);
-}
+    // Offsets are checked against the table size, so the terminator at its end keeps all values bounded.
+    _LOG_FAIL_CHECK_(strings[header->strings_size - 1] == '\0', "error", ERROR_REPORTS, return, err_code, EINVAL);
 
-TreeNode* BinaryTree_find(const BinaryTree* const tree, const char* word, int* const err_code) {
-    _LOG_FAIL_CHECK_(!BinaryTree_status(tree), "error", ERROR_REPORTS, return NULL, err_code, EFAULT);
-    _LOG_FAIL_CHECK_(word, "error", ERROR_REPORTS, return NULL, err_code, EFAULT);
+    TreeNode* nodes = (TreeNode*) Arena_alloc(&tree->arena, node_count * sizeof(*nodes), alignof(TreeNode), err_code);
+    _LOG_FAIL_CHECK_(nodes, "error", ERROR_REPORTS, return, err_code, ENOMEM);
 
-    TreeNode* node = tree->root;
-    TreeNode* prev = node->parent;
+    // Children always follow their parents in the table, so every node but the root
+    // must already have its parent assigned by the time it is reached.
+    for (size_t index = 0; index < node_count; ++index) {
+        const BinaryTreeRecord* record = &records[index];
+        TreeNode* node = &nodes[index];
 
-    do {
-        TreeNode* prev_mem = prev;
-        prev = node;
+        _LOG_FAIL_CHECK_(index == 0 || node->parent, "error", ERROR_REPORTS, return, err_code, EINVAL);
+        _LOG_FAIL_CHECK_(record->value < header->strings_size, "error", ERROR_REPORTS, return, err_code, EINVAL);
+        _LOG_FAIL_CHECK_((record->left == TREE_BINARY_NO_NODE) == (record->right == TREE_BINARY_NO_NODE),
+                         "error", ERROR_REPORTS, return, err_code, EINVAL);
 
-        if (!(node->left && node->right)) {
+        // Values that are not owned are never changed, so they can point into the read-only mapping.
+        node->value = (char*) (strings + record->value);
+        node->free_value = false;
 
-            if (strcmp(word, node->value) == 0) return node;
-            else node = node->parent;
+        if (record->left == TREE_BINARY_NO_NODE) continue;
 
-        } else if (prev_mem == node->parent) {
-            node = node->left;
-        } else if (prev_mem == node->left) {
-            node = node->right;
-        } else if (prev_mem == node->right) {
-            node = node->parent;
-        }
-    } while (node != NULL);
+        _LOG_FAIL_CHECK_(index < record->left  && record->left  < node_count && !nodes[record->left].parent,
+                         "error", ERROR_REPORTS, return, err_code, EINVAL);
+        _LOG_FAIL_CHECK_(index < record->right && record->right < node_count && !nodes[record->right].parent &&
+                         record->left != record->right, "error", ERROR_REPORTS, return, err_code, EINVAL);
 
-    return NULL;
+        node->left  = &nodes[record->left];
+        node->right = &nodes[record->right];
+        node->left->parent  = node;
+        node->right->parent = node;
+    }
+
+    tree->root = &nodes[0];
+
+    BinaryTree_mark_dirty(tree, NULL);
+
+    BinaryTree_build_index(tree, err_code);
+}
+
+TreeNode* BinaryTree_find(const BinaryTree* const tree, const char* word, int* const err_code) {
+    _LOG_FAIL_CHECK_(!BinaryTree_status(tree), "error", ERROR_REPORTS, return NULL, err_code, EFAULT);
+    _LOG_FAIL_CHECK_(word, "error", ERROR_REPORTS, return NULL, err_code, EFAULT);
+
+    return WordIndex_find(&tree->index, word);
 }
 
 void BinaryTree_fill_path(const TreeNode* node, const TreeNode* *path, size_t* const out_length, 
@@ -190,99 +601,489 @@ void BinaryTree_write_content(const BinaryTree* tree, FILE* const file, int* con
     TreeNode_write_content(tree->root, file, 0, err_code);
 }
 
-void TreeNode_write_content(const TreeNode* node, FILE* const file, int shift, int* const err_code) {
+void BinaryTree_write_binary(const BinaryTree* tree, FILE* const file, int* const err_code) {
+    _LOG_FAIL_CHECK_(!BinaryTree_status(tree), "error", ERROR_REPORTS, return, err_code, EINVAL);
+    _LOG_FAIL_CHECK_(file, "error", ERROR_REPORTS, return, err_code, EINVAL);
+
+    fflush(file);
+
+    WriteBuffer out = {};
+    WriteBuffer_ctor(&out, fileno(file), 0, err_code);
+
+    bool written = write_binary(tree->root, TREE_LATEST_VERSION, &out, err_code);
+
+    WriteBuffer_dtor(&out);
+    _LOG_FAIL_CHECK_(written, "error", ERROR_REPORTS, return, err_code, EIO);
+    _LOG_FAIL_CHECK_(!out.failed, "error", ERROR_REPORTS, return, err_code, EIO);
+}
+
+void TreeNode_write_content(const TreeNode* node, FILE* const file, int shift, int* const err_code, bool compact) {
     _LOG_FAIL_CHECK_(node, "error", ERROR_REPORTS, return, err_code, EINVAL);
     _LOG_FAIL_CHECK_(file, "error", ERROR_REPORTS, return, err_code, EINVAL);
-    for (int index = 0; index < shift; index++) fputc('\t', file);
-    fprintf(file, "{\"%s\"", node->value);
-    if (node->left) {
-        fprintf(file, ",\n");
-        TreeNode_write_content(node->left,  file, shift + 1, err_code);
-        fputc(',', file);
-    }
-    if (node->right) {
-        fputc('\n', file);
-        TreeNode_write_content(node->right, file, shift + 1, err_code);
-        fputc('\n', file);
-        for (int index = 0; index < shift; index++) fputc('\t', file);
-    }
-    fputc('}', file);
+
+    // Content bypasses stdio, so whatever is already buffered there has to go first.
+    fflush(file);
+
+    WriteBuffer out = {};
+    WriteBuffer_ctor(&out, fileno(file), 0, err_code);
+
+    write_text(node, &out, shift, compact);
+
+    WriteBuffer_dtor(&out);
+    _LOG_FAIL_CHECK_(!out.failed, "error", ERROR_REPORTS, return, err_code, EIO);
+}
+
+void BinaryTree_save(const BinaryTree* tree, const char* file_name, TreeFormat format, bool compact,
+                     int* const err_code) {
+    _LOG_FAIL_CHECK_(!BinaryTree_status(tree), "error", ERROR_REPORTS, return, err_code, EINVAL);
+
+    TreeSnapshot snapshot = {};
+    BinaryTree_snapshot(tree, &snapshot);
+
+    TreeSnapshot_save(&snapshot, file_name, format, compact, err_code);
+
+    TreeSnapshot_release(&snapshot);
+}
+
+void TreeSnapshot_save(const TreeSnapshot* snapshot, const char* file_name, TreeFormat format, bool compact,
+                       int* const err_code) {
+    _LOG_FAIL_CHECK_(snapshot && snapshot->tree, "error", ERROR_REPORTS, return, err_code, EINVAL);
+    _LOG_FAIL_CHECK_(file_name, "error", ERROR_REPORTS, return, err_code, EINVAL);
+
+    log_printf(STATUS_REPORTS, "status", "Saving data to the file %s.\n", file_name);
+
+    char temp_name[TREE_FILE_NAME_SIZE] = "";
+    _LOG_FAIL_CHECK_(snprintf(temp_name, TREE_FILE_NAME_SIZE, "%s" TREE_TEMP_FILE_SUFFIX, file_name) < (int)TREE_FILE_NAME_SIZE,
+                     "error", ERROR_REPORTS, return, err_code, ENAMETOOLONG);
+
+    int fd = open(temp_name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    _LOG_FAIL_CHECK_(fd >= 0, "error", ERROR_REPORTS, return, err_code, ENOENT);
+
+    WriteBuffer out = {};
+    WriteBuffer_ctor(&out, fd, 0, err_code);
+
+    const TreeNode* root = TreeSnapshot_root(snapshot);
+
+    bool written = true;
+
+    if (format == TREE_FORMAT_BINARY) written = write_binary(root, snapshot->version, &out, err_code);
+    else write_text(root, &out, 0, compact, snapshot->version);
+
+    WriteBuffer_dtor(&out);
+
+    // The file is only put in place of the database if every byte of the tree reached the disk.
+    bool success = written && !out.failed && fsync(fd) == 0;
+    success = close(fd) == 0 && success;
+
+    _LOG_FAIL_CHECK_(success, "error", ERROR_REPORTS, { unlink(temp_name); return; }, err_code, EIO);
+
+    // Old binary file stays mapped by the tree if it was read from it, rename keeps it alive until unmapping.
+    _LOG_FAIL_CHECK_(rename(temp_name, file_name) == 0, "error", ERROR_REPORTS, { unlink(temp_name); return; },
+                     err_code, EIO);
+
+    _LOG_FAIL_CHECK_(sync_directory(file_name), "error", ERROR_REPORTS, return, err_code, EIO);
 }
 
 BinaryTree_status_t BinaryTree_status(const BinaryTree* tree) {
     if (tree == NULL) return TREE_NULL;
     if (tree->root == NULL) return TREE_NULL_ROOT;
     #ifndef NDEBUG
-        return TreeNode_status(tree->root);
+        if (tree->dirty.everything) return BinaryTree_full_status(tree);
+
+        BinaryTree_status_t status = 0;
+        for (size_t index = 0; index < tree->dirty.size; ++index) {
+            status |= local_status(tree->dirty.nodes[index]);
+        }
+
+        if (!status) clear_dirty(tree);
+
+        return status;
     #else
         return 0;
     #endif
 }
 
+BinaryTree_status_t BinaryTree_full_status(const BinaryTree* tree) {
+    if (tree == NULL) return TREE_NULL;
+    if (tree->root == NULL) return TREE_NULL_ROOT;
+
+    BinaryTree_status_t status = TreeNode_status(tree->root);
+
+    if (!status) clear_dirty(tree);
+
+    return status;
+}
+
 BinaryTree_status_t TreeNode_status(const TreeNode* node) {
     _LOG_FAIL_CHECK_(node, "error", ERROR_REPORTS, return TREE_INV_CONNECTIONS, &errno, EFAULT);
 
-    if (((bool)node->left) != ((bool)node->right)) return TREE_INV_CONNECTIONS;
-    if (!node->left) return 0;
-    if (node->left->parent != node) return TREE_INV_CONNECTIONS;
-    if (node->right->parent != node) return TREE_INV_CONNECTIONS;
-    return TreeNode_status(node->left) | TreeNode_status(node->right);
+    NodeStack stack = {};
+    if (!NodeStack_push(&stack, node)) return TREE_INV_CONNECTIONS;
+
+    BinaryTree_status_t status = 0;
+
+    while (stack.size && !status) {
+        const TreeNode* current = stack.data[--stack.size];
+
+        status |= local_status(current);
+        if (!current->left || status) continue;
+
+        if (current->left == node || current->right == node) status |= TREE_INV_CONNECTIONS;
+        if (status) continue;
+
+        if (!NodeStack_push(&stack, current->right) || !NodeStack_push(&stack, current->left)) {
+            status |= TREE_INV_CONNECTIONS;
+        }
+    }
+
+    NodeStack_dtor(&stack);
+
+    return status;
 }
 
-static void recursive_dtor(TreeNode* node) {
-    if (node == NULL) return;
-    if (node->free_value) free(node->value);
-    if (node->left) recursive_dtor(node->left);
-    if (node->right) recursive_dtor(node->right);
-    free(node);
+const TreeNode* TreeNode_next_preorder(const TreeNode* node, const TreeNode* root, uint64_t version) {
+    if (TreeNode_child(node, false)) return TreeNode_child_at(node, false, version);
+
+    for (; node != root && node->parent; node = node->parent) {
+        if (node->is_right) continue;
+
+        const TreeNode* sibling = TreeNode_child_at(node->parent, true, version);
+        if (sibling) return sibling;
+    }
+
+    return NULL;
 }
 
-static void read_node(TreeNode* node, FILE* file, int* const err_code) {
-    _LOG_FAIL_CHECK_(node, "error", ERROR_REPORTS, return, err_code, ENOENT);
-    _LOG_FAIL_CHECK_(file, "error", ERROR_REPORTS, return, err_code, EINVAL);
-    _LOG_FAIL_CHECK_(node->value == NULL, "error", ERROR_REPORTS, return, err_code, ENOENT);
-    _LOG_FAIL_CHECK_(node->left == NULL,  "error", ERROR_REPORTS, return, err_code, ENOENT);
-    _LOG_FAIL_CHECK_(node->right == NULL, "error", ERROR_REPORTS, return, err_code, ENOENT);
+const TreeNode* TreeNode_first_leaf(const TreeNode* root, uint64_t version) {
+    const TreeNode* node = root;
+    while (node && TreeNode_child(node, false)) node = TreeNode_child_at(node, false, version);
+    return node;
+}
+
+const TreeNode* TreeNode_next_leaf(const TreeNode* node, const TreeNode* root, uint64_t version) {
+    for (; node != root && node->parent; node = node->parent) {
+        if (node->is_right) continue;
 
-    skip_to_char(file, '"');
+        const TreeNode* sibling = TreeNode_child_at(node->parent, true, version);
+        if (sibling) return TreeNode_first_leaf(sibling, version);
+    }
 
-                                                       /* v One extra zero character to avoid overflow */
-    char* temp_buffer = (char*) calloc(MAX_VALUE_LENGTH + 1, sizeof(*temp_buffer));
-    _LOG_FAIL_CHECK_(temp_buffer, "error", ERROR_REPORTS, return, err_code, ENOMEM);
+    return NULL;
+}
 
-    int length = skip_to_char(file, '"', temp_buffer, MAX_VALUE_LENGTH);
-    _LOG_FAIL_CHECK_(length >= 0, "error", ERROR_REPORTS, { free(temp_buffer); return; }, err_code, EINVAL);
+static const char* read_node(Arena* arena, TreeNode* node, const char* cursor, const char* const end, ParsePlan* plan,
+                             int* const err_code) {
+    _LOG_FAIL_CHECK_(node, "error", ERROR_REPORTS, return NULL, err_code, ENOENT);
+    _LOG_FAIL_CHECK_(cursor, "error", ERROR_REPORTS, return NULL, err_code, EINVAL);
+    _LOG_FAIL_CHECK_(node->value == NULL, "error", ERROR_REPORTS, return NULL, err_code, ENOENT);
+    _LOG_FAIL_CHECK_(node->left == NULL,  "error", ERROR_REPORTS, return NULL, err_code, ENOENT);
+    _LOG_FAIL_CHECK_(node->right == NULL, "error", ERROR_REPORTS, return NULL, err_code, ENOENT);
 
-    node->value = (char*) calloc((size_t)length + 1, sizeof(*node->value));
-    _LOG_FAIL_CHECK_(node->value, "error", ERROR_REPORTS, return, err_code, ENOMEM);
+    TreeNode* const root = node;
 
-    node->free_value = true;
+    ParseTask* next_task = plan && plan->size ? plan->tasks : NULL;
+    ParseTask* const last_task = next_task ? plan->tasks + plan->size : NULL;
 
-    memcpy(node->value, temp_buffer, ((size_t)length + 1) * sizeof(*node->value));
+    // Every iteration reads the value of the current node and then its braces up to
+    // the first child to descend into, returning to the parents on closing braces.
+    while (node) {
+        const char* value_start = (const char*) memchr(cursor, '"', (size_t)(end - cursor));
+        _LOG_FAIL_CHECK_(value_start, "error", ERROR_REPORTS, return NULL, err_code, EINVAL);
+        ++value_start;
 
-    free(temp_buffer);
+        const char* value_end = (const char*) memchr(value_start, '"', (size_t)(end - value_start));
+        _LOG_FAIL_CHECK_(value_end, "error", ERROR_REPORTS, return NULL, err_code, EINVAL);
 
-    exec_on_char(file, {
-        case EOF:
-        case '}': return;
+        // Values are followed by quotes, not terminators, and the file is mapped read-only, so they are copied.
+        node->value = Arena_strndup(arena, value_start, (size_t)(value_end - value_start), err_code);
+        _LOG_FAIL_CHECK_(node->value, "error", ERROR_REPORTS, return NULL, err_code, ENOMEM);
+        node->free_value = false;
+
+        TreeNode* child = NULL;
+
+        for (cursor = find_structural(value_end + 1, end); cursor < end && node && !child; cursor = find_structural(cursor + 1, end)) {
+            if (*cursor == '}') {
+                node = node == root ? NULL : node->parent;
+                continue;
+            }
+
+            if (*cursor != '{') continue;
 
-        case '{': {
             TreeNode** target_ptr = &node->left;
             if (node->left) target_ptr = &node->right;
 
             _LOG_FAIL_CHECK_(*target_ptr == NULL, "error", ERROR_REPORTS, {
                 log_printf(ERROR_REPORTS, "error", "Failed to read node from file. Too many children nodes were specified.");
-                return;
+                return NULL;
             }, err_code, EINVAL);
 
-            *target_ptr = (TreeNode*) calloc(1, sizeof(**target_ptr));
-            _LOG_FAIL_CHECK_(*target_ptr, "error", ERROR_REPORTS, return, err_code, ENOMEM);
+            child = *target_ptr = (TreeNode*) Arena_alloc(arena, sizeof(TreeNode), alignof(TreeNode), err_code);
+            _LOG_FAIL_CHECK_(child, "error", ERROR_REPORTS, return NULL, err_code, ENOMEM);
+
+            child->parent = node;
+
+            // Planned subtrees are left empty and skipped up to their closing brace.
+            if (next_task && cursor == next_task->start) {
+                next_task->node = child;
+                cursor = next_task->end;
+                child = NULL;
+                if (++next_task == last_task) next_task = NULL;
+            }
+        }
+
+        if (!child) break;
+
+        node = child;
+    }
+
+    _LOG_FAIL_CHECK_(next_task == NULL, "error", ERROR_REPORTS, {
+        log_printf(ERROR_REPORTS, "error", "Failed to read tree from file. Braces do not match the structure of the tree.\n");
+        return NULL;
+    }, err_code, EINVAL);
+
+    return cursor;
+}
+
+static bool plan_subtrees(ParsePlan* plan, const char* start, const char* const end, size_t max_size) {
+    const char** braces = NULL;
+    size_t depth = 0;
+    size_t capacity = 0;
+
+    bool broken = false;
+
+    for (const char* cursor = find_structural(start, end); cursor < end && !broken; cursor = find_structural(cursor + 1, end)) {
+        if (*cursor == '"') {
+            cursor = (const char*) memchr(cursor + 1, '"', (size_t)(end - cursor - 1));
+            broken = cursor == NULL;
+            if (broken) break;
+            continue;
+        }
+
+        if (*cursor == '{') {
+            if (depth == capacity) {
+                size_t new_capacity = capacity ? capacity * 2 : TREE_STACK_MIN_CAPACITY;
+                const char** new_braces = (const char**) realloc(braces, new_capacity * sizeof(*braces));
+                broken = new_braces == NULL;
+                if (broken) break;
+                braces = new_braces;
+                capacity = new_capacity;
+            }
+
+            braces[depth++] = cursor;
+            continue;
+        }
+
+        if (*cursor != '}') continue;
+
+        broken = depth == 0;
+        if (broken) break;
 
-            (*target_ptr)->parent = node;
+        const char* subtree = braces[--depth];
 
-            read_node(*target_ptr, file, err_code);
+        if (!depth || (size_t)(cursor - subtree) > max_size) continue;
+
+        // The subtree replaces its children, which were found before it.
+        while (plan->size && plan->tasks[plan->size - 1].start > subtree) --plan->size;
+
+        if (plan->size == plan->capacity) {
+            size_t new_capacity = plan->capacity ? plan->capacity * 2 : TREE_STACK_MIN_CAPACITY;
+            ParseTask* new_tasks = (ParseTask*) realloc(plan->tasks, new_capacity * sizeof(*plan->tasks));
+            broken = new_tasks == NULL;
+            if (broken) break;
+            plan->tasks = new_tasks;
+            plan->capacity = new_capacity;
         }
 
-        default: break;
-    });
+        plan->tasks[plan->size++] = { .start = subtree, .end = cursor, .node = NULL, .arena = {}, .err_code = 0 };
+    }
+
+    free(braces);
+
+    return !broken && depth == 0;
+}
+
+static void parse_task(size_t index, void* plan) {
+    ParseTask* task = ((ParsePlan*)plan)->tasks + index;
+
+    Arena_ctor(&task->arena, TREE_TASK_ARENA_CHUNK_SIZE, &task->err_code);
+
+    const char* parse_end = read_node(&task->arena, task->node, task->start + 1, task->end + 1, NULL, &task->err_code);
+
+    _LOG_FAIL_CHECK_(parse_end == task->end + 1, "error", ERROR_REPORTS, return, &task->err_code, EINVAL);
+}
+
+static void ParsePlan_dtor(ParsePlan* plan, Arena* arena) {
+    for (size_t id = 0; id < plan->size; ++id) {
+        Arena_merge(arena, &plan->tasks[id].arena);
+    }
+
+    free(plan->tasks);
+    *plan = {};
+}
+
+static bool NodeStack_push(NodeStack* stack, const TreeNode* node) {
+    if (stack->size == stack->capacity) {
+        size_t capacity = stack->capacity ? 2 * stack->capacity : TREE_STACK_MIN_CAPACITY;
+
+        const TreeNode** data = (const TreeNode**) realloc(stack->data, capacity * sizeof(*data));
+        _LOG_FAIL_CHECK_(data, "error", ERROR_REPORTS, return false, &errno, ENOMEM);
+
+        stack->data = data;
+        stack->capacity = capacity;
+    }
+
+    stack->data[stack->size++] = node;
+    return true;
+}
+
+static void NodeStack_dtor(NodeStack* stack) {
+    free(stack->data);
+    stack->data = NULL;
+    stack->size = stack->capacity = 0;
+}
+
+static BinaryTree_status_t local_status(const TreeNode* node) {
+    if (((bool)node->left) != ((bool)node->right)) return TREE_INV_CONNECTIONS;
+    if (node->parent && (node->is_right ? node->parent->right : node->parent->left) != node) return TREE_INV_CONNECTIONS;
+    if (!node->left) return 0;
+    if (node->left->parent != node) return TREE_INV_CONNECTIONS;
+    if (node->right->parent != node) return TREE_INV_CONNECTIONS;
+    if (node->left->depth != node->depth + 1 || node->right->depth != node->depth + 1) return TREE_INV_CONNECTIONS;
+    return 0;
+}
+
+static void clear_dirty(const BinaryTree* tree) {
+    tree->dirty.size = 0;
+    tree->dirty.everything = false;
+}
+
+static void forget_dirty(const BinaryTree* tree, const TreeNode* node) {
+    DirtyList* dirty = &tree->dirty;
+
+    size_t kept = 0;
+    for (size_t id = 0; id < dirty->size; ++id) {
+        if (dirty->nodes[id] != node) dirty->nodes[kept++] = dirty->nodes[id];
+    }
+
+    dirty->size = kept;
+}
+
+static void reclaim_node(void* node, void* tree) {
+    ((TreeNode*) node)->left = ((BinaryTree*) tree)->free_nodes;
+    ((BinaryTree*) tree)->free_nodes = (TreeNode*) node;
+}
+
+static void write_text(const TreeNode* node, WriteBuffer* out, int shift, bool compact, uint64_t version) {
+    const TreeNode* root = node;
+    const TreeNode* prev = root->parent;
+
+    const char* line_break = compact ? "" : "\n";
+    if (compact) shift = 0;
+
+    // Walk the subtree through parent pointers, prev tells which way the walk came from.
+    while (true) {
+        const TreeNode* next = NULL;
+        const TreeNode* left  = TreeNode_child_at(node, false, version);
+        const TreeNode* right = TreeNode_child_at(node, true,  version);
+
+        if (prev == node->parent) {
+            WriteBuffer_fill(out, '\t', (size_t)shift);
+            WriteBuffer_put(out, "{\"", 2);
+            if (node->value) WriteBuffer_puts(out, node->value);
+            else WriteBuffer_puts(out, "(null)");
+            WriteBuffer_put(out, "\"", 1);
+
+            if (left) {
+                WriteBuffer_put(out, ",", 1);
+                WriteBuffer_puts(out, line_break);
+            } else if (right) {
+                WriteBuffer_puts(out, line_break);
+            }
+
+            next = left ? left : right;
+        } else if (left && prev == left) {
+            WriteBuffer_put(out, ",", 1);
+            if (right) WriteBuffer_puts(out, line_break);
+
+            next = right;
+        } else {
+            WriteBuffer_puts(out, line_break);
+            WriteBuffer_fill(out, '\t', (size_t)shift);
+        }
+
+        prev = node;
+
+        if (next) {
+            node = next;
+            if (!compact) ++shift;
+            continue;
+        }
+
+        WriteBuffer_put(out, "}", 1);
+
+        if (node == root) break;
+
+        node = node->parent;
+        if (!compact) --shift;
+    }
+}
+
+static bool write_binary(const TreeNode* root, uint64_t version, WriteBuffer* out, int* const err_code) {
+    BinaryTreeHeader header = {};
+    memcpy(header.magic, TREE_BINARY_MAGIC, TREE_BINARY_MAGIC_LENGTH);
+
+    // Nodes are stored in van Emde Boas order, so the node array built on load keeps descents cache-friendly.
+    FlatTree flat = {};
+    FlatTree_ctor(&flat, root, FLAT_LAYOUT_VEB, version, err_code);
+    _LOG_FAIL_CHECK_(flat.size, "error", ERROR_REPORTS, return false, err_code, ENOMEM);
+
+    BinaryTreeRecord* records = (BinaryTreeRecord*) calloc(flat.size, sizeof(*records));
+    _LOG_FAIL_CHECK_(records, "error", ERROR_REPORTS, { FlatTree_dtor(&flat); return false; }, err_code, ENOMEM);
+
+    size_t strings_size = 0;
+
+    for (uint32_t index = 0; index < flat.size; ++index) {
+        records[index].left  = flat.left[index];
+        records[index].right = flat.right[index];
+        records[index].value = (uint32_t)strings_size;
+
+        strings_size += strlen(flat.value[index] ? flat.value[index] : "") + 1;
+
+        _LOG_FAIL_CHECK_(strings_size < TREE_BINARY_NO_NODE, "error", ERROR_REPORTS, {
+            free(records);
+            FlatTree_dtor(&flat);
+            return false;
+        }, err_code, EFBIG);
+    }
+
+    header.node_count = flat.size;
+    header.strings_size = strings_size;
+
+    WriteBuffer_put(out, &header, sizeof(header));
+    WriteBuffer_put(out, records, flat.size * sizeof(*records));
+    for (uint32_t index = 0; index < flat.size; ++index) {
+        const char* value = flat.value[index] ? flat.value[index] : "";
+        WriteBuffer_put(out, value, strlen(value) + 1);
+    }
+
+    free(records);
+    FlatTree_dtor(&flat);
+
+    return true;
+}
+
+static bool sync_directory(const char* file_name) {
+    const char* slash = strrchr(file_name, '/');
+
+    char directory[TREE_FILE_NAME_SIZE] = ".";
+    if (slash == file_name) strcpy(directory, "/");
+    else if (slash) snprintf(directory, TREE_FILE_NAME_SIZE, "%.*s", (int)(slash - file_name), file_name);
+
+    int fd = open(directory, O_RDONLY | O_DIRECTORY);
+    if (fd < 0) return false;
+
+    bool success = fsync(fd) == 0;
+    close(fd);
+
+    return success;
 }
@@ -14,70 +14,419 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
 
 #include "tree_config.h"
 #include "bin_tree_reports.h"
+#include "arena/arena.h"
+#include "word_index.h"
+#include "util/epoch.h"
+
+struct TreeJournal;
 
 struct TreeNode {
     TreeNode* parent = NULL;
     char* value = NULL;
     TreeNode* left = NULL;
     TreeNode* right = NULL;
+    TreeNode* jump = NULL;  // <- Ancestor for logarithmic ancestor queries (the node itself for the root).
+    size_t depth = 0;
+    bool is_right = false;  // <- The node is the NO answer of its parent (unlike the link of the parent, it never changes).
     bool free_value = false;
+    uint64_t version = 0;   // <- Version of the tree the node appeared in.
+    TreeNode* replaced = NULL;  // <- Node that was in place of this one (or had its value) in older versions.
+
+    // Access counters, only changed with relaxed atomic increments.
+    mutable uint64_t visits = 0;    // <- Games that asked the question of the node or guessed its word.
+    mutable uint64_t lookups = 0;   // <- Definitions and comparisons of the word of the node.
 };
 
+/**
+ * @brief Count access to the node, cheap enough to be done on every game.
+ * 
+ * @param counter counter of the node to increment
+ */
+inline void TreeNode_count(uint64_t* counter) {
+    __atomic_fetch_add(counter, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Get the child of the node. Safe to call while the tree is modified (see BinaryTree_split_leaf).
+ * 
+ * @param node
+ * @param is_right get the NO answer instead of the YES one
+ * @return TreeNode* 
+ */
+inline TreeNode* TreeNode_child(const TreeNode* node, bool is_right) {
+    return __atomic_load_n(is_right ? &node->right : &node->left, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * @brief Get the child the node had in the given version of the tree.
+ * 
+ * @param node node of that version
+ * @param is_right get the NO answer instead of the YES one
+ * @param version version of the tree
+ * @return const TreeNode* 
+ */
+inline const TreeNode* TreeNode_child_at(const TreeNode* node, bool is_right, uint64_t version) {
+    const TreeNode* child = TreeNode_child(node, is_right);
+    while (child && child->version > version) child = child->replaced;
+    return child;
+}
+
+/**
+ * @brief Get the number of games that ended at the node while it was still a leaf.
+ * Splits leave these games on the question that took place of the leaf, so they keep the depth they ended at.
+ * 
+ * @param node node of that version
+ * @param version version of the tree
+ * @return uint64_t
+ */
+inline uint64_t TreeNode_ended_games(const TreeNode* node, uint64_t version = TREE_LATEST_VERSION) {
+    const TreeNode* yes_child = TreeNode_child_at(node, false, version);
+    const TreeNode* no_child = TreeNode_child_at(node, true, version);
+
+    // Games count the node before its child, so children are read first to never see more games below the node.
+    uint64_t below = (yes_child ? __atomic_load_n(&yes_child->visits, __ATOMIC_RELAXED) : 0) +
+                     (no_child ? __atomic_load_n(&no_child->visits, __ATOMIC_RELAXED) : 0);
+    uint64_t visits = __atomic_load_n(&node->visits, __ATOMIC_RELAXED);
+
+    return visits > below ? visits - below : 0;
+}
+
 void TreeNode_ctor(TreeNode* node, char* value, bool free_value, TreeNode* parent, bool is_right, int* const err_code = NULL);
 void TreeNode_dtor(TreeNode* node);
 
+/**
+ * @brief Set depth and jump pointer of the node from its parent.
+ * The parent must already have them set.
+ * 
+ * @param node
+ */
+void TreeNode_link_ancestry(TreeNode* node);
+
+/**
+ * @brief Find the ancestor of the node at the given depth in O(log(depth)) using jump pointers.
+ * 
+ * @param node
+ * @param depth depth of the ancestor (0 for the root)
+ * @return const TreeNode* ancestor, NULL if the node is not that deep
+ */
+const TreeNode* TreeNode_ancestor(const TreeNode* node, size_t depth);
+
+/**
+ * @brief Find the deepest common ancestor of two nodes in O(log(depth)) using jump pointers.
+ * 
+ * @param node_a
+ * @param node_b
+ * @return const TreeNode* common ancestor, NULL if the nodes belong to different trees
+ */
+const TreeNode* TreeNode_common_ancestor(const TreeNode* node_a, const TreeNode* node_b);
+
+/**
+ * @brief Get the node next to the given one in preorder traversal of the subtree.
+ * Uses parent pointers, so the traversal needs no additional memory.
+ * 
+ * @param node current node
+ * @param root root of the traversed subtree
+ * @param version version of the tree to traverse
+ * @return const TreeNode* next node, NULL if the traversal is over
+ */
+const TreeNode* TreeNode_next_preorder(const TreeNode* node, const TreeNode* root, uint64_t version = TREE_LATEST_VERSION);
+
+/**
+ * @brief Get the first leaf of the subtree in preorder.
+ * 
+ * @param root root of the subtree
+ * @param version version of the tree to traverse
+ * @return const TreeNode* 
+ */
+const TreeNode* TreeNode_first_leaf(const TreeNode* root, uint64_t version = TREE_LATEST_VERSION);
+
+/**
+ * @brief Get the leaf next to the given one in preorder traversal of the subtree.
+ * 
+ * @param node current leaf
+ * @param root root of the traversed subtree
+ * @param version version of the tree to traverse
+ * @return const TreeNode* next leaf, NULL if the traversal is over
+ */
+const TreeNode* TreeNode_next_leaf(const TreeNode* node, const TreeNode* root, uint64_t version = TREE_LATEST_VERSION);
+
+/**
+ * @brief Iterate over all nodes of the subtree in preorder.
+ * 
+ * @param node name of the iterator variable (const TreeNode*)
+ * @param root root of the subtree
+ */
+#define foreach_node(node, root) \
+    for (const TreeNode* node = (root); node; node = TreeNode_next_preorder(node, (root)))
+
+/**
+ * @brief Iterate over all leaves of the subtree from left to right.
+ * 
+ * @param node name of the iterator variable (const TreeNode*)
+ * @param root root of the subtree
+ */
+#define foreach_leaf(node, root) \
+    for (const TreeNode* node = TreeNode_first_leaf(root); node; node = TreeNode_next_leaf(node, (root)))
+
+/**
+ * @brief Iterate over all nodes of the subtree as it was in the given version of the tree.
+ * 
+ * @param node name of the iterator variable (const TreeNode*)
+ * @param root root of the subtree in that version
+ * @param version version of the tree
+ */
+#define foreach_node_at(node, root, version) \
+    for (const TreeNode* node = (root); node; node = TreeNode_next_preorder(node, (root), (version)))
+
+/**
+ * @brief List of nodes changed since the last successful integrity check.
+ */
+struct DirtyList {
+    const TreeNode** nodes = NULL;
+    size_t size = 0;
+    size_t capacity = 0;
+    bool everything = false;  // <- Whole tree has to be checked.
+};
+
+/**
+ * @brief Binary tree. All nodes of the tree and their values are allocated from the tree's arena
+ * (see BinaryTree_new_node and BinaryTree_new_value) and are freed all at once on destruction.
+ * Values of the nodes read from the binary file point straight into its read-only mapping (source),
+ * values read from the text file are copied to the arena.
+ * Leaves are indexed by their values to make BinaryTree_find() constant-time.
+ * Changed nodes are remembered, so that BinaryTree_status() only re-validates them.
+ * If the journal is attached, every split of the leaf is recorded in it.
+ * 
+ * Splits are serialized with BinaryTree_lock(), whole-tree operations (validation, journal compaction)
+ * exclude them with BinaryTree_lock_shared(). Threads that only follow paths of the tree and search its index
+ * do not lock it, they read inside of epoch_enter() section: nodes are never changed in place,
+ * splits publish new ones with a single store and retire the replaced leaves.
+ * Every split creates the new version of the tree, older versions stay readable through snapshots (see TreeSnapshot).
+ */
 struct BinaryTree {
     TreeNode* root = NULL;
+    uint64_t version = 0;
+    Arena arena = {};
+    WordIndex index = {};
+    EpochList retired = {};         // <- Leaves replaced by splits, they return to free_nodes when no one reads them.
+    TreeNode* free_nodes = NULL;    // <- Reclaimed nodes linked through their left pointers.
+    mutable DirtyList dirty = {};
+    TreeJournal* journal = NULL;
+    mutable pthread_rwlock_t lock = PTHREAD_RWLOCK_INITIALIZER;
+
+    const char* source = NULL;
+    size_t source_size = 0;
+    bool source_mapped = false;
 };
 
 void BinaryTree_ctor(BinaryTree* const tree, int* const err_code = NULL);
 void BinaryTree_dtor(BinaryTree* const tree);
 
 /**
- * @brief Create binary tree from given data base.
+ * @brief Acquire the tree for reading, any number of threads can read the tree at once.
  * 
- * @param tree 
- * @param file 
+ * @param tree
  */
-void BinaryTree_read(BinaryTree* const tree, FILE* file, int* const err_code = NULL);
+void BinaryTree_lock_shared(const BinaryTree* const tree);
 
 /**
- * @brief Dump subtree into dot file.
+ * @brief Acquire the tree for modification, waits until all other threads release it.
  * 
- * @param node node to dump
- * @param file destination file
+ * @param tree
  */
-void TreeNode_graph_dump(const TreeNode* node, FILE* file);
+void BinaryTree_lock(const BinaryTree* const tree);
 
 /**
- * @brief Dump the list into logs.
+ * @brief Release the tree acquired by BinaryTree_lock_shared() or BinaryTree_lock().
  * 
- * @param list
- * @param importance message importance
+ * @param tree
  */
-#define BinaryTree_dump(tree, importance) do {                          \
-    log_printf(importance, TREE_DUMP_TAG, "Called list dumping.\n");    \
-    _BinaryTree_dump_graph(tree, importance);                           \
-} while (0)
+void BinaryTree_unlock(const BinaryTree* const tree);
 
 /**
- * @brief Put a picture of the tree into logs.
+ * @brief Get the root of the tree. Safe to call while the tree is modified.
+ * 
+ * @param tree
+ * @return TreeNode* 
+ */
+inline TreeNode* BinaryTree_root(const BinaryTree* const tree) {
+    return __atomic_load_n(&tree->root, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * @brief Immutable view of the tree as it was when the snapshot was taken.
+ * Nodes of newer versions share all untouched subtrees with it, so the snapshot costs nothing to take.
+ * Nodes replaced after it are not reused until it is released.
+ * The snapshot has to be released by the thread that has taken it.
+ */
+struct TreeSnapshot {
+    const BinaryTree* tree = NULL;
+    uint64_t version = 0;
+};
+
+/**
+ * @brief Take the snapshot of the current version of the tree. Does not wait for anything.
+ * 
+ * @param tree
+ * @param snapshot
+ */
+void BinaryTree_snapshot(const BinaryTree* const tree, TreeSnapshot* snapshot);
+
+/**
+ * @brief Release the snapshot taken by BinaryTree_snapshot().
+ * 
+ * @param snapshot
+ */
+void TreeSnapshot_release(TreeSnapshot* snapshot);
+
+/**
+ * @brief Get the root of the snapshot.
+ * 
+ * @param snapshot
+ * @return const TreeNode* 
+ */
+const TreeNode* TreeSnapshot_root(const TreeSnapshot* snapshot);
+
+/**
+ * @brief Find the leaf with the word in the snapshot.
+ * 
+ * @param snapshot
+ * @param word
+ * @return const TreeNode* found leaf, NULL if there was no such word in the version of the snapshot
+ */
+const TreeNode* TreeSnapshot_find(const TreeSnapshot* snapshot, const char* word);
+
+/**
+ * @brief Check that the node is still in the tree and was not replaced by a split or a rebuild.
+ * Takes O(depth) time. The tree must not be changed meanwhile (see BinaryTree_lock_shared).
+ * 
+ * @param tree
+ * @param node
+ * @return true if the node is reachable from the root
+ */
+bool BinaryTree_is_linked(const BinaryTree* const tree, const TreeNode* node);
+
+/**
+ * @brief Allocate empty node in the tree's arena or reuse the reclaimed one.
+ * 
+ * @param tree tree the node will belong to
+ * @param err_code variable to use as errno
+ * @return TreeNode* zero-initialized node, NULL on failure
+ */
+TreeNode* BinaryTree_new_node(BinaryTree* const tree, int* const err_code = NULL);
+
+/**
+ * @brief Copy node value into the tree's arena.
+ * 
+ * @param tree tree the value will belong to
+ * @param value string to copy
+ * @param length length of the string
+ * @param err_code variable to use as errno
+ * @return char* zero-terminated copy, NULL on failure
+ */
+char* BinaryTree_new_value(BinaryTree* const tree, const char* value, size_t length, int* const err_code = NULL);
+
+enum TreeFormat {
+    TREE_FORMAT_TEXT   = 0,
+    TREE_FORMAT_BINARY = 1,
+};
+
+/**
+ * @brief Header of the binary tree file.
+ * It is followed by node_count BinaryTreeRecord-s (root first, parents before children)
+ * and the table of zero-terminated node values of strings_size bytes.
+ */
+struct BinaryTreeHeader {
+    char magic[TREE_BINARY_MAGIC_LENGTH] = {};
+    uint32_t version = TREE_BINARY_VERSION;
+    uint32_t node_count = 0;
+    uint64_t strings_size = 0;
+};
+
+/**
+ * @brief Node of the binary tree file.
+ * Children are indices in the node table (TREE_BINARY_NO_NODE if absent),
+ * value is an offset in the string table.
+ */
+struct BinaryTreeRecord {
+    uint32_t left = TREE_BINARY_NO_NODE;
+    uint32_t right = TREE_BINARY_NO_NODE;
+    uint32_t value = 0;
+};
+
+/**
+ * @brief Rebuild the index of leaf values of the tree.
+ * If several leaves share the same value, the first one in preorder is indexed.
+ * 
+ * @param tree
+ * @param err_code variable to use as errno
+ */
+void BinaryTree_build_index(BinaryTree* const tree, int* const err_code = NULL);
+
+/**
+ * @brief Replace the leaf with a question node with the new word as the YES answer
+ * and the old value of the leaf as the NO answer. The split is recorded in the journal of the tree.
+ * New nodes are built aside and published with a single store, so readers in epoch_enter() sections
+ * see either the old leaf or the whole new subtree. The old leaf is retired and reused later.
+ * Splits of one tree have to be serialized (see BinaryTree_lock).
+ * 
+ * @param tree tree the leaf belongs to
+ * @param leaf leaf to split
+ * @param question value of the new question node (should be allocated in the tree)
+ * @param word new word (should be allocated in the tree)
+ * @param err_code variable to use as errno
+ */
+void BinaryTree_split_leaf(BinaryTree* const tree, TreeNode* leaf, char* question, char* word, int* const err_code = NULL);
+
+/**
+ * @brief Remember that connections of the node have changed and have to be checked again.
+ * 
+ * @param tree tree the node belongs to
+ * @param node changed node (NULL = whole tree)
+ */
+void BinaryTree_mark_dirty(const BinaryTree* const tree, const TreeNode* node);
+
+/**
+ * @brief Determine format of the data base by its magic number.
+ * Does not move the reading position of the file.
+ * 
+ * @param file data base file
+ * @return TreeFormat 
+ */
+TreeFormat BinaryTree_get_format(FILE* file);
+
+/**
+ * @brief Create binary tree from given data base.
+ * The file is mapped into memory while it is parsed, node values are copied to the arena of the tree.
  * 
  * @param tree 
- * @param importance 
+ * @param file 
  */
-void _BinaryTree_dump_graph(const BinaryTree* const tree, unsigned int importance);
+void BinaryTree_read(BinaryTree* const tree, FILE* file, int* const err_code = NULL);
+
+/**
+ * @brief Create binary tree from data base in binary format.
+ * The file is mapped into memory read-only, node values point into its string table,
+ * so the tree keeps the mapping until destruction.
+ * 
+ * @param tree 
+ * @param file 
+ * @param err_code variable to use as errno
+ */
+void BinaryTree_read_binary(BinaryTree* const tree, FILE* file, int* const err_code = NULL);
 
 /**
- * @brief Find the node with specified value in the tree.
+ * @brief Find the leaf with specified value in the tree using the index of the tree.
  * 
  * @param tree tree to search in
  * @param word searched node value
  * @param err_code variable to use as errno
- * @return 
+ * @return TreeNode* found leaf, NULL if there is no such word
  */
 TreeNode* BinaryTree_find(const BinaryTree* const tree, const char* word, int* const err_code = NULL);
 
@@ -85,7 +434,7 @@ TreeNode* BinaryTree_find(const BinaryTree* const tree, const char* word, int* c
  * @brief Find the path to the node from the root of the tree.
  * 
  * @param node vertex to find the path to
- * @param path array to write the path to
+ * @param path array to write the path to (node->depth + 1 elements hold the whole path)
  * @param out_length variable to put length of the path to
  * @param max_length maximal length of the path
  */
@@ -101,6 +450,15 @@ void BinaryTree_fill_path(const TreeNode* node, const TreeNode* *path, size_t* c
  */
 void BinaryTree_write_content(const BinaryTree* tree, FILE* const file, int* const err_code = NULL);
 
+/**
+ * @brief Write tree content to the file in binary format.
+ * 
+ * @param tree tree to write to the file
+ * @param file write destination
+ * @param err_code variable to use as errno
+ */
+void BinaryTree_write_binary(const BinaryTree* tree, FILE* const file, int* const err_code = NULL);
+
 /**
  * @brief Write node content to the file.
  * 
@@ -108,17 +466,52 @@ void BinaryTree_write_content(const BinaryTree* tree, FILE* const file, int* con
  * @param file write destination
  * @param shift depth of the node
  * @param err_code variable to use as errno
+ * @param compact do not put line breaks and indentation
  */
-void TreeNode_write_content(const TreeNode* node, FILE* const file, int shift, int* const err_code = NULL);
+void TreeNode_write_content(const TreeNode* node, FILE* const file, int shift, int* const err_code = NULL,
+                            bool compact = false);
 
 /**
- * @brief Get status of the tree.
+ * @brief Save the tree to the file. Content is written into a temporary file which then replaces
+ * the destination, so the old content stays intact if saving fails midway.
+ * 
+ * @param tree tree to save
+ * @param file_name destination file name
+ * @param format format of the destination
+ * @param compact do not put line breaks and indentation (text format only)
+ * @param err_code variable to use as errno
+ */
+void BinaryTree_save(const BinaryTree* tree, const char* file_name, TreeFormat format, bool compact = false,
+                     int* const err_code = NULL);
+
+/**
+ * @brief Save the snapshot to the file (see BinaryTree_save). Can be called while the tree is modified.
+ * 
+ * @param snapshot snapshot to save
+ * @param file_name destination file name
+ * @param format format of the destination
+ * @param compact do not put line breaks and indentation (text format only)
+ * @param err_code variable to use as errno
+ */
+void TreeSnapshot_save(const TreeSnapshot* snapshot, const char* file_name, TreeFormat format, bool compact = false,
+                       int* const err_code = NULL);
+
+/**
+ * @brief Get status of the tree. Only the nodes changed since the last successful check are validated.
  * 
  * @param tree 
  * @return (BinaryTree_status_t) binary tree status (0 = OK)
  */
 BinaryTree_status_t BinaryTree_status(const BinaryTree* tree);
 
+/**
+ * @brief Get status of the tree validating all of its nodes.
+ * 
+ * @param tree 
+ * @return (BinaryTree_status_t) binary tree status (0 = OK)
+ */
+BinaryTree_status_t BinaryTree_full_status(const BinaryTree* tree);
+
 /**
  * @brief Get status of the connections of the node all all of its subnodes.
  * 
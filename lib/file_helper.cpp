@@ -1,21 +1,70 @@
 #include "file_helper.h"
 
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <stdlib.h>
+#include <unistd.h>
 
-int skip_to_char(FILE* file, const char target, char* const buffer, size_t limit) {
-    if (file == NULL) return -1;
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FILE_HELPER_X86
+#endif
 
-    int count = 0;
+#include "util/dbg/debug.h"
 
-    while (true) {
-        char in_c = (char)fgetc(file);
+typedef const char* (*StructuralScanner)(const char* start, const char* end);
 
-        if (in_c == target) return count;
-        if (in_c == EOF) return -1;
+/**
+ * @brief Pick the fastest implementation of find_structural() for the current processor.
+ * 
+ * @return StructuralScanner
+ */
+static StructuralScanner select_scanner();
 
-        if (buffer && (count < (int)limit || limit == 0)) buffer[count] = in_c;
-        count++;
-    }
+/**
+ * @brief Portable implementation of find_structural(), checks one byte at a time.
+ * 
+ * @param start start of the buffer
+ * @param end end of the buffer
+ * @return char* pointer to the character, end if there is none
+ */
+static const char* scan_scalar(const char* start, const char* end);
+
+#ifdef FILE_HELPER_X86
+
+/**
+ * @brief Implementation of find_structural() that checks 16 bytes at a time.
+ * 
+ * @param start start of the buffer
+ * @param end end of the buffer
+ * @return char* pointer to the character, end if there is none
+ */
+__attribute__((target("sse2"))) static const char* scan_sse2(const char* start, const char* end);
+
+/**
+ * @brief Implementation of find_structural() that checks 32 bytes at a time.
+ * 
+ * @param start start of the buffer
+ * @param end end of the buffer
+ * @return char* pointer to the character, end if there is none
+ */
+__attribute__((target("avx2"))) static const char* scan_avx2(const char* start, const char* end);
+
+#endif
+
+/**
+ * @brief Read the rest of the stream into heap buffer.
+ * 
+ * @param file stream to read
+ * @param out_size variable to put number of read characters to
+ * @param err_code variable to use as errno
+ * @return char* heap buffer, NULL on failure
+ */
+static char* read_whole_file(FILE* file, size_t* const out_size, int* const err_code);
+
+const char* find_structural(const char* start, const char* end) {
+    static const StructuralScanner scanner = select_scanner();
+    return scanner(start, end);
 }
 
 void fclose_void(FILE** ptr) {
@@ -27,4 +76,188 @@ size_t get_file_size(int fd) {
     struct stat buffer;
     fstat(fd, &buffer);
     return (size_t)buffer.st_size;
-}
\ No newline at end of file
+}
+
+const char* map_file(FILE* file, size_t* const out_size, bool* const out_mapped, int* const err_code) {
+    _LOG_FAIL_CHECK_(file,       "error", ERROR_REPORTS, return NULL, err_code, EINVAL);
+    _LOG_FAIL_CHECK_(out_size,   "error", ERROR_REPORTS, return NULL, err_code, EINVAL);
+    _LOG_FAIL_CHECK_(out_mapped, "error", ERROR_REPORTS, return NULL, err_code, EINVAL);
+
+    size_t size = get_file_size(fileno(file));
+
+    if (size > 0) {
+        void* mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+        if (mapping != MAP_FAILED) {
+            madvise(mapping, size, MADV_SEQUENTIAL);
+            *out_size = size;
+            *out_mapped = true;
+            return (const char*) mapping;
+        }
+        log_printf(WARNINGS, "warning", "Failed to map the file, falling back to reading.\n");
+    }
+
+    *out_mapped = false;
+    return read_whole_file(file, out_size, err_code);
+}
+
+void unmap_file(const char* buffer, size_t size, bool mapped) {
+    if (!buffer) return;
+
+    if (mapped) munmap((void*) buffer, size);
+    else free((void*) buffer);
+}
+
+static char* read_whole_file(FILE* file, size_t* const out_size, int* const err_code) {
+    size_t capacity = 4096;
+    size_t size = 0;
+
+    char* buffer = (char*) calloc(capacity, sizeof(*buffer));
+    _LOG_FAIL_CHECK_(buffer, "error", ERROR_REPORTS, return NULL, err_code, ENOMEM);
+
+    while (true) {
+        size += fread(buffer + size, sizeof(*buffer), capacity - size, file);
+        if (size < capacity) break;
+
+        char* new_buffer = (char*) realloc(buffer, capacity * 2);
+        _LOG_FAIL_CHECK_(new_buffer, "error", ERROR_REPORTS, { free(buffer); return NULL; }, err_code, ENOMEM);
+
+        buffer = new_buffer;
+        capacity *= 2;
+    }
+
+    *out_size = size;
+    return buffer;
+}
+
+void WriteBuffer_ctor(WriteBuffer* buffer, int fd, size_t capacity, int* const err_code) {
+    _LOG_FAIL_CHECK_(buffer, "error", ERROR_REPORTS, return, err_code, EINVAL);
+
+    buffer->fd = fd;
+    buffer->size = 0;
+    buffer->capacity = capacity ? capacity : WRITE_BUFFER_DEFAULT_CAPACITY;
+    buffer->failed = false;
+
+    buffer->data = (char*) calloc(buffer->capacity, sizeof(*buffer->data));
+    _LOG_FAIL_CHECK_(buffer->data, "error", ERROR_REPORTS, {
+        buffer->capacity = 0;
+        buffer->failed = true;
+    }, err_code, ENOMEM);
+}
+
+void WriteBuffer_dtor(WriteBuffer* buffer) {
+    if (!buffer) return;
+
+    WriteBuffer_flush(buffer);
+
+    free(buffer->data);
+    buffer->data = NULL;
+    buffer->capacity = 0;
+}
+
+void WriteBuffer_put(WriteBuffer* buffer, const void* data, size_t length) {
+    if (buffer->failed) return;
+
+    const char* source = (const char*) data;
+
+    while (length) {
+        if (buffer->size == buffer->capacity && !WriteBuffer_flush(buffer)) return;
+
+        size_t portion = buffer->capacity - buffer->size;
+        if (portion > length) portion = length;
+
+        memcpy(buffer->data + buffer->size, source, portion);
+        buffer->size += portion;
+        source += portion;
+        length -= portion;
+    }
+}
+
+void WriteBuffer_fill(WriteBuffer* buffer, char character, size_t count) {
+    if (buffer->failed) return;
+
+    while (count) {
+        if (buffer->size == buffer->capacity && !WriteBuffer_flush(buffer)) return;
+
+        size_t portion = buffer->capacity - buffer->size;
+        if (portion > count) portion = count;
+
+        memset(buffer->data + buffer->size, character, portion);
+        buffer->size += portion;
+        count -= portion;
+    }
+}
+
+bool WriteBuffer_flush(WriteBuffer* buffer) {
+    if (buffer->failed) return false;
+
+    size_t written = 0;
+    while (written < buffer->size) {
+        ssize_t result = write(buffer->fd, buffer->data + written, buffer->size - written);
+
+        if (result < 0 && errno == EINTR) continue;
+
+        _LOG_FAIL_CHECK_(result > 0, "error", ERROR_REPORTS, {
+            buffer->failed = true;
+            return false;
+        }, NULL, 0);
+
+        written += (size_t)result;
+    }
+
+    buffer->size = 0;
+    return true;
+}
+
+static StructuralScanner select_scanner() {
+#ifdef FILE_HELPER_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return scan_avx2;
+    if (__builtin_cpu_supports("sse2")) return scan_sse2;
+#endif
+    return scan_scalar;
+}
+
+static const char* scan_scalar(const char* start, const char* end) {
+    for (; start < end; ++start) {
+        if (*start == '"' || *start == '{' || *start == '}') return start;
+    }
+    return start;
+}
+
+#ifdef FILE_HELPER_X86
+
+__attribute__((target("sse2"))) static const char* scan_sse2(const char* start, const char* end) {
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i open  = _mm_set1_epi8('{');
+    const __m128i close = _mm_set1_epi8('}');
+
+    for (; end - start >= 16; start += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)start);
+        __m128i hits = _mm_or_si128(_mm_cmpeq_epi8(chunk, quote),
+                       _mm_or_si128(_mm_cmpeq_epi8(chunk, open), _mm_cmpeq_epi8(chunk, close)));
+
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(hits);
+        if (mask) return start + __builtin_ctz(mask);
+    }
+
+    return scan_scalar(start, end);
+}
+
+__attribute__((target("avx2"))) static const char* scan_avx2(const char* start, const char* end) {
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i open  = _mm256_set1_epi8('{');
+    const __m256i close = _mm256_set1_epi8('}');
+
+    for (; end - start >= 32; start += 32) {
+        __m256i chunk = _mm256_loadu_si256((const __m256i*)start);
+        __m256i hits = _mm256_or_si256(_mm256_cmpeq_epi8(chunk, quote),
+                       _mm256_or_si256(_mm256_cmpeq_epi8(chunk, open), _mm256_cmpeq_epi8(chunk, close)));
+
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(hits);
+        if (mask) return start + __builtin_ctz(mask);
+    }
+
+    return scan_sse2(start, end);
+}
+
+#endif
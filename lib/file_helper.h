@@ -13,17 +13,19 @@
 #define FILE_HELPER_H
 
 #include <stdio.h>
+#include <string.h>
+
+const size_t WRITE_BUFFER_DEFAULT_CAPACITY = 1 << 20;
 
 /**
- * @brief Jump file reading point to the first mentioned specified character.
+ * @brief Find the first structural character of the tree text format (quote or curly brace).
+ * Uses the widest vector instructions supported by the processor.
  * 
- * @param file file to read from
- * @param target character to search for
- * @param buffer (OPTIONAL) buffer to write skipped characters to
- * @param limit (OPTIONAL) buffer size (0 = infinite)
- * @return int Number of characters that were skipped, -1 in case if char was not found.
+ * @param start start of the buffer
+ * @param end end of the buffer
+ * @return char* pointer to the character, end if there is none
  */
-int skip_to_char(FILE* file, const char target, char* const buffer = NULL, size_t limit = 0);
+const char* find_structural(const char* start, const char* end);
 
 /**
  * @brief Safely close the file.
@@ -41,26 +43,86 @@ void fclose_void(FILE** ptr);
 size_t get_file_size(int fd);
 
 /**
- * @brief (USE ONLY INSIDE exec_on_char STATEMENT) Stop reading symbols and continue execution.
+ * @brief Map content of the file into memory as a read-only buffer, its pages stay shared with the page cache.
+ * Falls back to reading the file into the heap if it can not be mapped (pipes, empty files).
+ * 
+ * @param file file to map
+ * @param out_size variable to put size of the content to
+ * @param out_mapped variable to put true to if the buffer was mapped and false if it was read
+ * @param err_code variable to use as errno
+ * @return const char* buffer with file content, NULL on failure
+ */
+const char* map_file(FILE* file, size_t* const out_size, bool* const out_mapped, int* const err_code = NULL);
+
+/**
+ * @brief Release buffer obtained by map_file().
+ * 
+ * @param buffer buffer to release
+ * @param size size of the buffer
+ * @param mapped whether the buffer was mapped
+ */
+void unmap_file(const char* buffer, size_t size, bool mapped);
+
+/**
+ * @brief Output buffer that collects small writes and passes them to the file descriptor in large blocks.
+ */
+struct WriteBuffer {
+    int fd = -1;
+    char* data = NULL;
+    size_t size = 0;
+    size_t capacity = 0;
+    bool failed = false;
+};
+
+/**
+ * @brief Initialize the buffer.
+ * 
+ * @param buffer
+ * @param fd file descriptor to write to
+ * @param capacity size of the buffer (0 = WRITE_BUFFER_DEFAULT_CAPACITY)
+ * @param err_code variable to use as errno
+ */
+void WriteBuffer_ctor(WriteBuffer* buffer, int fd, size_t capacity = 0, int* const err_code = NULL);
+
+/**
+ * @brief Flush and free the buffer.
+ * 
+ * @param buffer
+ */
+void WriteBuffer_dtor(WriteBuffer* buffer);
+
+/**
+ * @brief Append data to the buffer.
+ * 
+ * @param buffer
+ * @param data data to write
+ * @param length number of bytes to write
+ */
+void WriteBuffer_put(WriteBuffer* buffer, const void* data, size_t length);
+
+/**
+ * @brief Append several copies of the character to the buffer.
+ * 
+ * @param buffer
+ * @param character character to write
+ * @param count number of copies
+ */
+void WriteBuffer_fill(WriteBuffer* buffer, char character, size_t count);
+
+/**
+ * @brief Pass the content of the buffer to the file descriptor.
  * 
+ * @param buffer
+ * @return false if writing failed
  */
-#define stop_reading() (__keep_going = false)
+bool WriteBuffer_flush(WriteBuffer* buffer);
 
 /**
- * @brief Execute specific actions on defined characters.
+ * @brief Append zero-terminated string to the buffer.
  * 
- * @param file stream to read characters from
- * @param action_list list of cations in the form of @code{.cpp} 
- *          { case 'a': {do_smt(); break;} \ case EOF: stop_reading(); }
- *      @endcode
+ * @param buffer
+ * @param str string to write
  */
-#define exec_on_char(file, action_list) do {    \
-    bool __keep_going = true;                   \
-    while (__keep_going) {                      \
-        char __in_c = (char)fgetc(file);        \
-                                                \
-        switch(__in_c) action_list              \
-    }                                           \
-} while (0)
+#define WriteBuffer_puts(buffer, str) WriteBuffer_put(buffer, str, strlen(str))
 
 #endif
\ No newline at end of file
@@ -0,0 +1,366 @@
+#include "flat_tree.h"
+
+#include <string.h>
+
+#include "bin_tree.h"
+#include "util/dbg/debug.h"
+
+#include "tree_config.h"
+
+/**
+ * @brief Growable stack of node indices.
+ */
+struct IndexStack {
+    uint32_t* data = NULL;
+    size_t size = 0;
+    size_t capacity = 0;
+};
+
+/**
+ * @brief Push the index onto the stack.
+ * 
+ * @param stack
+ * @param index
+ * @return false if the stack could not be extended
+ */
+static bool IndexStack_push(IndexStack* stack, uint32_t index);
+
+/**
+ * @brief Free the stack.
+ * 
+ * @param stack
+ */
+static void IndexStack_dtor(IndexStack* stack);
+
+/**
+ * @brief State of the van Emde Boas layout construction.
+ */
+struct VebLayout {
+    const FlatTree* flat = NULL;
+    uint32_t* order = NULL;
+    uint32_t length = 0;
+    IndexStack bottoms = {};
+    IndexStack walk = {};
+    bool failed = false;
+};
+
+/**
+ * @brief Allocate arrays of the tree.
+ * 
+ * @param flat
+ * @param size number of nodes
+ * @return false on allocation failure (the tree is left empty)
+ */
+static bool alloc_arrays(FlatTree* flat, uint32_t size);
+
+/**
+ * @brief Find the slot of the word in the index of the leaves.
+ * 
+ * @param flat
+ * @param word
+ * @return uint32_t* slot holding the leaf with the word, or the empty slot where it would be
+ */
+static uint32_t* find_word_slot(const FlatTree* flat, const char* word);
+
+/**
+ * @brief List nodes of the tree level by level.
+ * 
+ * @param flat
+ * @param order array to put old indices of the nodes to in their new order
+ */
+static void order_bfs(const FlatTree* flat, uint32_t* order);
+
+/**
+ * @brief List nodes of the subtree in van Emde Boas order: the top half of its levels first,
+ * then every subtree hanging below it, each laid out the same way.
+ * 
+ * @param layout layout state
+ * @param root index of the subtree root
+ * @param levels number of levels of the subtree to list
+ */
+static void order_veb(VebLayout* layout, uint32_t root, uint32_t levels);
+
+void FlatTree_ctor(FlatTree* flat, const TreeNode* root, FlatTreeLayout layout, uint64_t version,
+                   int* const err_code) {
+    _LOG_FAIL_CHECK_(flat, "error", ERROR_REPORTS, return, err_code, EINVAL);
+    _LOG_FAIL_CHECK_(root, "error", ERROR_REPORTS, return, err_code, EINVAL);
+
+    size_t node_count = 0;
+    foreach_node_at(node, root, version) ++node_count;
+
+    _LOG_FAIL_CHECK_(node_count < FLAT_TREE_NO_NODE, "error", ERROR_REPORTS, return, err_code, EFBIG);
+
+    const TreeNode** queue = (const TreeNode**) calloc(node_count, sizeof(*queue));
+    _LOG_FAIL_CHECK_(queue, "error", ERROR_REPORTS, return, err_code, ENOMEM);
+
+    _LOG_FAIL_CHECK_(alloc_arrays(flat, (uint32_t)node_count), "error", ERROR_REPORTS, {
+        free(queue);
+        return;
+    }, err_code, ENOMEM);
+
+    queue[0] = root;
+    flat->parent[0] = FLAT_TREE_NO_NODE;
+    uint32_t queue_length = 1;
+
+    for (uint32_t index = 0; index < flat->size; ++index) {
+        const TreeNode* node = queue[index];
+
+        flat->value[index] = node->value;
+        flat->left[index] = flat->right[index] = FLAT_TREE_NO_NODE;
+
+        const TreeNode* left  = TreeNode_child_at(node, false, version);
+        const TreeNode* right = TreeNode_child_at(node, true,  version);
+
+        if (left) {
+            flat->parent[queue_length] = index;
+            flat->left[index] = queue_length;
+            queue[queue_length++] = left;
+        }
+
+        if (right) {
+            flat->parent[queue_length] = index;
+            flat->right[index] = queue_length;
+            queue[queue_length++] = right;
+        }
+    }
+
+    free(queue);
+
+    if (layout != FLAT_LAYOUT_BFS) FlatTree_relayout(flat, layout, err_code);
+}
+
+void FlatTree_dtor(FlatTree* flat) {
+    if (!flat) return;
+
+    free(flat->left);
+    free(flat->right);
+    free(flat->parent);
+    free(flat->value);
+    free(flat->words);
+
+    *flat = {};
+}
+
+void FlatTree_index_words(FlatTree* flat, int* const err_code) {
+    _LOG_FAIL_CHECK_(flat, "error", ERROR_REPORTS, return, err_code, EINVAL);
+
+    // Leaves are about a half of the nodes, so the table is at most half full.
+    uint32_t capacity = FLAT_TREE_MIN_WORD_CAPACITY;
+    while (capacity < flat->size && capacity < FLAT_TREE_NO_NODE / 2) capacity *= 2;
+
+    free(flat->words);
+    flat->word_capacity = 0;
+
+    flat->words = (uint32_t*) calloc(capacity, sizeof(*flat->words));
+    _LOG_FAIL_CHECK_(flat->words, "error", ERROR_REPORTS, return, err_code, ENOMEM);
+
+    memset(flat->words, 0xFF, capacity * sizeof(*flat->words));
+    flat->word_capacity = capacity;
+
+    // Leaves are indexed in preorder and the first leaf of a repeated word is kept, the same one WordIndex finds.
+    for (uint32_t index = 0; index != FLAT_TREE_NO_NODE;) {
+        if (flat->left[index] != FLAT_TREE_NO_NODE) {
+            index = flat->left[index];
+            continue;
+        }
+
+        if (flat->value[index]) {
+            uint32_t* slot = find_word_slot(flat, flat->value[index]);
+            if (*slot == FLAT_TREE_NO_NODE) *slot = index;
+        }
+
+        for (uint32_t parent = flat->parent[index];; index = parent, parent = flat->parent[index]) {
+            if (parent == FLAT_TREE_NO_NODE) {
+                index = FLAT_TREE_NO_NODE;
+                break;
+            }
+
+            if (flat->left[parent] == index) {
+                index = flat->right[parent];
+                break;
+            }
+        }
+    }
+}
+
+uint32_t FlatTree_find(const FlatTree* flat, const char* word) {
+    if (!flat || !flat->word_capacity || !word) return FLAT_TREE_NO_NODE;
+
+    return *find_word_slot(flat, word);
+}
+
+void FlatTree_relayout(FlatTree* flat, FlatTreeLayout layout, int* const err_code) {
+    _LOG_FAIL_CHECK_(flat, "error", ERROR_REPORTS, return, err_code, EINVAL);
+
+    if (!flat->size) return;
+
+    uint32_t* order = (uint32_t*) calloc(flat->size, sizeof(*order));
+    _LOG_FAIL_CHECK_(order, "error", ERROR_REPORTS, return, err_code, ENOMEM);
+
+    if (layout == FLAT_LAYOUT_VEB) {
+        // Parents precede their children, so heights can be computed in a single backward pass.
+        uint32_t* height = (uint32_t*) calloc(flat->size, sizeof(*height));
+        _LOG_FAIL_CHECK_(height, "error", ERROR_REPORTS, { free(order); return; }, err_code, ENOMEM);
+
+        for (uint32_t index = flat->size; index-- > 0;) {
+            uint32_t left  = flat->left[index]  == FLAT_TREE_NO_NODE ? 0 : height[flat->left[index]];
+            uint32_t right = flat->right[index] == FLAT_TREE_NO_NODE ? 0 : height[flat->right[index]];
+            height[index] = (left > right ? left : right) + 1;
+        }
+
+        VebLayout veb = {};
+        veb.flat = flat;
+        veb.order = order;
+
+        order_veb(&veb, 0, height[0]);
+
+        IndexStack_dtor(&veb.bottoms);
+        IndexStack_dtor(&veb.walk);
+        free(height);
+
+        _LOG_FAIL_CHECK_(!veb.failed, "error", ERROR_REPORTS, { free(order); return; }, err_code, ENOMEM);
+    } else {
+        order_bfs(flat, order);
+    }
+
+    FlatTree result = {};
+    uint32_t* position = (uint32_t*) calloc(flat->size, sizeof(*position));
+
+    _LOG_FAIL_CHECK_(position && alloc_arrays(&result, flat->size), "error", ERROR_REPORTS, {
+        free(position);
+        free(order);
+        return;
+    }, err_code, ENOMEM);
+
+    for (uint32_t index = 0; index < flat->size; ++index) position[order[index]] = index;
+
+    for (uint32_t index = 0; index < flat->size; ++index) {
+        uint32_t old_index = order[index];
+
+        result.value[index] = flat->value[old_index];
+
+        uint32_t links[] = { flat->left[old_index], flat->right[old_index], flat->parent[old_index] };
+        result.left[index]   = links[0] == FLAT_TREE_NO_NODE ? FLAT_TREE_NO_NODE : position[links[0]];
+        result.right[index]  = links[1] == FLAT_TREE_NO_NODE ? FLAT_TREE_NO_NODE : position[links[1]];
+        result.parent[index] = links[2] == FLAT_TREE_NO_NODE ? FLAT_TREE_NO_NODE : position[links[2]];
+    }
+
+    free(order);
+
+    // Index of the words is moved along with the nodes.
+    if (flat->words) {
+        result.words = flat->words;
+        result.word_capacity = flat->word_capacity;
+        flat->words = NULL;
+
+        for (uint32_t slot = 0; slot < result.word_capacity; ++slot) {
+            if (result.words[slot] != FLAT_TREE_NO_NODE) result.words[slot] = position[result.words[slot]];
+        }
+    }
+
+    free(position);
+
+    FlatTree_dtor(flat);
+    *flat = result;
+}
+
+static bool IndexStack_push(IndexStack* stack, uint32_t index) {
+    if (stack->size == stack->capacity) {
+        size_t new_capacity = stack->capacity ? stack->capacity * 2 : TREE_STACK_MIN_CAPACITY;
+        uint32_t* new_data = (uint32_t*) realloc(stack->data, new_capacity * sizeof(*new_data));
+        if (!new_data) return false;
+
+        stack->data = new_data;
+        stack->capacity = new_capacity;
+    }
+
+    stack->data[stack->size++] = index;
+    return true;
+}
+
+static void IndexStack_dtor(IndexStack* stack) {
+    free(stack->data);
+    *stack = {};
+}
+
+static bool alloc_arrays(FlatTree* flat, uint32_t size) {
+    *flat = {};
+
+    flat->left   = (uint32_t*) calloc(size, sizeof(*flat->left));
+    flat->right  = (uint32_t*) calloc(size, sizeof(*flat->right));
+    flat->parent = (uint32_t*) calloc(size, sizeof(*flat->parent));
+    flat->value  = (const char**) calloc(size, sizeof(*flat->value));
+
+    if (!flat->left || !flat->right || !flat->parent || !flat->value) {
+        FlatTree_dtor(flat);
+        return false;
+    }
+
+    flat->size = size;
+    return true;
+}
+
+static uint32_t* find_word_slot(const FlatTree* flat, const char* word) {
+    hash_t hash = get_simple_hash(word, word + strlen(word));
+    uint32_t mask = flat->word_capacity - 1;
+
+    for (uint32_t position = (uint32_t)(hash ^ (hash >> 32)) & mask;; position = (position + 1) & mask) {
+        uint32_t* slot = &flat->words[position];
+        if (*slot == FLAT_TREE_NO_NODE || strcmp(flat->value[*slot], word) == 0) return slot;
+    }
+}
+
+static void order_bfs(const FlatTree* flat, uint32_t* order) {
+    order[0] = 0;
+    uint32_t length = 1;
+
+    for (uint32_t index = 0; index < length; ++index) {
+        uint32_t node = order[index];
+        if (flat->left[node]  != FLAT_TREE_NO_NODE) order[length++] = flat->left[node];
+        if (flat->right[node] != FLAT_TREE_NO_NODE) order[length++] = flat->right[node];
+    }
+}
+
+static void order_veb(VebLayout* layout, uint32_t root, uint32_t levels) {
+    if (layout->failed) return;
+
+    if (levels <= 1) {
+        layout->order[layout->length++] = root;
+        return;
+    }
+
+    uint32_t top_levels = (levels + 1) / 2;
+
+    order_veb(layout, root, top_levels);
+
+    // Roots of the bottom subtrees are collected from left to right, the walk stack holds (node, depth) pairs.
+    const FlatTree* flat = layout->flat;
+    size_t bottoms_start = layout->bottoms.size;
+
+    if (!IndexStack_push(&layout->walk, root) || !IndexStack_push(&layout->walk, 0)) layout->failed = true;
+
+    while (layout->walk.size && !layout->failed) {
+        uint32_t depth = layout->walk.data[--layout->walk.size];
+        uint32_t node  = layout->walk.data[--layout->walk.size];
+
+        if (depth == top_levels) {
+            layout->failed = !IndexStack_push(&layout->bottoms, node);
+            continue;
+        }
+
+        uint32_t children[] = { flat->right[node], flat->left[node] };
+        for (size_t id = 0; id < sizeof(children) / sizeof(*children) && !layout->failed; ++id) {
+            if (children[id] == FLAT_TREE_NO_NODE) continue;
+            layout->failed = !IndexStack_push(&layout->walk, children[id]) || !IndexStack_push(&layout->walk, depth + 1);
+        }
+    }
+
+    layout->walk.size = 0;
+
+    size_t bottoms_end = layout->bottoms.size;
+    for (size_t id = bottoms_start; id < bottoms_end && !layout->failed; ++id) {
+        order_veb(layout, layout->bottoms.data[id], levels - top_levels);
+    }
+
+    layout->bottoms.size = bottoms_start;
+}
@@ -0,0 +1,106 @@
+/**
+ * @file flat_tree.h
+ * @author Kudryashov Ilya (kudriashov.it@phystech.edu)
+ * @brief Compact read-only tree storage with 32-bit links in separate arrays.
+ * @version 0.1
+ * @date 2022-11-19
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#ifndef FLAT_TREE_H
+#define FLAT_TREE_H
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "tree_config.h"
+
+struct TreeNode;
+
+const uint32_t FLAT_TREE_NO_NODE = 0xFFFFFFFF;
+
+/**
+ * @brief Order of the nodes in the arrays.
+ */
+enum FlatTreeLayout {
+    FLAT_LAYOUT_BFS,  // <- Level by level, top levels share cache lines.
+    FLAT_LAYOUT_VEB,  // <- Van Emde Boas, every short path from a node down fits into few cache lines.
+};
+
+/**
+ * @brief Tree stored as arrays of node indices. Root is always at index 0 and parents precede their children.
+ * Values are not copied, so the source tree has to outlive the flat one.
+ * It is a read-only copy (node order of binary saves, batch queries), the game itself works on TreeNode.
+ */
+struct FlatTree {
+    uint32_t* left = NULL;
+    uint32_t* right = NULL;
+    uint32_t* parent = NULL;
+    const char** value = NULL;
+    uint32_t size = 0;
+
+    uint32_t* words = NULL;         // <- Hash table of leaves by their values, FLAT_TREE_NO_NODE in empty slots.
+    uint32_t word_capacity = 0;     // <- Power of two, 0 if the leaves are not indexed.
+};
+
+/**
+ * @brief Build flat copy of the tree.
+ * 
+ * @param flat
+ * @param root root of the tree to copy
+ * @param layout order of the nodes
+ * @param version tree version to copy
+ * @param err_code variable to use as errno
+ */
+void FlatTree_ctor(FlatTree* flat, const TreeNode* root, FlatTreeLayout layout = FLAT_LAYOUT_BFS,
+                   uint64_t version = TREE_LATEST_VERSION, int* const err_code = NULL);
+
+/**
+ * @brief Free the arrays of the tree.
+ * 
+ * @param flat
+ */
+void FlatTree_dtor(FlatTree* flat);
+
+/**
+ * @brief Reorder nodes of the tree.
+ * 
+ * @param flat
+ * @param layout new order of the nodes
+ * @param err_code variable to use as errno
+ */
+void FlatTree_relayout(FlatTree* flat, FlatTreeLayout layout, int* const err_code = NULL);
+
+/**
+ * @brief Index the leaves of the tree by their values to make FlatTree_find() constant-time.
+ * Repeated words are found at their first leaf in preorder, like in WordIndex. The index is kept by FlatTree_relayout().
+ * 
+ * @param flat
+ * @param err_code variable to use as errno
+ */
+void FlatTree_index_words(FlatTree* flat, int* const err_code = NULL);
+
+/**
+ * @brief Find the leaf with the value. Leaves must be indexed with FlatTree_index_words().
+ * 
+ * @param flat
+ * @param word searched value
+ * @return uint32_t index of the leaf, FLAT_TREE_NO_NODE if there is no such word
+ */
+uint32_t FlatTree_find(const FlatTree* flat, const char* word);
+
+/**
+ * @brief Get child of the node that corresponds to the answer to its question.
+ * 
+ * @param flat
+ * @param node index of the node
+ * @param answer true for "yes", false for "no"
+ * @return uint32_t index of the child, FLAT_TREE_NO_NODE for leaves
+ */
+static inline uint32_t FlatTree_child(const FlatTree* flat, uint32_t node, bool answer) {
+    return answer ? flat->left[node] : flat->right[node];
+}
+
+#endif
@@ -19,7 +19,8 @@ void _say(const char* format, ...) {
                                 /*   v- length of the TTS module name */
     char request[MAX_PHRASE_LENGTH + 9] = "espeak \"";
 
-    vsprintf(request + strlen(request), format, args);
+    size_t prefix_length = strlen(request);
+    vsnprintf(request + prefix_length, sizeof(request) - prefix_length - 1, format, args);
     request[strlen(request)] = '"';
     request[sizeof(request) / sizeof(*request) - 1] = '\0';
 
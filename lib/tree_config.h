@@ -13,13 +13,39 @@
 #define TREE_CONFIG_H
 
 #include <stdlib.h>
+#include <stdint.h>
 
-const size_t MAX_VALUE_LENGTH = 255;
+const size_t TREE_ARENA_CHUNK_SIZE = 1 << 20;
+const size_t TREE_STACK_MIN_CAPACITY = 64;
+const uint32_t FLAT_TREE_MIN_WORD_CAPACITY = 64;
+const size_t TREE_MAX_DIRTY_NODES = 1 << 16;
+const uint64_t TREE_LATEST_VERSION = UINT64_MAX;
+
+const size_t TREE_PARALLEL_MIN_SIZE = 1 << 20;
+const size_t TREE_PARALLEL_TASKS_PER_THREAD = 8;
+const size_t TREE_TASK_ARENA_CHUNK_SIZE = 1 << 16;
+
+#define TREE_BINARY_MAGIC "BTREEBIN"
+const size_t TREE_BINARY_MAGIC_LENGTH = 8;
+const unsigned int TREE_BINARY_VERSION = 1;
+const unsigned int TREE_BINARY_NO_NODE = 0xFFFFFFFF;
 
 const size_t TREE_PICT_NAME_SIZE = 256;
-const size_t TREE_DRAW_REQUEST_SIZE = 512;
+const size_t TREE_DUMP_MAX_NODES = 512;
+const size_t TREE_DUMP_QUEUE_CAPACITY = 16;
+
+const size_t TREE_FILE_NAME_SIZE = 1024;
+#define TREE_TEMP_FILE_SUFFIX ".tmp"
+#define TREE_JOURNAL_SUFFIX ".journal"
+const size_t TREE_JOURNAL_LENGTH_SIZE = 24;
+const unsigned int TREE_SAVER_POLL_PERIOD_MS = 100;
+const unsigned int TREE_SAVER_MIN_RETRY_DELAY = 1;     // <- Seconds.
+const unsigned int TREE_SAVER_MAX_RETRY_DELAY = 64;    // <- Seconds.
+
+const size_t TREE_STATS_BAR_WIDTH = 40;
 
 #define TREE_TEMP_DOT_FNAME "temp.dot"
+#define TREE_DRAW_PROGRAM "dot"
 #define TREE_LOG_ASSET_FOLD_NAME "log_assets"
 #define TREE_DUMP_TAG "tree_dump"
 
@@ -0,0 +1,393 @@
+#include "tree_dump.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "util/dbg/debug.h"
+
+/**
+ * @brief Graph waiting to be drawn.
+ */
+struct TreeDumpJob {
+    char* graph = NULL;
+    size_t size = 0;
+    unsigned int importance = 0;
+};
+
+/**
+ * @brief Node of the picture with the node it was reached from.
+ */
+struct TreeDumpStep {
+    const TreeNode* node = NULL;
+    const TreeNode* from = NULL;
+    size_t distance = 0;
+};
+
+static TreeDumpJob queue[TREE_DUMP_QUEUE_CAPACITY] = {};
+static size_t queue_head = 0;
+static size_t queue_size = 0;
+static bool drawing = false;        // <- The worker took a job from the queue and has not finished it yet.
+static bool worker_running = false;
+
+static pthread_t worker = {};
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_wake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t queue_done = PTHREAD_COND_INITIALIZER;
+static pthread_once_t worker_once = PTHREAD_ONCE_INIT;
+
+static size_t PictCount = 0;
+
+/**
+ * @brief Write the node of the graph.
+ *
+ * @param file
+ * @param node
+ * @param focus node to highlight
+ */
+static void write_node(FILE* file, const TreeNode* node, const TreeNode* focus);
+
+/**
+ * @brief Write the edge of the graph.
+ *
+ * @param file
+ * @param parent
+ * @param child
+ */
+static void write_edge(FILE* file, const TreeNode* parent, const TreeNode* child);
+
+/**
+ * @brief Mark the place where the branches of the node were cut off.
+ *
+ * @param file
+ * @param node
+ * @param above the parent of the node was cut off, not its children
+ */
+static void write_cut(FILE* file, const TreeNode* node, bool above);
+
+/**
+ * @brief Write the nodes close to the focus, the closest first.
+ *
+ * @param node root of the tree
+ * @param file
+ * @param view
+ */
+static void write_around(const TreeNode* node, FILE* file, const TreeDumpView* view);
+
+/**
+ * @brief Write the path from the root to the focus with the other children of its nodes.
+ *
+ * @param node root of the tree
+ * @param file
+ * @param view
+ */
+static void write_path(const TreeNode* node, FILE* file, const TreeDumpView* view);
+
+/**
+ * @brief Start the thread that draws the pictures.
+ */
+static void start_worker();
+
+/**
+ * @brief Draw the rest of the pictures and stop the worker.
+ */
+static void stop_worker();
+
+/**
+ * @brief Draw the pictures from the queue until the worker is stopped.
+ *
+ * @param argument unused
+ * @return NULL
+ */
+static void* draw_queued(void* argument);
+
+/**
+ * @brief Draw the graph and put the picture into the log.
+ *
+ * @param job
+ */
+static void draw(TreeDumpJob* job);
+
+void TreeNode_graph_dump(const TreeNode* node, FILE* file, const TreeDumpView* view) {
+    if (!node || !file) return;
+
+    TreeDumpView whole_tree = {};
+    if (!view) view = &whole_tree;
+
+    if (view->mode == TREE_DUMP_PATH) write_path(node, file, view);
+    else write_around(node, file, view);
+}
+
+void _BinaryTree_dump_graph(const BinaryTree* const tree, unsigned int importance, const TreeDumpView* view) {
+    BinaryTree_status_t status = BinaryTree_status(tree);
+    _log_printf(importance, "tree_dump", "\tTree at %p (status = %d):\n", tree, status);
+    if (status) {
+        for (size_t error_id = 0; error_id < TREE_REPORT_COUNT; ++error_id) {
+            if (status & (1 << error_id)) {
+                _log_printf(importance, "tree_dump", "\t%s\n", TREE_STATUS_DESCR[error_id]);
+            }
+        }
+    }
+
+    if (status & ~TREE_INV_CONNECTIONS) return;
+
+    // Pictures that would not get into the log are not drawn.
+    if (!log_enabled(importance)) return;
+
+    TreeDumpJob job = {};
+    job.importance = importance;
+
+    FILE* graph = open_memstream(&job.graph, &job.size);
+    _LOG_FAIL_CHECK_(graph, "error", ERROR_REPORTS, return, NULL, 0);
+
+    fputs("digraph G {\n", graph);
+    fputs(  "\trankdir=TB\n"
+            "\tlayout=dot\n"
+            , graph);
+
+    if (tree->root) TreeNode_graph_dump(tree->root, graph, view);
+
+    fputc('}', graph);
+    fclose(graph);
+
+    pthread_once(&worker_once, start_worker);
+
+    pthread_mutex_lock(&queue_lock);
+
+    bool queued = worker_running && queue_size < TREE_DUMP_QUEUE_CAPACITY;
+    bool running = worker_running;
+
+    if (queued) {
+        queue[(queue_head + queue_size++) % TREE_DUMP_QUEUE_CAPACITY] = job;
+        pthread_cond_signal(&queue_wake);
+    }
+
+    pthread_mutex_unlock(&queue_lock);
+
+    if (queued) return;
+
+    if (running) {
+        log_printf(WARNINGS, "warning", "Too many pictures of the tree are being drawn, the dump was skipped.\n");
+        free(job.graph);
+        return;
+    }
+
+    draw(&job);
+}
+
+void TreeDump_wait() {
+    pthread_mutex_lock(&queue_lock);
+    while (queue_size || drawing) pthread_cond_wait(&queue_done, &queue_lock);
+    pthread_mutex_unlock(&queue_lock);
+}
+
+static void write_node(FILE* file, const TreeNode* node, const TreeNode* focus) {
+    fprintf(file, "\tV%p [label=\"%s\"%s]\n", node, node->value ? node->value : "NULL",
+            node == focus ? " style=filled fillcolor=lightblue" : "");
+}
+
+static void write_edge(FILE* file, const TreeNode* parent, const TreeNode* child) {
+    fprintf(file, "\tV%p -> V%p [color=\"%s\"]\n", parent, child, child == parent->left ? "darkgreen" : "darkred");
+}
+
+static void write_cut(FILE* file, const TreeNode* node, bool above) {
+    char side = above ? 'U' : 'D';
+
+    fprintf(file, "\t%c%p [label=\"...\" shape=plaintext]\n", side, node);
+
+    if (above) fprintf(file, "\tU%p -> V%p [style=dashed]\n", node, node);
+    else fprintf(file, "\tV%p -> D%p [style=dashed]\n", node, node);
+}
+
+static void write_around(const TreeNode* node, FILE* file, const TreeDumpView* view) {
+    const TreeNode* start = view->focus ? view->focus : node;
+    bool upwards = view->mode == TREE_DUMP_NEIGHBORHOOD;
+
+    TreeDumpStep* steps = (TreeDumpStep*) calloc(TREE_DUMP_MAX_NODES, sizeof(*steps));
+    _LOG_FAIL_CHECK_(steps, "error", ERROR_REPORTS, return, NULL, 0);
+
+    size_t count = 0;
+    steps[count++] = { start, NULL, 0 };
+    write_node(file, start, view->focus);
+
+    if (!upwards && start->parent) write_cut(file, start, true);
+
+    // Steps are taken in the order of their distance, so the nodes that do not fit are the farthest ones.
+    // Connections may be broken at this point, the limit on the number of nodes also stops the walk in a cycle.
+    for (size_t next = 0; next < count; ++next) {
+        TreeDumpStep step = steps[next];
+
+        const TreeNode* neighbors[] = { step.node->left, step.node->right, upwards ? step.node->parent : NULL };
+        bool children_cut = false, parent_cut = false;
+
+        for (size_t id = 0; id < sizeof(neighbors) / sizeof(*neighbors); ++id) {
+            const TreeNode* neighbor = neighbors[id];
+            bool is_parent = id == 2;
+
+            if (!neighbor || neighbor == step.from) continue;
+
+            if (step.distance >= view->radius || count == TREE_DUMP_MAX_NODES) {
+                if (is_parent) parent_cut = true;
+                else children_cut = true;
+                continue;
+            }
+
+            steps[count++] = { neighbor, step.node, step.distance + 1 };
+            write_node(file, neighbor, view->focus);
+
+            if (is_parent) write_edge(file, neighbor, step.node);
+            else write_edge(file, step.node, neighbor);
+        }
+
+        if (children_cut) write_cut(file, step.node, false);
+        if (parent_cut) write_cut(file, step.node, true);
+    }
+
+    free(steps);
+}
+
+static void write_path(const TreeNode* node, FILE* file, const TreeDumpView* view) {
+    const TreeNode* focus = view->focus ? view->focus : node;
+    const TreeNode* below = NULL;   // <- Node of the path written before the current one.
+    size_t count = 0;
+
+    // The path is written from the focus up, so the part closest to it is drawn if the path is too long.
+    for (const TreeNode* current = focus; current; below = current, current = current->parent) {
+        if (count + 3 > TREE_DUMP_MAX_NODES) {
+            write_cut(file, below, true);
+            break;
+        }
+
+        write_node(file, current, focus);
+        ++count;
+
+        if (below) write_edge(file, current, below);
+
+        const TreeNode* children[] = { current->left, current->right };
+
+        for (size_t id = 0; id < sizeof(children) / sizeof(*children); ++id) {
+            const TreeNode* child = children[id];
+            if (!child || child == below) continue;
+
+            write_node(file, child, focus);
+            write_edge(file, current, child);
+            ++count;
+
+            if (child->left || child->right) write_cut(file, child, false);
+        }
+    }
+}
+
+static void start_worker() {
+    // Signals meant for the main thread (server stop requests) must not wake the worker instead.
+    sigset_t all_signals = {}, old_mask = {};
+    sigfillset(&all_signals);
+
+    // The flag is set before the start, otherwise the worker could see it unset and stop right away.
+    pthread_mutex_lock(&queue_lock);
+    worker_running = true;
+    pthread_mutex_unlock(&queue_lock);
+
+    pthread_sigmask(SIG_BLOCK, &all_signals, &old_mask);
+    int create_error = pthread_create(&worker, NULL, draw_queued, NULL);
+    pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+
+    if (create_error) {
+        pthread_mutex_lock(&queue_lock);
+        worker_running = false;
+        pthread_mutex_unlock(&queue_lock);
+    }
+
+    _LOG_FAIL_CHECK_(!create_error, "warning", WARNINGS, return, NULL, 0);
+
+    // Exit handlers run in reverse order, so the pictures get into the log before it is closed.
+    atexit(stop_worker);
+}
+
+static void stop_worker() {
+    pthread_mutex_lock(&queue_lock);
+
+    bool was_running = worker_running;
+    worker_running = false;
+    pthread_cond_signal(&queue_wake);
+
+    pthread_mutex_unlock(&queue_lock);
+
+    if (was_running) pthread_join(worker, NULL);
+}
+
+static void* draw_queued(void* argument) {
+    SILENCE_UNUSED(argument);
+
+    pthread_mutex_lock(&queue_lock);
+
+    while (true) {
+        while (worker_running && !queue_size) pthread_cond_wait(&queue_wake, &queue_lock);
+
+        // Pictures requested before the stop are still drawn.
+        if (!queue_size) break;
+
+        TreeDumpJob job = queue[queue_head];
+        queue_head = (queue_head + 1) % TREE_DUMP_QUEUE_CAPACITY;
+        --queue_size;
+        drawing = true;
+
+        pthread_mutex_unlock(&queue_lock);
+        draw(&job);
+        pthread_mutex_lock(&queue_lock);
+
+        drawing = false;
+        if (!queue_size) pthread_cond_broadcast(&queue_done);
+    }
+
+    pthread_mutex_unlock(&queue_lock);
+
+    return NULL;
+}
+
+static void draw(TreeDumpJob* job) {
+    FILE* temp_file = fopen(TREE_TEMP_DOT_FNAME, "w");
+
+    _LOG_FAIL_CHECK_(temp_file, "error", ERROR_REPORTS, {
+        free(job->graph);
+        return;
+    }, NULL, 0);
+
+    fwrite(job->graph, sizeof(*job->graph), job->size, temp_file);
+    fclose(temp_file);
+
+    free(job->graph);
+    job->graph = NULL;
+
+    if (mkdir(TREE_LOG_ASSET_FOLD_NAME, 0755) && errno != EEXIST) return;
+
+    time_t raw_time = 0;
+    time(&raw_time);
+
+    char pict_name[TREE_PICT_NAME_SIZE] = "";
+    snprintf(pict_name, TREE_PICT_NAME_SIZE, TREE_LOG_ASSET_FOLD_NAME "/" LOG_ASSET_PREFIX_FORMAT "pict%04ld_%ld.png",
+             log_segment(), (long int)__atomic_add_fetch(&PictCount, 1, __ATOMIC_RELAXED), raw_time);
+
+    char program[] = TREE_DRAW_PROGRAM;
+    char format[] = "-Tpng";
+    char output[] = "-o";
+    char source[] = TREE_TEMP_DOT_FNAME;
+
+    char* arguments[] = { program, format, output, pict_name, source, NULL };
+
+    pid_t process = 0;
+    if (posix_spawnp(&process, TREE_DRAW_PROGRAM, NULL, NULL, arguments, environ)) return;
+
+    int exit_status = 0;
+    if (waitpid(process, &exit_status, 0) < 0 || !WIFEXITED(exit_status) || WEXITSTATUS(exit_status)) return;
+
+    _log_printf(job->importance, "tree_dump",
+                "\n<details><summary>Graph</summary><img src=\"%s\"></details>\n", pict_name);
+}
@@ -0,0 +1,86 @@
+/**
+ * @file tree_dump.h
+ * @author Kudryashov Ilya (kudriashov.it@phystech.edu)
+ * @brief Pictures of the tree in the logs, drawn in the background.
+ * @version 0.1
+ * @date 2022-11-28
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef TREE_DUMP_H
+#define TREE_DUMP_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "bin_tree.h"
+
+/**
+ * @brief Parts of the tree a picture can show.
+ */
+enum TreeDumpMode {
+    TREE_DUMP_DEPTH = 0,            // <- Nodes down to the radius below the focus.
+    TREE_DUMP_NEIGHBORHOOD = 1,     // <- Nodes at most the radius edges away from the focus, up or down.
+    TREE_DUMP_PATH = 2,             // <- Path from the root to the focus with the other children of its nodes.
+};
+
+/**
+ * @brief Part of the tree to draw. Pictures never have more than TREE_DUMP_MAX_NODES nodes,
+ * nodes closer to the focus are drawn first and cut branches end with "...".
+ */
+struct TreeDumpView {
+    TreeDumpMode mode = TREE_DUMP_DEPTH;
+    const TreeNode* focus = NULL;   // <- Node the picture is centered on, the root if NULL.
+    size_t radius = SIZE_MAX;
+};
+
+/**
+ * @brief Write the part of the tree as the body of dot graph.
+ *
+ * @param node root of the tree
+ * @param file destination file
+ * @param view (optional) part of the tree to write, the whole tree (up to the node limit) by default
+ */
+void TreeNode_graph_dump(const TreeNode* node, FILE* file, const TreeDumpView* view = NULL);
+
+/**
+ * @brief Dump the part of the tree into logs.
+ *
+ * @param tree
+ * @param importance message importance
+ * @param view part of the tree to draw (NULL for the whole tree)
+ */
+#define BinaryTree_dump_view(tree, importance, view) do {               \
+    if constexpr (log_compiled(importance)) {                           \
+        log_printf(importance, TREE_DUMP_TAG, "Called list dumping.\n");\
+        _BinaryTree_dump_graph(tree, importance, view);                 \
+    }                                                                   \
+} while (0)
+
+/**
+ * @brief Dump the list into logs.
+ *
+ * @param list
+ * @param importance message importance
+ */
+#define BinaryTree_dump(tree, importance) BinaryTree_dump_view(tree, importance, NULL)
+
+/**
+ * @brief Put a picture of the tree into logs.
+ * The graph is written right away, the picture is drawn by the background thread
+ * and appears in the log when it is ready. The tree must not be changed during the call.
+ *
+ * @param tree
+ * @param importance
+ * @param view (optional) part of the tree to draw
+ */
+void _BinaryTree_dump_graph(const BinaryTree* const tree, unsigned int importance, const TreeDumpView* view = NULL);
+
+/**
+ * @brief Wait until all pictures requested so far are in the log.
+ */
+void TreeDump_wait();
+
+#endif
@@ -0,0 +1,341 @@
+#include "tree_journal.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+
+#include "util/dbg/debug.h"
+#include "file_helper.h"
+
+/**
+ * @brief Read one length-prefixed field of the entry and the separator following it.
+ * 
+ * @param cursor position to read from
+ * @param end end of the journal content
+ * @param out_field variable to put the start of the field to
+ * @param out_length variable to put the length of the field to
+ * @return const char* position after the separator, NULL if the field is broken
+ */
+static const char* read_field(const char* cursor, const char* end, const char** out_field, size_t* out_length);
+
+/**
+ * @brief Apply one entry of the journal to the tree.
+ * 
+ * @param tree
+ * @param path path to the split leaf
+ * @param path_length
+ * @param fields old word, new word and question in this order
+ * @param lengths lengths of the fields
+ * @param err_code variable to use as errno
+ * @return false if the entry does not match the tree
+ */
+static bool apply_entry(BinaryTree* tree, const char* path, size_t path_length,
+                        const char* const* fields, const size_t* lengths, int* const err_code);
+
+/**
+ * @brief Append length-prefixed field to the buffer.
+ * 
+ * @param cursor position to write to
+ * @param field field content
+ * @param length field length
+ * @param separator character to put after the field
+ * @return char* position after the separator
+ */
+static char* write_field(char* cursor, const char* field, size_t length, char separator);
+
+/**
+ * @brief Remove the first entries of the journal.
+ * Entries following them are moved into the new journal file, that replaces the old one with a single rename.
+ * 
+ * @param journal
+ * @param covered size of the removed part of the journal
+ * @param err_code variable to use as errno
+ */
+static void drop_entries(TreeJournal* journal, off_t covered, int* const err_code);
+
+/**
+ * @brief Remove the temporary file of the interrupted save of the file.
+ * 
+ * @param name name of the saved file
+ */
+static void remove_temp_file(const char* name);
+
+void TreeJournal_open(TreeJournal* journal, const char* base_name, TreeFormat base_format, bool base_compact,
+                      int* const err_code) {
+    _LOG_FAIL_CHECK_(journal,   "error", ERROR_REPORTS, return, err_code, EINVAL);
+    _LOG_FAIL_CHECK_(base_name, "error", ERROR_REPORTS, return, err_code, EINVAL);
+
+    _LOG_FAIL_CHECK_(strlen(base_name) < TREE_FILE_NAME_SIZE, "error", ERROR_REPORTS, return, err_code, ENAMETOOLONG);
+    strcpy(journal->base_name, base_name);
+    journal->base_format = base_format;
+    journal->base_compact = base_compact;
+
+    _LOG_FAIL_CHECK_(snprintf(journal->name, TREE_FILE_NAME_SIZE, "%s" TREE_JOURNAL_SUFFIX, base_name) < (int)TREE_FILE_NAME_SIZE,
+                     "error", ERROR_REPORTS, return, err_code, ENAMETOOLONG);
+
+    // Saves are finished with rename(), so the temporary files of the killed ones are never read.
+    remove_temp_file(journal->base_name);
+    remove_temp_file(journal->name);
+
+    journal->fd = open(journal->name, O_RDWR | O_CREAT | O_APPEND, 0644);
+    _LOG_FAIL_CHECK_(journal->fd >= 0, "error", ERROR_REPORTS, return, err_code, ENOENT);
+
+    journal->session_start = lseek(journal->fd, 0, SEEK_END);
+
+    log_printf(STATUS_REPORTS, "status", "Opened journal %s (%lld bytes).\n", journal->name, (long long)journal->session_start);
+}
+
+void TreeJournal_close(TreeJournal* journal) {
+    if (!journal || journal->fd < 0) return;
+
+    close(journal->fd);
+    journal->fd = -1;
+}
+
+size_t TreeJournal_replay(TreeJournal* journal, BinaryTree* tree, int* const err_code) {
+    _LOG_FAIL_CHECK_(journal && journal->fd >= 0, "error", ERROR_REPORTS, return 0, err_code, EINVAL);
+    _LOG_FAIL_CHECK_(!BinaryTree_status(tree), "error", ERROR_REPORTS, return 0, err_code, EINVAL);
+
+    size_t size = get_file_size(journal->fd);
+    if (size == 0) {
+        journal->replayed = true;
+        return 0;
+    }
+
+    char* content = (char*) calloc(size, sizeof(*content));
+    _LOG_FAIL_CHECK_(content, "error", ERROR_REPORTS, return 0, err_code, ENOMEM);
+
+    _LOG_FAIL_CHECK_(pread(journal->fd, content, size, 0) == (ssize_t)size, "error", ERROR_REPORTS,
+                     { free(content); return 0; }, err_code, EIO);
+
+    size_t applied = 0;
+    const char* cursor = content;
+    const char* end = content + size;
+
+    while (cursor < end) {
+        const char* path = NULL;
+        size_t path_length = 0;
+        const char* fields[3] = {};
+        size_t lengths[3] = {};
+
+        const char* next = read_field(cursor, end, &path, &path_length);
+        for (size_t index = 0; index < 3 && next; ++index) {
+            next = read_field(next, end, &fields[index], &lengths[index]);
+        }
+
+        if (!next || next[-1] != '\n') {
+            log_printf(WARNINGS, "warning", "Journal entry at offset %lld is broken, the rest of the journal was ignored.\n",
+                       (long long)(cursor - content));
+            break;
+        }
+
+        if (!apply_entry(tree, path, path_length, fields, lengths, err_code)) {
+            log_printf(WARNINGS, "warning", "Journal entry at offset %lld does not match the tree, the rest of the journal was ignored.\n",
+                       (long long)(cursor - content));
+            break;
+        }
+
+        ++applied;
+        cursor = next;
+    }
+
+    free(content);
+
+    journal->replayed = true;
+
+    log_printf(STATUS_REPORTS, "status", "Replayed %lld journal entries.\n", (long long)applied);
+
+    return applied;
+}
+
+void TreeJournal_record(TreeJournal* journal, const TreeNode* node, const char* old_word, const char* word,
+                        int* const err_code) {
+    _LOG_FAIL_CHECK_(journal && journal->fd >= 0, "error", ERROR_REPORTS, return, err_code, EINVAL);
+    _LOG_FAIL_CHECK_(node && node->value, "error", ERROR_REPORTS, return, err_code, EINVAL);
+    _LOG_FAIL_CHECK_(old_word && word, "error", ERROR_REPORTS, return, err_code, EINVAL);
+
+    size_t depth = 0;
+    for (const TreeNode* current = node; current->parent; current = current->parent) ++depth;
+
+    size_t old_length = strlen(old_word);
+    size_t word_length = strlen(word);
+    size_t question_length = strlen(node->value);
+
+    size_t capacity = depth + old_length + word_length + question_length + 4 * TREE_JOURNAL_LENGTH_SIZE;
+    char* entry = (char*) calloc(capacity, sizeof(*entry));
+    _LOG_FAIL_CHECK_(entry, "error", ERROR_REPORTS, return, err_code, ENOMEM);
+
+    char* cursor = entry + sprintf(entry, "%lld:", (long long)depth);
+
+    cursor += depth;
+    char* path = cursor;
+    for (const TreeNode* current = node; current->parent; current = current->parent) {
+        *--path = current->is_right ? 'n' : 'y';
+    }
+    *cursor++ = ' ';
+
+    cursor = write_field(cursor, old_word, old_length, ' ');
+    cursor = write_field(cursor, word, word_length, ' ');
+    cursor = write_field(cursor, node->value, question_length, '\n');
+
+    // Entry goes in a single write, so a crash can only leave a broken tail that replay ignores.
+    bool success = write(journal->fd, entry, (size_t)(cursor - entry)) == cursor - entry && fdatasync(journal->fd) == 0;
+
+    free(entry);
+
+    _LOG_FAIL_CHECK_(success, "error", ERROR_REPORTS, return, err_code, EIO);
+}
+
+void TreeJournal_compact(TreeJournal* journal, const BinaryTree* tree, int* const err_code) {
+    _LOG_FAIL_CHECK_(journal && journal->fd >= 0, "error", ERROR_REPORTS, return, err_code, EINVAL);
+    _LOG_FAIL_CHECK_(journal->replayed, "error", ERROR_REPORTS, return, err_code, EINVAL);
+    _LOG_FAIL_CHECK_(tree, "error", ERROR_REPORTS, return, err_code, EINVAL);
+
+    pthread_mutex_lock(&journal->checkpoint_lock);
+
+    // Splits append to the journal under the writer lock, so the snapshot contains every entry before the offset.
+    BinaryTree_lock_shared(tree);
+
+    TreeSnapshot snapshot = {};
+    BinaryTree_snapshot(tree, &snapshot);
+    off_t covered = lseek(journal->fd, 0, SEEK_END);
+
+    BinaryTree_unlock(tree);
+
+    int save_error = covered < 0 ? EIO : 0;
+    if (!save_error) {
+        TreeSnapshot_save(&snapshot, journal->base_name, journal->base_format, journal->base_compact, &save_error);
+    }
+
+    uint64_t version = snapshot.version;
+    TreeSnapshot_release(&snapshot);
+
+    // Replay skips entries that are already in the base, so a crash before the entries are dropped is harmless.
+    if (!save_error) {
+        BinaryTree_lock_shared(tree);
+        drop_entries(journal, covered, &save_error);
+        BinaryTree_unlock(tree);
+    }
+
+    pthread_mutex_unlock(&journal->checkpoint_lock);
+
+    _LOG_FAIL_CHECK_(!save_error, "error", ERROR_REPORTS, return, err_code, save_error);
+
+    journal->compacted = true;
+
+    log_printf(STATUS_REPORTS, "status", "Journal was compacted into %s (version %llu).\n",
+               journal->base_name, (unsigned long long)version);
+}
+
+void TreeJournal_rollback(TreeJournal* journal, int* const err_code) {
+    _LOG_FAIL_CHECK_(journal && journal->fd >= 0, "error", ERROR_REPORTS, return, err_code, EINVAL);
+    _LOG_FAIL_CHECK_(journal->replayed, "error", ERROR_REPORTS, return, err_code, EINVAL);
+
+    _LOG_FAIL_CHECK_(ftruncate(journal->fd, journal->session_start) == 0 && fsync(journal->fd) == 0,
+                     "error", ERROR_REPORTS, return, err_code, EIO);
+}
+
+static const char* read_field(const char* cursor, const char* end, const char** out_field, size_t* out_length) {
+    size_t length = 0;
+    const char* digit = cursor;
+
+    for (; digit < end && '0' <= *digit && *digit <= '9'; ++digit) length = length * 10 + (size_t)(*digit - '0');
+
+    if (digit == cursor || digit >= end || *digit != ':') return NULL;
+    if ((size_t)(end - digit - 1) < length + 1) return NULL;
+
+    *out_field = digit + 1;
+    *out_length = length;
+
+    return digit + 1 + length + 1;
+}
+
+static bool apply_entry(BinaryTree* tree, const char* path, size_t path_length,
+                        const char* const* fields, const size_t* lengths, int* const err_code) {
+    TreeNode* node = tree->root;
+
+    for (size_t index = 0; index < path_length; ++index) {
+        if (!node->left) return false;
+
+        if (path[index] == 'y') node = node->left;
+        else if (path[index] == 'n') node = node->right;
+        else return false;
+    }
+
+    #define MATCHES_(value, field) ((value) && strlen(value) == lengths[field] && memcmp(value, fields[field], lengths[field]) == 0)
+
+    if (node->left) {
+        // Split is already in the tree (journal was not emptied after compaction).
+        return MATCHES_(node->value, 2) && MATCHES_(node->left->value, 1) && MATCHES_(node->right->value, 0);
+    }
+
+    if (!MATCHES_(node->value, 0)) return false;
+
+    #undef MATCHES_
+
+    char* word_copy     = BinaryTree_new_value(tree, fields[1], lengths[1], err_code);
+    char* question_copy = BinaryTree_new_value(tree, fields[2], lengths[2], err_code);
+    if (!word_copy || !question_copy) return false;
+
+    BinaryTree_split_leaf(tree, node, question_copy, word_copy, err_code);
+
+    return true;
+}
+
+static char* write_field(char* cursor, const char* field, size_t length, char separator) {
+    cursor += sprintf(cursor, "%lld:", (long long)length);
+    memcpy(cursor, field, length);
+    cursor += length;
+    *cursor++ = separator;
+    return cursor;
+}
+
+static void drop_entries(TreeJournal* journal, off_t covered, int* const err_code) {
+    off_t end = lseek(journal->fd, 0, SEEK_END);
+    _LOG_FAIL_CHECK_(end >= covered, "error", ERROR_REPORTS, return, err_code, EIO);
+
+    if (end == covered) {
+        _LOG_FAIL_CHECK_(ftruncate(journal->fd, 0) == 0 && fsync(journal->fd) == 0,
+                         "error", ERROR_REPORTS, return, err_code, EIO);
+
+        journal->session_start = 0;
+        return;
+    }
+
+    size_t tail_size = (size_t)(end - covered);
+    char* tail = (char*) calloc(tail_size, sizeof(*tail));
+    _LOG_FAIL_CHECK_(tail, "error", ERROR_REPORTS, return, err_code, ENOMEM);
+
+    char temp_name[TREE_FILE_NAME_SIZE] = "";
+    bool success = snprintf(temp_name, TREE_FILE_NAME_SIZE, "%s" TREE_TEMP_FILE_SUFFIX, journal->name) < (int)TREE_FILE_NAME_SIZE
+                && pread(journal->fd, tail, tail_size, covered) == (ssize_t)tail_size;
+
+    int fd = success ? open(temp_name, O_RDWR | O_CREAT | O_TRUNC | O_APPEND, 0644) : -1;
+
+    success = fd >= 0 && write(fd, tail, tail_size) == (ssize_t)tail_size && fsync(fd) == 0
+           && rename(temp_name, journal->name) == 0;
+
+    free(tail);
+
+    _LOG_FAIL_CHECK_(success, "error", ERROR_REPORTS, {
+        if (fd >= 0) {
+            close(fd);
+            unlink(temp_name);
+        }
+        return;
+    }, err_code, EIO);
+
+    close(journal->fd);
+    journal->fd = fd;
+
+    journal->session_start = journal->session_start > covered ? journal->session_start - covered : 0;
+}
+
+static void remove_temp_file(const char* name) {
+    char temp_name[TREE_FILE_NAME_SIZE] = "";
+    if (snprintf(temp_name, TREE_FILE_NAME_SIZE, "%s" TREE_TEMP_FILE_SUFFIX, name) >= (int)TREE_FILE_NAME_SIZE) return;
+
+    int saved_errno = errno;
+    if (unlink(temp_name) == 0) log_printf(WARNINGS, "warning", "Removed %s left by the interrupted save.\n", temp_name);
+    errno = saved_errno;
+}
@@ -0,0 +1,105 @@
+/**
+ * @file tree_journal.h
+ * @author Kudryashov Ilya (kudriashov.it@phystech.edu)
+ * @brief Append-only journal of changes of the tree.
+ * @version 0.1
+ * @date 2022-11-18
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#ifndef TREE_JOURNAL_H
+#define TREE_JOURNAL_H
+
+#include <sys/types.h>
+#include <pthread.h>
+
+#include "bin_tree.h"
+
+/**
+ * @brief Journal of leaf splits made on top of the base data base file.
+ * Every split is appended and synced as soon as it is made, so learned words survive crashes.
+ * 
+ * Entry format: <length>:<path> <length>:<old word> <length>:<new word> <length>:<question>\n,
+ * where path consists of 'y' and 'n' characters leading from the root to the split leaf.
+ * 
+ * Compaction writes a snapshot of the tree into the base file and drops only the entries the snapshot covers,
+ * so it can run while the tree is being changed. Compactions are serialized with checkpoint_lock.
+ */
+struct TreeJournal {
+    int fd = -1;
+    off_t session_start = 0;
+    pthread_mutex_t checkpoint_lock = PTHREAD_MUTEX_INITIALIZER;
+
+    char name[TREE_FILE_NAME_SIZE] = "";
+    char base_name[TREE_FILE_NAME_SIZE] = "";
+    TreeFormat base_format = TREE_FORMAT_TEXT;
+    bool base_compact = false;
+
+    bool replayed = false;      // <- Entries of the journal were applied to the tree, so it can be compacted or rolled back.
+    bool compacted = false;     // <- Splits of this session were written into the base file, rollback can not drop them.
+};
+
+/**
+ * @brief Open (or create) the journal of the data base file.
+ * 
+ * @param journal
+ * @param base_name name of the data base file
+ * @param base_format format of the data base file
+ * @param base_compact write the data base without indentation on compaction
+ * @param err_code variable to use as errno
+ */
+void TreeJournal_open(TreeJournal* journal, const char* base_name, TreeFormat base_format, bool base_compact = false,
+                      int* const err_code = NULL);
+
+/**
+ * @brief Close the journal. Its content stays on the disk.
+ * 
+ * @param journal
+ */
+void TreeJournal_close(TreeJournal* journal);
+
+/**
+ * @brief Apply all entries of the journal to the tree.
+ * Entries that are already present in the tree are skipped, replay stops on the first broken entry.
+ * Compaction and rollback are refused until the journal is replayed, as they would lose its entries.
+ * 
+ * @param journal
+ * @param tree tree read from the base file
+ * @param err_code variable to use as errno
+ * @return size_t number of applied entries
+ */
+size_t TreeJournal_replay(TreeJournal* journal, BinaryTree* tree, int* const err_code = NULL);
+
+/**
+ * @brief Append the split of the leaf to the journal.
+ * 
+ * @param journal
+ * @param node split node (already containing the question)
+ * @param old_word previous value of the leaf
+ * @param word new word
+ * @param err_code variable to use as errno
+ */
+void TreeJournal_record(TreeJournal* journal, const TreeNode* node, const char* old_word, const char* word,
+                        int* const err_code = NULL);
+
+/**
+ * @brief Write the current version of the tree into the base file and drop journal entries it contains.
+ * Entries of splits made while the base file was written stay in the journal.
+ * 
+ * @param journal
+ * @param tree 
+ * @param err_code variable to use as errno
+ */
+void TreeJournal_compact(TreeJournal* journal, const BinaryTree* tree, int* const err_code = NULL);
+
+/**
+ * @brief Drop all entries made since the journal was opened or since the last compaction, whichever is later.
+ * 
+ * @param journal
+ * @param err_code variable to use as errno
+ */
+void TreeJournal_rollback(TreeJournal* journal, int* const err_code = NULL);
+
+#endif
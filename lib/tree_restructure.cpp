@@ -0,0 +1,505 @@
+#include "tree_restructure.h"
+
+#include <string.h>
+
+#include "util/dbg/debug.h"
+
+const uint32_t RESTRUCTURE_NO_QUESTION = 0xFFFFFFFF;
+
+/**
+ * @brief Word of the tree with the answers it knows.
+ */
+struct RestructureLeaf {
+    TreeNode* node = NULL;      // <- Leaf of the old tree.
+    TreeNode* copy = NULL;      // <- Leaf of the new tree.
+    uint64_t weight = 0;        // <- Popularity of the word.
+    size_t first = 0;           // <- Index of the first known answer.
+    size_t known = 0;           // <- Number of known answers (depth of the old leaf).
+};
+
+/**
+ * @brief Group of words that is yet to be placed under the parent.
+ */
+struct RestructureTask {
+    size_t begin = 0;
+    size_t end = 0;
+    TreeNode* parent = NULL;
+    bool is_right = false;
+};
+
+/**
+ * @brief Question of the old tree with its preorder index.
+ */
+struct RestructureQuestion {
+    const char* text = NULL;
+    uint32_t id = 0;
+};
+
+/**
+ * @brief State of the rebuild.
+ * Questions are identified by the preorder index of the first node with their text in the old tree.
+ */
+struct Restructure {
+    BinaryTree* tree = NULL;
+    uint64_t version = 0;
+    TreeNode* root = NULL;
+
+    const TreeNode** questions = NULL;
+    uint32_t question_count = 0;
+
+    RestructureLeaf* leaves = NULL;
+    size_t leaf_count = 0;
+
+    uint32_t* known_ids = NULL;     // <- Questions known to the words, each word has a continuous range.
+    bool* known_yes = NULL;         // <- Answers to these questions.
+
+    size_t* counts = NULL;          // <- Number of words of the group that know the question.
+    uint64_t* yes_weights = NULL;   // <- Popularity of the words of the group that answer YES to it.
+    uint32_t* touched = NULL;       // <- Questions with non-zero counts.
+
+    RestructureTask* tasks = NULL;
+    size_t task_count = 0;
+
+    TreeNode** created = NULL;      // <- Nodes of the new tree, they are given back if the rebuild fails.
+    size_t created_count = 0;
+
+    uint64_t total_weight = 0;
+    uint64_t depth_before = 0;      // <- Sum of popularity multiplied by depth of the old leaf.
+    uint64_t depth_after = 0;
+
+    bool ambiguous = false;         // <- Some words know the same answers, the tree can not be rebuilt.
+};
+
+/**
+ * @brief List words of the tree together with answers to all questions on their paths.
+ * 
+ * @param state
+ * @param err_code variable to use as errno
+ * @return false on failure
+ */
+static bool collect_leaves(Restructure* state, int* const err_code);
+
+/**
+ * @brief Give questions with the same text the same index and drop repeated questions from the words.
+ * The answer asked closest to the word is kept.
+ * 
+ * @param state
+ * @param err_code variable to use as errno
+ * @return false on failure
+ */
+static bool merge_questions(Restructure* state, int* const err_code);
+
+/**
+ * @brief Order questions by text, then by preorder index.
+ * 
+ * @param question_a
+ * @param question_b
+ * @return int
+ */
+static int compare_questions(const void* question_a, const void* question_b);
+
+/**
+ * @brief Choose the question that all words of the group know and that splits their popularity most evenly.
+ * 
+ * @param state
+ * @param task group of words
+ * @param visits variable to put total number of visits of the words to
+ * @return uint32_t index of the question, RESTRUCTURE_NO_QUESTION if nothing splits the group
+ */
+static uint32_t choose_question(Restructure* state, const RestructureTask* task, uint64_t* visits);
+
+/**
+ * @brief Get the answer of the word to the question it knows.
+ * 
+ * @param state
+ * @param leaf word
+ * @param question index of the question
+ * @return true on YES
+ */
+static bool answer_of(const Restructure* state, const RestructureLeaf* leaf, uint32_t question);
+
+/**
+ * @brief Build the new tree from the top, words of each group are reordered so that YES answers go first.
+ * 
+ * @param state
+ * @param err_code variable to use as errno
+ * @return false on failure
+ */
+static bool build(Restructure* state, int* const err_code);
+
+/**
+ * @brief Replace the tree with the new one and retire the nodes of the old one.
+ * 
+ * @param state
+ * @param err_code variable to use as errno
+ */
+static void publish(Restructure* state, int* const err_code);
+
+/**
+ * @brief Give nodes of the unfinished new tree back to the tree.
+ * 
+ * @param state
+ */
+static void discard(Restructure* state);
+
+/**
+ * @brief Free the state of the rebuild.
+ * 
+ * @param state
+ */
+static void Restructure_dtor(Restructure* state);
+
+void BinaryTree_restructure(BinaryTree* tree, RestructureReport* report, int* const err_code) {
+    _LOG_FAIL_CHECK_(tree && tree->root, "error", ERROR_REPORTS, return, err_code, EINVAL);
+
+    BinaryTree_lock(tree);
+
+    Restructure state = {};
+    state.tree = tree;
+    state.version = tree->version + 1;
+
+    bool success = collect_leaves(&state, err_code) && merge_questions(&state, err_code);
+
+    if (success && state.leaf_count > 1) {
+        success = build(&state, err_code);
+
+        // Greedy choice is not always the best one, the old tree is kept if it is not worse.
+        if (success && !state.ambiguous && state.depth_after < state.depth_before) publish(&state, err_code);
+        else discard(&state);
+    }
+
+    BinaryTree_unlock(tree);
+
+    if (success && report) {
+        double total = (double)state.total_weight;
+
+        report->leaf_count = state.leaf_count;
+        report->rebuilt = state.root != NULL;
+        report->ambiguous = state.ambiguous;
+        report->questions_before = (double)state.depth_before / total;
+        report->questions_after = state.ambiguous ? report->questions_before : (double)state.depth_after / total;
+    }
+
+    Restructure_dtor(&state);
+
+    _LOG_FAIL_CHECK_(success, "error", ERROR_REPORTS, return, NULL, 0);
+
+    log_printf(STATUS_REPORTS, "status", "Restructure of the tree of %lld words is finished.\n", (long long)state.leaf_count);
+}
+
+static bool collect_leaves(Restructure* state, int* const err_code) {
+    size_t question_count = 0;
+    size_t known_count = 0;
+    size_t max_depth = 0;
+
+    foreach_node(node, state->tree->root) {
+        if (node->depth > max_depth) max_depth = node->depth;
+
+        if (node->left) {
+            ++question_count;
+            continue;
+        }
+
+        ++state->leaf_count;
+        known_count += node->depth;
+    }
+
+    _LOG_FAIL_CHECK_(question_count < RESTRUCTURE_NO_QUESTION, "error", ERROR_REPORTS, return false, err_code, EFBIG);
+    state->question_count = (uint32_t)question_count;
+
+    state->questions   = (const TreeNode**) calloc(question_count + 1, sizeof(*state->questions));
+    state->leaves      = (RestructureLeaf*) calloc(state->leaf_count, sizeof(*state->leaves));
+    state->known_ids   = (uint32_t*) calloc(known_count + 1, sizeof(*state->known_ids));
+    state->known_yes   = (bool*) calloc(known_count + 1, sizeof(*state->known_yes));
+    state->counts      = (size_t*) calloc(question_count + 1, sizeof(*state->counts));
+    state->yes_weights = (uint64_t*) calloc(question_count + 1, sizeof(*state->yes_weights));
+    state->touched     = (uint32_t*) calloc(question_count + 1, sizeof(*state->touched));
+    state->tasks       = (RestructureTask*) calloc(state->leaf_count, sizeof(*state->tasks));
+    state->created     = (TreeNode**) calloc(2 * state->leaf_count, sizeof(*state->created));
+
+    // Question of every level of the current path of the preorder walk.
+    uint32_t* path = (uint32_t*) calloc(max_depth + 1, sizeof(*path));
+    // Games that ended at the questions of the current path while they were the leaves of the word
+    // that is reached from them by the NO answers (see BinaryTree_split_leaf).
+    uint64_t* inherited = (uint64_t*) calloc(max_depth + 1, sizeof(*inherited));
+
+    _LOG_FAIL_CHECK_(state->questions && state->leaves && state->known_ids && state->known_yes && state->counts &&
+                     state->yes_weights && state->touched && state->tasks && state->created && path && inherited,
+                     "error", ERROR_REPORTS, { free(path); free(inherited); return false; }, err_code, ENOMEM);
+
+    uint32_t question_id = 0;
+    size_t leaf_id = 0;
+    size_t known_id = 0;
+
+    foreach_node(node, state->tree->root) {
+        inherited[node->depth] = node->is_right ?
+                                 inherited[node->depth - 1] + TreeNode_ended_games(node->parent) : 0;
+
+        if (node->left) {
+            path[node->depth] = question_id;
+            state->questions[question_id++] = node;
+            state->depth_before += TreeNode_ended_games(node) * node->depth;
+            continue;
+        }
+
+        RestructureLeaf* leaf = &state->leaves[leaf_id++];
+        leaf->node = (TreeNode*)node;
+        leaf->weight = __atomic_load_n(&node->visits, __ATOMIC_RELAXED) + inherited[node->depth] + 1;
+        leaf->first = known_id;
+        leaf->known = node->depth;
+
+        // Walking up from the leaf, each node tells which answer its parent was given.
+        for (const TreeNode* current = node; current->parent; current = current->parent) {
+            state->known_ids[known_id + current->depth - 1] = path[current->depth - 1];
+            state->known_yes[known_id + current->depth - 1] = !current->is_right;
+        }
+        known_id += node->depth;
+
+        state->total_weight += leaf->weight;
+        state->depth_before += (leaf->weight - inherited[node->depth]) * node->depth;
+    }
+
+    free(path);
+    free(inherited);
+
+    return true;
+}
+
+static bool merge_questions(Restructure* state, int* const err_code) {
+    RestructureQuestion* sorted = (RestructureQuestion*) calloc(state->question_count + 1, sizeof(*sorted));
+    _LOG_FAIL_CHECK_(sorted, "error", ERROR_REPORTS, return false, err_code, ENOMEM);
+
+    for (uint32_t id = 0; id < state->question_count; ++id) {
+        sorted[id].text = state->questions[id]->value ? state->questions[id]->value : "";
+        sorted[id].id = id;
+    }
+
+    qsort(sorted, state->question_count, sizeof(*sorted), compare_questions);
+
+    // Touched list is not needed until the rebuild, it maps preorder indices to merged ones meanwhile.
+    uint32_t* merged = state->touched;
+    for (uint32_t index = 0; index < state->question_count; ++index) {
+        bool same = index && !strcmp(sorted[index].text, sorted[index - 1].text);
+        merged[sorted[index].id] = same ? merged[sorted[index - 1].id] : sorted[index].id;
+    }
+
+    free(sorted);
+
+    for (size_t leaf_id = 0; leaf_id < state->leaf_count; ++leaf_id) {
+        RestructureLeaf* leaf = &state->leaves[leaf_id];
+        size_t kept = 0;
+
+        uint32_t* ids = state->known_ids + leaf->first;
+        bool* answers = state->known_yes + leaf->first;
+
+        // Answers are stored from the root down, the word keeps the one closest to it.
+        for (size_t index = 0; index < leaf->known / 2; ++index) {
+            size_t mirror = leaf->known - 1 - index;
+
+            uint32_t id = ids[index];
+            ids[index] = ids[mirror];
+            ids[mirror] = id;
+
+            bool answer = answers[index];
+            answers[index] = answers[mirror];
+            answers[mirror] = answer;
+        }
+
+        for (size_t index = 0; index < leaf->known; ++index) {
+            uint32_t question = merged[ids[index]];
+            if (state->counts[question] == leaf_id + 1) continue;
+            state->counts[question] = leaf_id + 1;
+
+            ids[kept] = question;
+            answers[kept] = answers[index];
+            ++kept;
+        }
+
+        leaf->known = kept;
+    }
+
+    for (uint32_t id = 0; id < state->question_count; ++id) {
+        state->counts[id] = 0;
+        state->touched[id] = 0;
+    }
+
+    return true;
+}
+
+static int compare_questions(const void* question_a, const void* question_b) {
+    const RestructureQuestion* first = (const RestructureQuestion*) question_a;
+    const RestructureQuestion* second = (const RestructureQuestion*) question_b;
+
+    int order = strcmp(first->text, second->text);
+    if (order) return order;
+
+    return first->id < second->id ? -1 : first->id > second->id;
+}
+
+static uint32_t choose_question(Restructure* state, const RestructureTask* task, uint64_t* visits) {
+    uint64_t total = 0;
+    uint32_t touched_count = 0;
+
+    for (size_t index = task->begin; index < task->end; ++index) {
+        const RestructureLeaf* leaf = &state->leaves[index];
+        total += leaf->weight;
+
+        for (size_t known = leaf->first; known < leaf->first + leaf->known; ++known) {
+            uint32_t question = state->known_ids[known];
+
+            if (!state->counts[question]) state->touched[touched_count++] = question;
+
+            ++state->counts[question];
+            if (state->known_yes[known]) state->yes_weights[question] += leaf->weight;
+        }
+    }
+
+    // Words are leaves, so the information gain of the question is the entropy of the split itself,
+    // the highest one belongs to the question with the heaviest lighter side.
+    uint32_t best = RESTRUCTURE_NO_QUESTION;
+    uint64_t best_balance = 0;
+
+    for (uint32_t index = 0; index < touched_count; ++index) {
+        uint32_t question = state->touched[index];
+
+        if (state->counts[question] == task->end - task->begin) {
+            uint64_t yes = state->yes_weights[question];
+            uint64_t balance = yes < total - yes ? yes : total - yes;
+
+            // Ties go to the question that was closer to the root.
+            if (balance > best_balance || (balance && balance == best_balance && question < best)) {
+                best = question;
+                best_balance = balance;
+            }
+        }
+
+        state->counts[question] = 0;
+        state->yes_weights[question] = 0;
+    }
+
+    // Every popularity has a bonus of one game.
+    *visits = total - (task->end - task->begin);
+
+    return best;
+}
+
+static bool answer_of(const Restructure* state, const RestructureLeaf* leaf, uint32_t question) {
+    for (size_t known = leaf->first; known < leaf->first + leaf->known; ++known) {
+        if (state->known_ids[known] == question) return state->known_yes[known];
+    }
+
+    return false;
+}
+
+static bool build(Restructure* state, int* const err_code) {
+    RestructureTask* first = &state->tasks[state->task_count++];
+    first->begin = 0;
+    first->end = state->leaf_count;
+
+    while (state->task_count) {
+        RestructureTask task = state->tasks[--state->task_count];
+
+        TreeNode* node = BinaryTree_new_node(state->tree, err_code);
+        _LOG_FAIL_CHECK_(node, "error", ERROR_REPORTS, return false, err_code, ENOMEM);
+        state->created[state->created_count++] = node;
+
+        if (task.end - task.begin == 1) {
+            RestructureLeaf* leaf = &state->leaves[task.begin];
+
+            TreeNode_ctor(node, leaf->node->value, false, task.parent, task.is_right, err_code);
+            // The word takes the games that ended at the questions above it, the new tree has no such questions.
+            node->visits = leaf->weight - 1;
+            node->lookups = __atomic_load_n(&leaf->node->lookups, __ATOMIC_RELAXED);
+            node->replaced = leaf->node;
+
+            leaf->copy = node;
+            state->depth_after += leaf->weight * node->depth;
+        } else {
+            uint64_t visits = 0;
+            uint32_t question = choose_question(state, &task, &visits);
+
+            // Words are never asked for by a question: the game would ask for the word twice
+            // and definitions would lose the criteria. Only a tree that contradicts itself runs out of questions.
+            if (question == RESTRUCTURE_NO_QUESTION) {
+                log_printf(WARNINGS, "warning", "Words \"%s\" and \"%s\" can not be told apart, the tree was kept.\n",
+                           state->leaves[task.begin].node->value ? state->leaves[task.begin].node->value : "",
+                           state->leaves[task.begin + 1].node->value ? state->leaves[task.begin + 1].node->value : "");
+                state->ambiguous = true;
+                return true;
+            }
+
+            TreeNode_ctor(node, state->questions[question]->value, false, task.parent, task.is_right, err_code);
+            node->visits = visits;
+
+            size_t middle = task.begin;
+            for (size_t index = task.begin; index < task.end; ++index) {
+                if (!answer_of(state, &state->leaves[index], question)) continue;
+
+                RestructureLeaf swap = state->leaves[index];
+                state->leaves[index] = state->leaves[middle];
+                state->leaves[middle++] = swap;
+            }
+
+            // NO answers are pushed first, so that the YES subtree is built first.
+            RestructureTask* no_task = &state->tasks[state->task_count++];
+            *no_task = { middle, task.end, node, true };
+
+            RestructureTask* yes_task = &state->tasks[state->task_count++];
+            *yes_task = { task.begin, middle, node, false };
+        }
+
+        node->version = state->version;
+        if (!task.parent) state->root = node;
+    }
+
+    return true;
+}
+
+static void publish(Restructure* state, int* const err_code) {
+    BinaryTree* tree = state->tree;
+    TreeNode* old_root = tree->root;
+
+    // Older versions reach the old tree through the replaced pointer of the root.
+    state->root->replaced = old_root;
+
+    // The index gets the copies before the new tree is published, the same way as after a split.
+    // Older versions get from the copies to the old leaves through their replaced pointers.
+    foreach_leaf(copy, state->root) {
+        if (!copy->value) continue;
+
+        // The first copy of the word in preorder is indexed, like on the load of the tree.
+        TreeNode* indexed = WordIndex_find(&tree->index, copy->value);
+        if (!indexed || indexed->version < state->version) WordIndex_insert(&tree->index, copy->value, (TreeNode*)copy, err_code);
+    }
+
+    __atomic_store_n(&tree->root, state->root, __ATOMIC_RELEASE);
+    __atomic_store_n(&tree->version, state->version, __ATOMIC_RELEASE);
+
+    foreach_node(node, old_root) EpochList_retire(&tree->retired, (TreeNode*)node, err_code);
+
+    BinaryTree_mark_dirty(tree, NULL);
+}
+
+static void discard(Restructure* state) {
+    for (size_t index = 0; index < state->created_count; ++index) {
+        state->created[index]->left = state->tree->free_nodes;
+        state->tree->free_nodes = state->created[index];
+    }
+
+    state->created_count = 0;
+    state->root = NULL;
+}
+
+static void Restructure_dtor(Restructure* state) {
+    free(state->questions);
+    free(state->leaves);
+    free(state->known_ids);
+    free(state->known_yes);
+    free(state->counts);
+    free(state->yes_weights);
+    free(state->touched);
+    free(state->tasks);
+    free(state->created);
+
+    *state = {};
+}
@@ -0,0 +1,49 @@
+/**
+ * @file tree_restructure.h
+ * @author Kudryashov Ilya (kudriashov.it@phystech.edu)
+ * @brief Rebuilding of the tree that minimizes the expected number of questions per game.
+ * @version 0.1
+ * @date 2022-11-25
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#ifndef TREE_RESTRUCTURE_H
+#define TREE_RESTRUCTURE_H
+
+#include "bin_tree.h"
+
+/**
+ * @brief Expected number of questions per game before and after the rebuild.
+ */
+struct RestructureReport {
+    double questions_before = 0.0;
+    double questions_after = 0.0;   // <- Also set if the new tree was built but not published.
+    size_t leaf_count = 0;
+    bool rebuilt = false;       // <- The new tree was published, the old one was not better.
+    bool ambiguous = false;     // <- Some words can not be told apart by the questions, the new tree was not built.
+};
+
+/**
+ * @brief Rebuild the tree so that popular words are guessed in fewer questions.
+ * Popularity of the word is the number of games that ended at its leaf (TreeNode::visits) plus one.
+ * 
+ * Every word only knows answers to the questions on its path, questions with the same text are the same question.
+ * The tree is rebuilt greedily from the top: each node gets the question that all of its words know the answer to
+ * and that splits their popularity most evenly (the one with the highest information gain).
+ * Only questions of the old tree are asked, so definitions of the words stay true, although their criteria may change.
+ * Tree that has words with the same answers to all of their questions is kept as it is.
+ * 
+ * The new tree replaces the old one only if it takes fewer questions on average.
+ * It is published as a new version with a single store, readers of the old one are not disturbed.
+ * Paths in the journal become invalid, so the journal of the tree has to be compacted right after the rebuild,
+ * before any other split.
+ * 
+ * @param tree
+ * @param report variable to put expected numbers of questions to (can be NULL)
+ * @param err_code variable to use as errno
+ */
+void BinaryTree_restructure(BinaryTree* tree, RestructureReport* report = NULL, int* const err_code = NULL);
+
+#endif
@@ -0,0 +1,143 @@
+#include "tree_saver.h"
+
+#include <signal.h>
+#include <time.h>
+
+#include "util/dbg/debug.h"
+
+/**
+ * @brief Make checkpoints until the saver is stopped.
+ * 
+ * @param saver_ptr TreeSaver* to serve
+ * @return NULL
+ */
+static void* save_periodically(void* saver_ptr);
+
+/**
+ * @brief Check if the checkpoint has to be made.
+ * 
+ * @param saver
+ * @param version current version of the tree
+ * @param last_checkpoint time of the previous attempt to make the checkpoint
+ * @return true if one of the limits was reached and the retry delay has passed
+ */
+static bool checkpoint_due(const TreeSaver* saver, uint64_t version, const struct timespec* last_checkpoint);
+
+void TreeSaver_start(TreeSaver* saver, TreeJournal* journal, const BinaryTree* tree, unsigned int period,
+                     uint64_t split_limit, int* const err_code) {
+    _LOG_FAIL_CHECK_(saver && !saver->running, "error", ERROR_REPORTS, return, err_code, EINVAL);
+    _LOG_FAIL_CHECK_(journal && tree, "error", ERROR_REPORTS, return, err_code, EINVAL);
+
+    if (!period && !split_limit) return;
+
+    saver->journal = journal;
+    saver->tree = tree;
+    saver->period = period;
+    saver->split_limit = split_limit;
+
+    // Splits replayed from the journal are not in the base file yet, the base itself is version 0.
+    saver->saved_version = 0;
+    saver->retry_delay = 0;
+    saver->checkpoint_count = 0;
+
+    saver->running = true;
+
+    // Signals meant for the main thread (server stop requests) must not wake the saver instead.
+    sigset_t all_signals = {}, old_mask = {};
+    sigfillset(&all_signals);
+
+    pthread_sigmask(SIG_BLOCK, &all_signals, &old_mask);
+    int create_error = pthread_create(&saver->thread, NULL, save_periodically, saver);
+    pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+
+    _LOG_FAIL_CHECK_(!create_error, "error", ERROR_REPORTS, {
+        saver->running = false;
+        return;
+    }, err_code, create_error);
+
+    log_printf(STATUS_REPORTS, "status", "Started background saver (period %u s, limit %llu splits).\n",
+               period, (unsigned long long)split_limit);
+}
+
+void TreeSaver_stop(TreeSaver* saver) {
+    if (!saver || !saver->running) return;
+
+    pthread_mutex_lock(&saver->lock);
+    saver->running = false;
+    pthread_cond_signal(&saver->wake);
+    pthread_mutex_unlock(&saver->lock);
+
+    pthread_join(saver->thread, NULL);
+
+    log_printf(STATUS_REPORTS, "status", "Stopped background saver after %lld checkpoints.\n",
+               (long long)saver->checkpoint_count);
+}
+
+static void* save_periodically(void* saver_ptr) {
+    TreeSaver* saver = (TreeSaver*) saver_ptr;
+
+    struct timespec last_checkpoint = {};
+    clock_gettime(CLOCK_MONOTONIC, &last_checkpoint);
+
+    pthread_mutex_lock(&saver->lock);
+
+    while (saver->running) {
+        // Deadline only sets the polling rate, so the wall clock jumps do not matter.
+        struct timespec deadline = {};
+        clock_gettime(CLOCK_REALTIME, &deadline);
+
+        deadline.tv_nsec += (long)TREE_SAVER_POLL_PERIOD_MS * 1000000;
+        deadline.tv_sec += deadline.tv_nsec / 1000000000;
+        deadline.tv_nsec %= 1000000000;
+
+        pthread_cond_timedwait(&saver->wake, &saver->lock, &deadline);
+        if (!saver->running) break;
+
+        uint64_t version = __atomic_load_n(&saver->tree->version, __ATOMIC_ACQUIRE);
+        if (!checkpoint_due(saver, version, &last_checkpoint)) continue;
+
+        pthread_mutex_unlock(&saver->lock);
+
+        // Splits continue while the snapshot is written, the ones it misses stay in the journal.
+        int save_error = 0;
+        TreeJournal_compact(saver->journal, saver->tree, &save_error);
+
+        pthread_mutex_lock(&saver->lock);
+
+        clock_gettime(CLOCK_MONOTONIC, &last_checkpoint);
+
+        if (save_error) {
+            // Changes are still in the journal, the checkpoint is retried once the delay passes.
+            saver->retry_delay = saver->retry_delay ? saver->retry_delay * 2 : TREE_SAVER_MIN_RETRY_DELAY;
+            if (saver->retry_delay > TREE_SAVER_MAX_RETRY_DELAY) saver->retry_delay = TREE_SAVER_MAX_RETRY_DELAY;
+
+            log_printf(WARNINGS, "warning", "Checkpoint failed (error %d), next attempt in %u s.\n",
+                       save_error, saver->retry_delay);
+            continue;
+        }
+
+        saver->saved_version = version;
+        saver->retry_delay = 0;
+        ++saver->checkpoint_count;
+    }
+
+    pthread_mutex_unlock(&saver->lock);
+
+    return NULL;
+}
+
+static bool checkpoint_due(const TreeSaver* saver, uint64_t version, const struct timespec* last_checkpoint) {
+    if (version == saver->saved_version) return false;
+
+    struct timespec now = {};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    time_t elapsed = now.tv_sec - last_checkpoint->tv_sec;
+
+    // Failed checkpoint was due already, it only waits for the delay.
+    if (saver->retry_delay) return elapsed >= (time_t)saver->retry_delay;
+
+    if (saver->split_limit && version - saver->saved_version >= saver->split_limit) return true;
+
+    return saver->period && elapsed >= (time_t)saver->period;
+}
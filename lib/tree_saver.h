@@ -0,0 +1,61 @@
+/**
+ * @file tree_saver.h
+ * @author Kudryashov Ilya (kudriashov.it@phystech.edu)
+ * @brief Background checkpoints of the tree into its data base file.
+ * @version 0.1
+ * @date 2022-11-23
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#ifndef TREE_SAVER_H
+#define TREE_SAVER_H
+
+#include <pthread.h>
+
+#include "bin_tree.h"
+#include "tree_journal.h"
+
+/**
+ * @brief Thread compacting the journal of the tree while the tree is used by others.
+ * Checkpoint is made once the tree was changed and the period has passed since the previous one,
+ * or once the number of splits since the previous one reaches the limit.
+ * Failed checkpoints are retried with the delay doubling up to TREE_SAVER_MAX_RETRY_DELAY.
+ */
+struct TreeSaver {
+    pthread_t thread = {};
+    pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+    pthread_cond_t wake = PTHREAD_COND_INITIALIZER;
+    bool running = false;
+
+    TreeJournal* journal = NULL;
+    const BinaryTree* tree = NULL;
+    unsigned int period = 0;        // <- Seconds between checkpoints (0 - not limited by time).
+    uint64_t split_limit = 0;       // <- Splits between checkpoints (0 - not limited by splits).
+    uint64_t saved_version = 0;     // <- Version of the tree at the last successful checkpoint.
+    unsigned int retry_delay = 0;   // <- Seconds to wait after the failed checkpoint before the next attempt.
+    size_t checkpoint_count = 0;
+};
+
+/**
+ * @brief Start making checkpoints in the background. Does nothing if neither limit was specified.
+ * 
+ * @param saver
+ * @param journal journal to compact
+ * @param tree tree the journal belongs to
+ * @param period seconds between checkpoints (0 - not limited by time)
+ * @param split_limit splits between checkpoints (0 - not limited by splits)
+ * @param err_code variable to use as errno
+ */
+void TreeSaver_start(TreeSaver* saver, TreeJournal* journal, const BinaryTree* tree, unsigned int period,
+                     uint64_t split_limit, int* const err_code = NULL);
+
+/**
+ * @brief Stop the saver and wait for the checkpoint in progress. Changes since the last checkpoint stay in the journal.
+ * 
+ * @param saver
+ */
+void TreeSaver_stop(TreeSaver* saver);
+
+#endif
@@ -0,0 +1,43 @@
+#include "bin_tree.h"
+
+#include "util/epoch.h"
+
+void BinaryTree_snapshot(const BinaryTree* const tree, TreeSnapshot* snapshot) {
+    if (!snapshot) return;
+
+    *snapshot = {};
+    if (!tree) return;
+
+    // The read section keeps nodes replaced after this moment from being reused.
+    epoch_enter();
+
+    snapshot->tree = tree;
+    snapshot->version = __atomic_load_n(&tree->version, __ATOMIC_ACQUIRE);
+}
+
+void TreeSnapshot_release(TreeSnapshot* snapshot) {
+    if (!snapshot || !snapshot->tree) return;
+
+    snapshot->tree = NULL;
+
+    epoch_exit();
+}
+
+const TreeNode* TreeSnapshot_root(const TreeSnapshot* snapshot) {
+    if (!snapshot || !snapshot->tree) return NULL;
+
+    const TreeNode* root = BinaryTree_root(snapshot->tree);
+    while (root && root->version > snapshot->version) root = root->replaced;
+
+    return root;
+}
+
+const TreeNode* TreeSnapshot_find(const TreeSnapshot* snapshot, const char* word) {
+    if (!snapshot || !snapshot->tree) return NULL;
+
+    // Index holds the newest leaf of the word, its older copies are linked through replaced pointers.
+    const TreeNode* node = WordIndex_find(&snapshot->tree->index, word);
+    while (node && node->version > snapshot->version) node = node->replaced;
+
+    return node;
+}
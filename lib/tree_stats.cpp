@@ -0,0 +1,208 @@
+#include "tree_stats.h"
+
+#include "util/dbg/debug.h"
+
+/**
+ * @brief Total number of accesses to the node listed in the statistics.
+ * 
+ * @param entry
+ * @return uint64_t
+ */
+static uint64_t heat(const TreeStatsEntry* entry);
+
+/**
+ * @brief Offer the node to the min-heap of the hottest nodes.
+ * 
+ * @param stats statistics with the heap
+ * @param capacity maximal size of the heap
+ * @param entry counters of the node
+ */
+static void offer_hot(TreeStats* stats, size_t capacity, const TreeStatsEntry* entry);
+
+/**
+ * @brief Restore heap order below the element.
+ * 
+ * @param heap
+ * @param size size of the heap
+ * @param index index of the element
+ */
+static void sift_down(TreeStatsEntry* heap, size_t size, size_t index);
+
+/**
+ * @brief Make sure histograms have a bucket for the depth.
+ * 
+ * @param stats
+ * @param depth
+ * @return false if there is not enough memory
+ */
+static bool reserve_depth(TreeStats* stats, size_t depth);
+
+/**
+ * @brief Order entries from the hottest one to the coldest one.
+ */
+static int compare_heat(const void* entry_a, const void* entry_b);
+
+void TreeStats_collect(TreeStats* stats, const TreeSnapshot* snapshot, size_t top_count, int* const err_code) {
+    _LOG_FAIL_CHECK_(stats, "error", ERROR_REPORTS, return, err_code, EINVAL);
+    _LOG_FAIL_CHECK_(snapshot && snapshot->tree, "error", ERROR_REPORTS, return, err_code, EINVAL);
+
+    TreeStats_dtor(stats);
+
+    if (top_count) {
+        stats->hot = (TreeStatsEntry*) calloc(top_count, sizeof(*stats->hot));
+        _LOG_FAIL_CHECK_(stats->hot, "error", ERROR_REPORTS, return, err_code, ENOMEM);
+    }
+
+    const TreeNode* root = TreeSnapshot_root(snapshot);
+
+    foreach_node_at(node, root, snapshot->version) {
+        TreeStatsEntry entry = {};
+        entry.value = node->value;
+        entry.depth = node->depth;
+        entry.visits = __atomic_load_n(&node->visits, __ATOMIC_RELAXED);
+        entry.lookups = __atomic_load_n(&node->lookups, __ATOMIC_RELAXED);
+        entry.is_leaf = !node->left;
+
+        if (top_count && heat(&entry)) offer_hot(stats, top_count, &entry);
+
+        // Questions keep the games that ended at them before they took place of the leaf.
+        uint64_t ended = entry.is_leaf ? entry.visits : TreeNode_ended_games(node, snapshot->version);
+        if (!entry.is_leaf && !ended) continue;
+
+        _LOG_FAIL_CHECK_(reserve_depth(stats, entry.depth), "error", ERROR_REPORTS, {
+            TreeStats_dtor(stats);
+            return;
+        }, err_code, ENOMEM);
+
+        // Every question on the path to the leaf was asked once per game that ended there.
+        stats->games += ended;
+        stats->questions += ended * entry.depth;
+        stats->depth_games[entry.depth] += ended;
+
+        if (!entry.is_leaf) continue;
+
+        stats->lookups += entry.lookups;
+        stats->leaf_depth_sum += entry.depth;
+        ++stats->leaf_count;
+        ++stats->depth_leaves[entry.depth];
+    }
+
+    if (stats->hot_count) qsort(stats->hot, stats->hot_count, sizeof(*stats->hot), compare_heat);
+}
+
+void TreeStats_print(const TreeStats* stats, FILE* out) {
+    if (!stats || !out) return;
+
+    fprintf(out, "Games finished: %llu, questions per game: %.2f (average leaf depth %.2f).\n",
+            (unsigned long long)stats->games,
+            stats->games ? (double)stats->questions / (double)stats->games : 0.0,
+            stats->leaf_count ? (double)stats->leaf_depth_sum / (double)stats->leaf_count : 0.0);
+    fprintf(out, "Definitions and comparisons: %llu.\n", (unsigned long long)stats->lookups);
+
+    if (stats->hot_count) fprintf(out, "Hottest nodes:\n");
+
+    for (size_t index = 0; index < stats->hot_count; ++index) {
+        const TreeStatsEntry* entry = &stats->hot[index];
+        fprintf(out, "%4lld. %s \"%s\" at depth %lld: %llu visits, %llu lookups.\n",
+                (long long)index + 1, entry->is_leaf ? "word" : "question",
+                entry->value ? entry->value : "(null)", (long long)entry->depth,
+                (unsigned long long)entry->visits, (unsigned long long)entry->lookups);
+    }
+
+    uint64_t max_games = 0;
+    for (size_t depth = 0; depth < stats->depth_count; ++depth) {
+        if (stats->depth_games[depth] > max_games) max_games = stats->depth_games[depth];
+    }
+
+    if (stats->depth_count) fprintf(out, "Games by depth of the answer:\n");
+
+    for (size_t depth = 0; depth < stats->depth_count; ++depth) {
+        if (!stats->depth_leaves[depth] && !stats->depth_games[depth]) continue;
+
+        size_t bar = max_games ? stats->depth_games[depth] * TREE_STATS_BAR_WIDTH / max_games : 0;
+
+        fprintf(out, "%4lld: %10llu games, %8lld leaves |", (long long)depth,
+                (unsigned long long)stats->depth_games[depth], (long long)stats->depth_leaves[depth]);
+        for (size_t column = 0; column < bar; ++column) fputc('#', out);
+        fputc('\n', out);
+    }
+}
+
+void TreeStats_dtor(TreeStats* stats) {
+    if (!stats) return;
+
+    free(stats->hot);
+    free(stats->depth_games);
+    free(stats->depth_leaves);
+
+    *stats = {};
+}
+
+static void offer_hot(TreeStats* stats, size_t capacity, const TreeStatsEntry* entry) {
+    if (stats->hot_count < capacity) {
+        // Sift the new element up.
+        size_t index = stats->hot_count++;
+        while (index && heat(&stats->hot[(index - 1) / 2]) > heat(entry)) {
+            stats->hot[index] = stats->hot[(index - 1) / 2];
+            index = (index - 1) / 2;
+        }
+        stats->hot[index] = *entry;
+        return;
+    }
+
+    if (heat(entry) <= heat(&stats->hot[0])) return;
+
+    stats->hot[0] = *entry;
+    sift_down(stats->hot, stats->hot_count, 0);
+}
+
+static void sift_down(TreeStatsEntry* heap, size_t size, size_t index) {
+    TreeStatsEntry element = heap[index];
+
+    while (2 * index + 1 < size) {
+        size_t child = 2 * index + 1;
+        if (child + 1 < size && heat(&heap[child + 1]) < heat(&heap[child])) ++child;
+
+        if (heat(&heap[child]) >= heat(&element)) break;
+
+        heap[index] = heap[child];
+        index = child;
+    }
+
+    heap[index] = element;
+}
+
+static bool reserve_depth(TreeStats* stats, size_t depth) {
+    if (depth < stats->depth_count) return true;
+
+    size_t new_count = stats->depth_count ? stats->depth_count : TREE_STACK_MIN_CAPACITY;
+    while (new_count <= depth) new_count *= 2;
+
+    uint64_t* new_games = (uint64_t*) realloc(stats->depth_games, new_count * sizeof(*new_games));
+    if (!new_games) return false;
+    stats->depth_games = new_games;
+
+    size_t* new_leaves = (size_t*) realloc(stats->depth_leaves, new_count * sizeof(*new_leaves));
+    if (!new_leaves) return false;
+    stats->depth_leaves = new_leaves;
+
+    for (size_t index = stats->depth_count; index < new_count; ++index) {
+        stats->depth_games[index] = 0;
+        stats->depth_leaves[index] = 0;
+    }
+
+    stats->depth_count = new_count;
+
+    return true;
+}
+
+static uint64_t heat(const TreeStatsEntry* entry) {
+    return entry->visits + entry->lookups;
+}
+
+static int compare_heat(const void* entry_a, const void* entry_b) {
+    uint64_t heat_a = heat((const TreeStatsEntry*) entry_a);
+    uint64_t heat_b = heat((const TreeStatsEntry*) entry_b);
+
+    return heat_a < heat_b ? 1 : heat_a > heat_b ? -1 : 0;
+}
@@ -0,0 +1,75 @@
+/**
+ * @file tree_stats.h
+ * @author Kudryashov Ilya (kudriashov.it@phystech.edu)
+ * @brief Statistics of the tree traffic gathered from access counters of its nodes.
+ * @version 0.1
+ * @date 2022-11-24
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#ifndef TREE_STATS_H
+#define TREE_STATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "bin_tree.h"
+
+/**
+ * @brief Counters of a single node.
+ */
+struct TreeStatsEntry {
+    const char* value = NULL;
+    size_t depth = 0;
+    uint64_t visits = 0;
+    uint64_t lookups = 0;
+    bool is_leaf = false;
+};
+
+/**
+ * @brief Summary of the counters of all nodes of the tree.
+ */
+struct TreeStats {
+    TreeStatsEntry* hot = NULL;     // <- Most accessed nodes, hottest first.
+    size_t hot_count = 0;
+
+    uint64_t games = 0;             // <- Games that reached a leaf (or a question that was the leaf then).
+    uint64_t questions = 0;         // <- Questions asked in these games.
+    uint64_t lookups = 0;           // <- Definitions and comparisons.
+    size_t leaf_count = 0;
+    size_t leaf_depth_sum = 0;
+
+    uint64_t* depth_games = NULL;   // <- Games finished at each depth.
+    size_t* depth_leaves = NULL;    // <- Leaves of each depth.
+    size_t depth_count = 0;
+};
+
+/**
+ * @brief Gather statistics of the snapshot of the tree. Counters are read without stopping the games,
+ * so they may be slightly behind.
+ * 
+ * @param stats
+ * @param snapshot tree version to gather statistics of
+ * @param top_count number of the hottest nodes to list
+ * @param err_code variable to use as errno
+ */
+void TreeStats_collect(TreeStats* stats, const TreeSnapshot* snapshot, size_t top_count, int* const err_code = NULL);
+
+/**
+ * @brief Print the statistics in human-readable form.
+ * 
+ * @param stats
+ * @param out stream to print to
+ */
+void TreeStats_print(const TreeStats* stats, FILE* out);
+
+/**
+ * @brief Free the statistics.
+ * 
+ * @param stats
+ */
+void TreeStats_dtor(TreeStats* stats);
+
+#endif
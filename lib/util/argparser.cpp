@@ -61,6 +61,11 @@ void edit_string(const int argc, void** argv, const char* argument) {
     strcpy(*(char**)argv, argument);
 }
 
+void set_true(const int argc, void** argv, const char* argument) {
+    SILENCE_UNUSED(argc); SILENCE_UNUSED(argument);
+    *(bool*)argv[0] = true;
+}
+
 void print_description(const ActionTag& tag) {
     if (*tag.name.long_name)
         printf("-%c --%s - %s\n\n", tag.name.short_name, tag.name.long_name, tag.description);
@@ -72,4 +72,13 @@ void edit_int(const int argc, void** argv, const char* argument);
  */
 void edit_string(const int argc, void** argv, const char* argument);
 
+/**
+ * @brief Set boolean value (first pointer) to true.
+ * 
+ * @param argc number of arguments
+ * @param argv pointers to arguments (1-st element should be bool*)
+ * @param argument unimportant
+ */
+void set_true(const int argc, void** argv, const char* argument);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,759 @@
+#include "binary_log.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "debug.h"
+
+/**
+ * @brief Types of arguments printf() takes.
+ */
+enum BinaryLogArgument {
+    ARGUMENT_NONE,
+    ARGUMENT_INT,
+    ARGUMENT_LONG,
+    ARGUMENT_LONG_LONG,
+    ARGUMENT_SIZE,
+    ARGUMENT_INTMAX,
+    ARGUMENT_PTRDIFF,
+    ARGUMENT_DOUBLE,
+    ARGUMENT_LONG_DOUBLE,
+    ARGUMENT_STRING,
+    ARGUMENT_POINTER,
+    ARGUMENT_UNSUPPORTED,
+};
+
+/**
+ * @brief Conversion specification of the format string.
+ */
+struct BinaryLogConversion {
+    size_t length = 0;          // <- Length of the specification, '%' included.
+    size_t stars = 0;           // <- Number of int arguments taken by '*' width and precision.
+    BinaryLogArgument argument = ARGUMENT_NONE;
+};
+
+/**
+ * @brief Record being written.
+ */
+struct BinaryLogWriter {
+    char* buffer = NULL;
+    size_t size = 0;
+    size_t length = 0;
+};
+
+/**
+ * @brief Record being read.
+ */
+struct BinaryLogReader {
+    const char* data = NULL;
+    size_t size = 0;
+    size_t position = 0;
+    bool failed = false;
+};
+
+/**
+ * @brief Site of the run being decoded.
+ */
+struct BinaryLogDecodedSite {
+    const char* tag = NULL;
+    const char* format = NULL;
+};
+
+const uint32_t BINARY_LOG_NULL_STRING = 0xFFFFFFFF;
+
+/**
+ * @brief Parse the conversion specification.
+ *
+ * @param spec specification, starting with '%'
+ * @return BinaryLogConversion
+ */
+static BinaryLogConversion parse_conversion(const char* spec);
+
+/**
+ * @brief Check if all arguments of the format can be stored raw.
+ *
+ * @param format
+ * @return true if they can
+ */
+static bool is_encodable(const char* format);
+
+/**
+ * @brief Get hash of the site.
+ *
+ * @param tag
+ * @param format
+ * @return size_t
+ */
+static size_t site_hash(const char* tag, const char* format);
+
+/**
+ * @brief Append bytes to the record, if they fit.
+ *
+ * @param writer
+ * @param data
+ * @param length
+ */
+static void put(BinaryLogWriter* writer, const void* data, size_t length);
+
+/**
+ * @brief Append the string with its length to the record.
+ *
+ * @param writer
+ * @param string string to append (can be NULL)
+ */
+static void put_string(BinaryLogWriter* writer, const char* string);
+
+/**
+ * @brief Start the record.
+ *
+ * @param writer
+ * @param kind kind of the record
+ * @param site index of the site
+ * @param moment time of the record
+ */
+static void put_header(BinaryLogWriter* writer, BinaryLogRecord kind, uint32_t site, time_t moment);
+
+/**
+ * @brief Write the payload length into the header of the finished record.
+ *
+ * @param writer
+ */
+static void finish(BinaryLogWriter* writer);
+
+/**
+ * @brief Read bytes of the record.
+ *
+ * @param reader
+ * @param data buffer to put the bytes to
+ * @param length
+ */
+static void get(BinaryLogReader* reader, void* data, size_t length);
+
+/**
+ * @brief Read the string with its length.
+ *
+ * @param reader
+ * @return const char* string inside the log, "(null)" for NULL strings
+ */
+static const char* get_string(BinaryLogReader* reader);
+
+/**
+ * @brief Print the message of the site, reading its arguments from the record.
+ *
+ * @param output
+ * @param format format string of the site
+ * @param reader payload of the record
+ */
+static void print_message(FILE* output, const char* format, BinaryLogReader* reader);
+
+/**
+ * @brief Print one argument of the message.
+ *
+ * @param output
+ * @param spec conversion specification without '*'
+ * @param argument type of the argument
+ * @param reader payload of the record
+ */
+static void print_argument(FILE* output, const char* spec, BinaryLogArgument argument, BinaryLogReader* reader);
+
+/**
+ * @brief Print the value with printf() conversion specification.
+ *
+ * @param output
+ * @param spec conversion specification
+ * @param ... value
+ */
+static void print_value(FILE* output, const char* spec, ...);
+
+/**
+ * @brief Print the prefix of the message (time and tag).
+ *
+ * @param output
+ * @param moment time of the message
+ * @param tag
+ */
+static void print_prefix(FILE* output, time_t moment, const char* tag);
+
+void BinaryLogSites_ctor(BinaryLogSites* sites, int* const err_code) {
+    _LOG_FAIL_CHECK_(sites, "error", ERROR_REPORTS, return, err_code, EINVAL);
+
+    sites->entries = (BinaryLogSite*) calloc(BINARY_LOG_SITE_CAPACITY, sizeof(*sites->entries));
+    sites->count = 0;
+
+    _LOG_FAIL_CHECK_(sites->entries, "error", ERROR_REPORTS, return, err_code, ENOMEM);
+}
+
+void BinaryLogSites_dtor(BinaryLogSites* sites) {
+    if (!sites) return;
+
+    free(sites->entries);
+    sites->entries = NULL;
+    sites->count = 0;
+}
+
+uint32_t BinaryLogSites_find(BinaryLogSites* sites, const char* tag, const char* format, bool* is_new) {
+    *is_new = false;
+
+    if (!sites->entries) return BINARY_LOG_SITE_CAPACITY;
+
+    size_t start = site_hash(tag, format);
+
+    for (size_t probe = 0; probe < BINARY_LOG_SITE_CAPACITY; ++probe) {
+        size_t index = (start + probe) % BINARY_LOG_SITE_CAPACITY;
+        const BinaryLogSite* entry = &sites->entries[index];
+
+        const char* entry_format = __atomic_load_n(&entry->format, __ATOMIC_ACQUIRE);
+        if (!entry_format) break;
+
+        if (entry_format != format || entry->tag != tag) continue;
+
+        return entry->encodable ? (uint32_t)index : BINARY_LOG_SITE_CAPACITY;
+    }
+
+    pthread_mutex_lock(&sites->lock);
+
+    uint32_t site = BINARY_LOG_SITE_CAPACITY;
+
+    // Another writer may have added the site while the lock was taken, the table is searched again.
+    for (size_t probe = 0; probe < BINARY_LOG_SITE_CAPACITY; ++probe) {
+        size_t index = (start + probe) % BINARY_LOG_SITE_CAPACITY;
+        BinaryLogSite* entry = &sites->entries[index];
+
+        if (entry->format) {
+            if (entry->format != format || entry->tag != tag) continue;
+
+            if (entry->encodable) site = (uint32_t)index;
+            break;
+        }
+
+        // Table is kept sparse for short probe sequences, sites that do not fit are written as text.
+        if (4 * (sites->count + 1) > 3 * BINARY_LOG_SITE_CAPACITY) break;
+
+        entry->tag = tag;
+        entry->encodable = is_encodable(format);
+        __atomic_store_n(&entry->format, format, __ATOMIC_RELEASE);
+
+        ++sites->count;
+
+        // Sites that cannot be encoded are kept in the table so that their formats are not parsed again.
+        if (entry->encodable) {
+            site = (uint32_t)index;
+            *is_new = true;
+        }
+        break;
+    }
+
+    pthread_mutex_unlock(&sites->lock);
+
+    return site;
+}
+
+size_t BinaryLog_encode_start(char* buffer, size_t size, time_t moment) {
+    BinaryLogWriter writer = { buffer, size, 0 };
+
+    put_header(&writer, BINARY_LOG_START, BINARY_LOG_SITE_CAPACITY, moment);
+    put_string(&writer, BINARY_LOG_MAGIC);
+    finish(&writer);
+
+    return writer.length;
+}
+
+size_t BinaryLog_encode_site(char* buffer, size_t size, const BinaryLogSites* sites, uint32_t site) {
+    BinaryLogWriter writer = { buffer, size, 0 };
+
+    put_header(&writer, BINARY_LOG_SITE, site, 0);
+    put_string(&writer, sites->entries[site].tag);
+    put_string(&writer, sites->entries[site].format);
+    finish(&writer);
+
+    return writer.length;
+}
+
+size_t BinaryLog_encode_message(char* buffer, size_t size, const BinaryLogSites* sites, uint32_t site, time_t moment,
+                                va_list args) {
+    BinaryLogWriter writer = { buffer, size, 0 };
+
+    put_header(&writer, BINARY_LOG_MESSAGE, site, moment);
+
+    for (const char* spec = strchr(sites->entries[site].format, '%'); spec; spec = strchr(spec, '%')) {
+        BinaryLogConversion conversion = parse_conversion(spec);
+        spec += conversion.length;
+
+        for (size_t star = 0; star < conversion.stars; ++star) {
+            int value = va_arg(args, int);
+            put(&writer, &value, sizeof(value));
+        }
+
+        switch (conversion.argument) {
+        case ARGUMENT_INT: {
+            int value = va_arg(args, int);
+            put(&writer, &value, sizeof(value));
+            break;
+        }
+        case ARGUMENT_LONG: {
+            long value = va_arg(args, long);
+            put(&writer, &value, sizeof(value));
+            break;
+        }
+        case ARGUMENT_LONG_LONG: {
+            long long value = va_arg(args, long long);
+            put(&writer, &value, sizeof(value));
+            break;
+        }
+        case ARGUMENT_SIZE: {
+            size_t value = va_arg(args, size_t);
+            put(&writer, &value, sizeof(value));
+            break;
+        }
+        case ARGUMENT_INTMAX: {
+            intmax_t value = va_arg(args, intmax_t);
+            put(&writer, &value, sizeof(value));
+            break;
+        }
+        case ARGUMENT_PTRDIFF: {
+            ptrdiff_t value = va_arg(args, ptrdiff_t);
+            put(&writer, &value, sizeof(value));
+            break;
+        }
+        case ARGUMENT_DOUBLE: {
+            double value = va_arg(args, double);
+            put(&writer, &value, sizeof(value));
+            break;
+        }
+        case ARGUMENT_LONG_DOUBLE: {
+            long double value = va_arg(args, long double);
+            put(&writer, &value, sizeof(value));
+            break;
+        }
+        case ARGUMENT_STRING: {
+            put_string(&writer, va_arg(args, const char*));
+            break;
+        }
+        case ARGUMENT_POINTER: {
+            const void* value = va_arg(args, const void*);
+            put(&writer, &value, sizeof(value));
+            break;
+        }
+        case ARGUMENT_NONE:
+        case ARGUMENT_UNSUPPORTED:
+        default: break;
+        }
+    }
+
+    finish(&writer);
+
+    return writer.length;
+}
+
+size_t BinaryLog_encode_text(char* buffer, size_t size, time_t moment, const char* tag, const char* format,
+                             va_list args) {
+    BinaryLogWriter writer = { buffer, size, 0 };
+
+    put_header(&writer, BINARY_LOG_TEXT, BINARY_LOG_SITE_CAPACITY, moment);
+    put_string(&writer, tag);
+
+    // Text is formatted right into the record, its length goes before it.
+    size_t length_position = writer.length;
+    uint32_t length = 0;
+    put(&writer, &length, sizeof(length));
+
+    bool fits = writer.length < writer.size;
+    int printed = vsnprintf(fits ? writer.buffer + writer.length : NULL, fits ? writer.size - writer.length : 0,
+                            format, args);
+    length = printed > 0 ? (uint32_t)printed : 0;
+
+    if (length_position + sizeof(length) <= writer.size) memcpy(writer.buffer + length_position, &length, sizeof(length));
+    writer.length += length + 1;
+
+    finish(&writer);
+
+    return writer.length;
+}
+
+void BinaryLog_decode(FILE* input, FILE* output, int* const err_code) {
+    _LOG_FAIL_CHECK_(input && output, "error", ERROR_REPORTS, return, err_code, EINVAL);
+
+    fseek(input, 0, SEEK_END);
+    long input_size = ftell(input);
+    fseek(input, 0, SEEK_SET);
+    _LOG_FAIL_CHECK_(input_size >= 0, "error", ERROR_REPORTS, return, err_code, EIO);
+
+    char* data = (char*) calloc((size_t)input_size + 1, sizeof(*data));
+    BinaryLogDecodedSite* sites = (BinaryLogDecodedSite*) calloc(BINARY_LOG_SITE_CAPACITY, sizeof(*sites));
+
+    _LOG_FAIL_CHECK_(data && sites, "error", ERROR_REPORTS, {
+        free(data);
+        free(sites);
+        return;
+    }, err_code, ENOMEM);
+
+    size_t size = fread(data, sizeof(*data), (size_t)input_size, input);
+
+    bool in_run = false;
+    size_t position = 0;
+
+    while (position < size) {
+        BinaryLogReader header = { data, size, position, false };
+
+        uint8_t kind = 0;
+        uint32_t site = 0, length = 0;
+        int64_t raw_moment = 0;
+
+        get(&header, &kind, sizeof(kind));
+        get(&header, &site, sizeof(site));
+        get(&header, &length, sizeof(length));
+        get(&header, &raw_moment, sizeof(raw_moment));
+
+        time_t moment = raw_moment;
+
+        if (header.failed || header.position + length > size) break;
+
+        BinaryLogReader payload = { data + header.position, length, 0, false };
+
+        if (kind == BINARY_LOG_START) {
+            if (in_run) fputs("</pre>", output);
+            fputs("<pre>", output);
+            in_run = true;
+
+            // Sites of the run can be recorded after their first messages, so all of them are read first.
+            for (size_t index = 0; index < BINARY_LOG_SITE_CAPACITY; ++index) sites[index] = {};
+
+            for (size_t next = header.position + length; next + BINARY_LOG_HEADER_SIZE <= size;) {
+                BinaryLogReader site_header = { data, size, next, false };
+
+                uint8_t site_kind = 0;
+                uint32_t site_index = 0, site_length = 0;
+                int64_t site_moment = 0;
+
+                get(&site_header, &site_kind, sizeof(site_kind));
+                get(&site_header, &site_index, sizeof(site_index));
+                get(&site_header, &site_length, sizeof(site_length));
+                get(&site_header, &site_moment, sizeof(site_moment));
+
+                if (site_header.failed || site_kind == BINARY_LOG_START) break;
+                if (site_header.position + site_length > size) break;
+
+                if (site_kind == BINARY_LOG_SITE && site_index < BINARY_LOG_SITE_CAPACITY) {
+                    BinaryLogReader site_payload = { data + site_header.position, site_length, 0, false };
+
+                    sites[site_index].tag = get_string(&site_payload);
+                    sites[site_index].format = get_string(&site_payload);
+                    if (site_payload.failed) sites[site_index] = {};
+                }
+
+                next = site_header.position + site_length;
+            }
+        } else if (kind == BINARY_LOG_MESSAGE && site < BINARY_LOG_SITE_CAPACITY && sites[site].format) {
+            print_prefix(output, moment, sites[site].tag);
+            print_message(output, sites[site].format, &payload);
+        } else if (kind == BINARY_LOG_TEXT) {
+            const char* tag = get_string(&payload);
+
+            uint32_t text_length = 0;
+            get(&payload, &text_length, sizeof(text_length));
+
+            if (!payload.failed && payload.position + text_length < payload.size) {
+                print_prefix(output, moment, tag);
+                fwrite(payload.data + payload.position, sizeof(char), text_length, output);
+            }
+        }
+
+        position = header.position + length;
+    }
+
+    if (in_run) fputs("</pre>", output);
+
+    free(data);
+    free(sites);
+
+    _LOG_FAIL_CHECK_(position == size, "error", ERROR_REPORTS, return, err_code, EILSEQ);
+}
+
+static BinaryLogConversion parse_conversion(const char* spec) {
+    BinaryLogConversion conversion = {};
+
+    const char* current = spec + 1;
+
+    current += strspn(current, "-+ #0'");
+
+    if (*current == '*') {
+        ++conversion.stars;
+        ++current;
+    } else {
+        current += strspn(current, "0123456789");
+    }
+
+    if (*current == '.') {
+        ++current;
+
+        if (*current == '*') {
+            ++conversion.stars;
+            ++current;
+        } else {
+            current += strspn(current, "0123456789");
+        }
+    }
+
+    BinaryLogArgument integer = ARGUMENT_INT;
+    bool is_long_double = false;
+
+    if (!strncmp(current, "hh", 2) || !strncmp(current, "ll", 2)) {
+        if (*current == 'l') integer = ARGUMENT_LONG_LONG;
+        current += 2;
+    } else if (*current && strchr("hlLqjzt", *current)) {
+        switch (*current) {
+        case 'l': integer = ARGUMENT_LONG;      break;
+        case 'q': integer = ARGUMENT_LONG_LONG; break;
+        case 'j': integer = ARGUMENT_INTMAX;    break;
+        case 'z': integer = ARGUMENT_SIZE;      break;
+        case 't': integer = ARGUMENT_PTRDIFF;   break;
+        case 'L': is_long_double = true;        break;
+        default: break;
+        }
+        ++current;
+    }
+
+    if (!*current) {
+        conversion.length = (size_t)(current - spec);
+        conversion.argument = ARGUMENT_UNSUPPORTED;
+        return conversion;
+    }
+
+    conversion.length = (size_t)(current - spec) + 1;
+
+    switch (*current) {
+    case 'd': case 'i': case 'u': case 'o': case 'x': case 'X':
+        conversion.argument = integer;
+        break;
+    case 'c':
+        conversion.argument = integer == ARGUMENT_INT ? ARGUMENT_INT : ARGUMENT_UNSUPPORTED;
+        break;
+    case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+        conversion.argument = is_long_double ? ARGUMENT_LONG_DOUBLE : ARGUMENT_DOUBLE;
+        break;
+    case 's':
+        conversion.argument = integer == ARGUMENT_INT ? ARGUMENT_STRING : ARGUMENT_UNSUPPORTED;
+        break;
+    case 'p':
+        conversion.argument = ARGUMENT_POINTER;
+        break;
+    case '%':
+        conversion.argument = ARGUMENT_NONE;
+        break;
+    default:
+        conversion.argument = ARGUMENT_UNSUPPORTED;
+        break;
+    }
+
+    return conversion;
+}
+
+static bool is_encodable(const char* format) {
+    for (const char* spec = strchr(format, '%'); spec; spec = strchr(spec, '%')) {
+        BinaryLogConversion conversion = parse_conversion(spec);
+        if (conversion.argument == ARGUMENT_UNSUPPORTED) return false;
+
+        // Stars are replaced with numbers when the log is decoded.
+        if (conversion.length + 2 * sizeof(int) * 3 >= BINARY_LOG_SPEC_SIZE) return false;
+
+        spec += conversion.length;
+    }
+
+    return true;
+}
+
+static size_t site_hash(const char* tag, const char* format) {
+    uintptr_t key = (uintptr_t)format ^ ((uintptr_t)tag << 1);
+    key *= 0x9E3779B97F4A7C15ull;
+
+    return (key >> 32) % BINARY_LOG_SITE_CAPACITY;
+}
+
+static void put(BinaryLogWriter* writer, const void* data, size_t length) {
+    if (writer->length + length <= writer->size) memcpy(writer->buffer + writer->length, data, length);
+    writer->length += length;
+}
+
+static void put_string(BinaryLogWriter* writer, const char* string) {
+    uint32_t length = string ? (uint32_t)strlen(string) : BINARY_LOG_NULL_STRING;
+    put(writer, &length, sizeof(length));
+
+    // Strings keep their terminators, so the decoder prints them right from the log.
+    if (string) put(writer, string, (size_t)length + 1);
+}
+
+static void put_header(BinaryLogWriter* writer, BinaryLogRecord kind, uint32_t site, time_t moment) {
+    uint8_t raw_kind = (uint8_t)kind;
+    uint32_t length = 0;
+    int64_t raw_moment = moment;
+
+    put(writer, &raw_kind, sizeof(raw_kind));
+    put(writer, &site, sizeof(site));
+    put(writer, &length, sizeof(length));
+    put(writer, &raw_moment, sizeof(raw_moment));
+}
+
+static void finish(BinaryLogWriter* writer) {
+    if (writer->length > writer->size) return;
+
+    uint32_t length = (uint32_t)(writer->length - BINARY_LOG_HEADER_SIZE);
+    memcpy(writer->buffer + sizeof(uint8_t) + sizeof(uint32_t), &length, sizeof(length));
+}
+
+static void get(BinaryLogReader* reader, void* data, size_t length) {
+    if (reader->failed || reader->position + length > reader->size) {
+        reader->failed = true;
+        memset(data, 0, length);
+        return;
+    }
+
+    memcpy(data, reader->data + reader->position, length);
+    reader->position += length;
+}
+
+static const char* get_string(BinaryLogReader* reader) {
+    uint32_t length = 0;
+    get(reader, &length, sizeof(length));
+
+    if (reader->failed || length == BINARY_LOG_NULL_STRING) return "(null)";
+
+    if (reader->position + length + 1 > reader->size || reader->data[reader->position + length]) {
+        reader->failed = true;
+        return "(null)";
+    }
+
+    const char* string = reader->data + reader->position;
+    reader->position += (size_t)length + 1;
+
+    return string;
+}
+
+static void print_message(FILE* output, const char* format, BinaryLogReader* reader) {
+    const char* current = format;
+
+    while (*current) {
+        if (*current != '%') {
+            size_t literal = strcspn(current, "%");
+            fwrite(current, sizeof(char), literal, output);
+            current += literal;
+            continue;
+        }
+
+        BinaryLogConversion conversion = parse_conversion(current);
+
+        // Widths and precisions given as arguments are put right into the specification.
+        char spec[BINARY_LOG_SPEC_SIZE] = "";
+        size_t spec_length = 0;
+
+        for (size_t index = 0; index < conversion.length && spec_length + 1 < BINARY_LOG_SPEC_SIZE; ++index) {
+            if (current[index] != '*') {
+                spec[spec_length++] = current[index];
+                continue;
+            }
+
+            int value = 0;
+            get(reader, &value, sizeof(value));
+
+            int printed = snprintf(spec + spec_length, BINARY_LOG_SPEC_SIZE - spec_length, "%d", value);
+            if (printed > 0) spec_length += (size_t)printed;
+        }
+
+        print_argument(output, spec, conversion.argument, reader);
+        if (reader->failed) return;
+
+        current += conversion.length;
+    }
+}
+
+static void print_argument(FILE* output, const char* spec, BinaryLogArgument argument, BinaryLogReader* reader) {
+    switch (argument) {
+    case ARGUMENT_INT: {
+        int value = 0;
+        get(reader, &value, sizeof(value));
+        print_value(output, spec, value);
+        break;
+    }
+    case ARGUMENT_LONG: {
+        long value = 0;
+        get(reader, &value, sizeof(value));
+        print_value(output, spec, value);
+        break;
+    }
+    case ARGUMENT_LONG_LONG: {
+        long long value = 0;
+        get(reader, &value, sizeof(value));
+        print_value(output, spec, value);
+        break;
+    }
+    case ARGUMENT_SIZE: {
+        size_t value = 0;
+        get(reader, &value, sizeof(value));
+        print_value(output, spec, value);
+        break;
+    }
+    case ARGUMENT_INTMAX: {
+        intmax_t value = 0;
+        get(reader, &value, sizeof(value));
+        print_value(output, spec, value);
+        break;
+    }
+    case ARGUMENT_PTRDIFF: {
+        ptrdiff_t value = 0;
+        get(reader, &value, sizeof(value));
+        print_value(output, spec, value);
+        break;
+    }
+    case ARGUMENT_DOUBLE: {
+        double value = 0;
+        get(reader, &value, sizeof(value));
+        print_value(output, spec, value);
+        break;
+    }
+    case ARGUMENT_LONG_DOUBLE: {
+        long double value = 0;
+        get(reader, &value, sizeof(value));
+        print_value(output, spec, value);
+        break;
+    }
+    case ARGUMENT_STRING: {
+        print_value(output, spec, get_string(reader));
+        break;
+    }
+    case ARGUMENT_POINTER: {
+        const void* value = NULL;
+        get(reader, &value, sizeof(value));
+        print_value(output, spec, value);
+        break;
+    }
+    case ARGUMENT_NONE: {
+        fputc('%', output);
+        break;
+    }
+    case ARGUMENT_UNSUPPORTED:
+    default: {
+        fputs(spec, output);
+        break;
+    }
+    }
+}
+
+static void print_value(FILE* output, const char* spec, ...) {
+    va_list args;
+    va_start(args, spec);
+
+    vfprintf(output, spec, args);
+
+    va_end(args);
+}
+
+static void print_prefix(FILE* output, time_t moment, const char* tag) {
+    struct tm time_info = {};
+    localtime_r(&moment, &time_info);
+
+    char stamp[32] = "";
+    asctime_r(&time_info, stamp);
+    stamp[strlen(stamp) - 1] = '\0';
+
+    fprintf(output, LOG_PREFIX_FORMAT, stamp, tag);
+}
@@ -0,0 +1,140 @@
+/**
+ * @file binary_log.h
+ * @author Ilya Kudryashov (kudriashov.it@phystech.edu)
+ * @brief Compact binary log records with deferred formatting.
+ * @version 0.1
+ * @date 2022-11-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef BINARY_LOG_H
+#define BINARY_LOG_H
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+const size_t BINARY_LOG_SITE_CAPACITY = 4096;
+const size_t BINARY_LOG_HEADER_SIZE = 17;       // <- Kind, site index, payload length and time of the record.
+const size_t BINARY_LOG_SPEC_SIZE = 64;
+#define BINARY_LOG_MAGIC "guesser-binary-log-1"
+
+/**
+ * @brief Kinds of log records.
+ * Arguments are stored in their native sizes, so the log is decoded on the machine that wrote it.
+ */
+enum BinaryLogRecord {
+    BINARY_LOG_START = 0,       // <- Start of the program, site indices start over.
+    BINARY_LOG_SITE = 1,        // <- Tag and format string of the site.
+    BINARY_LOG_MESSAGE = 2,     // <- Arguments of the message of the site.
+    BINARY_LOG_TEXT = 3,        // <- Tag and formatted message that could not be stored by site.
+};
+
+/**
+ * @brief Place the message was logged from, identified by its (static) tag and format string.
+ */
+struct BinaryLogSite {
+    const char* format = NULL;
+    const char* tag = NULL;
+    bool encodable = false;     // <- All conversions of the format can be stored as raw arguments.
+};
+
+/**
+ * @brief Table of sites met since the start of the program. Lookups do not lock.
+ */
+struct BinaryLogSites {
+    BinaryLogSite* entries = NULL;
+    size_t count = 0;
+    pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+};
+
+/**
+ * @brief Allocate the site table.
+ *
+ * @param sites
+ * @param err_code variable to use as errno
+ */
+void BinaryLogSites_ctor(BinaryLogSites* sites, int* const err_code = NULL);
+
+/**
+ * @brief Free the site table.
+ *
+ * @param sites
+ */
+void BinaryLogSites_dtor(BinaryLogSites* sites);
+
+/**
+ * @brief Get index of the site, adding it to the table if it was not met yet.
+ *
+ * @param sites
+ * @param tag tag of the message
+ * @param format format string of the message
+ * @param is_new variable to put true to if the site was just added and its record has to be written
+ * @return uint32_t index of the site, BINARY_LOG_SITE_CAPACITY if the message has to be stored as text
+ */
+uint32_t BinaryLogSites_find(BinaryLogSites* sites, const char* tag, const char* format, bool* is_new);
+
+/**
+ * @brief Encode the record of the start of the program.
+ * Encoding functions return the length of the record, the buffer only holds it if it is not longer than the size.
+ *
+ * @param buffer buffer to put the record to
+ * @param size size of the buffer
+ * @param moment current time
+ * @return size_t length of the record
+ */
+size_t BinaryLog_encode_start(char* buffer, size_t size, time_t moment);
+
+/**
+ * @brief Encode the record of the site.
+ *
+ * @param buffer buffer to put the record to
+ * @param size size of the buffer
+ * @param sites
+ * @param site index of the site
+ * @return size_t length of the record
+ */
+size_t BinaryLog_encode_site(char* buffer, size_t size, const BinaryLogSites* sites, uint32_t site);
+
+/**
+ * @brief Encode the message with the raw arguments, strings are copied.
+ *
+ * @param buffer buffer to put the record to
+ * @param size size of the buffer
+ * @param sites
+ * @param site index of the site of the message
+ * @param moment time of the message
+ * @param args arguments of the message
+ * @return size_t length of the record
+ */
+size_t BinaryLog_encode_message(char* buffer, size_t size, const BinaryLogSites* sites, uint32_t site, time_t moment,
+                                va_list args);
+
+/**
+ * @brief Encode the formatted message.
+ *
+ * @param buffer buffer to put the record to
+ * @param size size of the buffer
+ * @param moment time of the message
+ * @param tag tag of the message
+ * @param format format string for printf()
+ * @param args arguments for printf()
+ * @return size_t length of the record
+ */
+size_t BinaryLog_encode_text(char* buffer, size_t size, time_t moment, const char* tag, const char* format, va_list args)
+    __attribute__((format (printf, 5, 0)));
+
+/**
+ * @brief Format the binary log into the HTML log, one <pre> block per program start.
+ *
+ * @param input binary log
+ * @param output stream to write the HTML log to
+ * @param err_code variable to use as errno
+ */
+void BinaryLog_decode(FILE* input, FILE* output, int* const err_code = NULL);
+
+#endif
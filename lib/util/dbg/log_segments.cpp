@@ -0,0 +1,268 @@
+#include "log_segments.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <spawn.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Errors are not logged here, as segments are rotated by the logger itself.
+
+/**
+ * @brief Put the name of the segment into the buffer.
+ *
+ * @param segments
+ * @param index index of the segment
+ * @param buffer
+ * @return false if the name did not fit
+ */
+static bool segment_name(const LogSegments* segments, size_t index, char buffer[LOG_SEGMENT_NAME_SIZE]);
+
+/**
+ * @brief Put the pattern matching all closed segments and the part of their names before the index into the buffers.
+ *
+ * @param segments
+ * @param pattern buffer for the pattern for glob()
+ * @param prefix buffer for the prefix
+ * @return false if the names did not fit
+ */
+static bool segment_pattern(const LogSegments* segments, char pattern[LOG_SEGMENT_NAME_SIZE],
+                            char prefix[LOG_SEGMENT_NAME_SIZE]);
+
+/**
+ * @brief Read the index from the name of the file.
+ *
+ * @param name name of the file
+ * @param prefix part of the name before the index
+ * @param index variable to put the index to
+ * @return false if the name does not start with the prefix and the index
+ */
+static bool parse_index(const char* name, const char* prefix, size_t* index);
+
+/**
+ * @brief Find the largest index of the closed segments.
+ *
+ * @param segments
+ * @return size_t index of the last closed segment, 0 if there are none
+ */
+static size_t last_index(const LogSegments* segments);
+
+/**
+ * @brief Remove the segments and the assets that belong to the segments beyond the limit.
+ *
+ * @param segments
+ */
+static void remove_old(LogSegments* segments);
+
+/**
+ * @brief Start compressing the segment in the background.
+ *
+ * @param segments
+ * @param name name of the segment
+ */
+static void compress_segment(LogSegments* segments, const char* name);
+
+/**
+ * @brief Collect the compressors that have finished.
+ *
+ * @param segments
+ * @param wait_index wait for the compression of the segments up to the index (0 - for none)
+ */
+static void collect_compressors(LogSegments* segments, size_t wait_index);
+
+void LogSegments_ctor(LogSegments* segments, const char* filename, size_t size, size_t max_size, size_t max_count,
+                      bool compress, const char* asset_folder, int* const err_code) {
+    if (!segments || !filename || strlen(filename) >= LOG_SEGMENT_NAME_SIZE) {
+        if (err_code) *err_code = EINVAL;
+        return;
+    }
+
+    strcpy(segments->stem, filename);
+
+    // Dots of the folders are not extensions.
+    char* extension = strrchr(segments->stem, '.');
+    if (extension && strchr(extension, '/')) extension = NULL;
+
+    if (extension) {
+        strcpy(segments->extension, extension);
+        *extension = '\0';
+    }
+
+    segments->asset_folder = asset_folder;
+    segments->max_size = max_size;
+    segments->max_count = max_count > 0 ? max_count : 1;
+    segments->compress = compress;
+    segments->size = size;
+    segments->compressor_count = 0;
+
+    // The current file continues the segment that was being written when the program stopped.
+    segments->index = last_index(segments) + 1;
+
+    remove_old(segments);
+}
+
+void LogSegments_dtor(LogSegments* segments) {
+    if (!segments) return;
+
+    collect_compressors(segments, SIZE_MAX);
+}
+
+bool LogSegments_full(const LogSegments* segments) {
+    return segments->max_size && segments->size >= segments->max_size;
+}
+
+void LogSegments_rotate(LogSegments* segments, FILE* file, int* const err_code) {
+    char closed_name[LOG_SEGMENT_NAME_SIZE] = "";
+    char current_name[LOG_SEGMENT_NAME_SIZE] = "";
+
+    if (!segment_name(segments, segments->index, closed_name) ||
+        snprintf(current_name, LOG_SEGMENT_NAME_SIZE, "%s%s", segments->stem, segments->extension) < 0) {
+        if (err_code) *err_code = ENAMETOOLONG;
+        return;
+    }
+
+    if (rename(current_name, closed_name)) {
+        if (err_code) *err_code = errno;
+        return;
+    }
+
+    // Writers keep the stream, only the file under it is replaced.
+    int descriptor = open(current_name, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (descriptor < 0 || dup2(descriptor, fileno(file)) < 0) {
+        if (err_code) *err_code = errno;
+        if (descriptor >= 0) close(descriptor);
+        return;
+    }
+    close(descriptor);
+
+    ++segments->index;
+    segments->size = 0;
+
+    if (segments->compress) compress_segment(segments, closed_name);
+
+    remove_old(segments);
+}
+
+static bool segment_name(const LogSegments* segments, size_t index, char buffer[LOG_SEGMENT_NAME_SIZE]) {
+    int length = snprintf(buffer, LOG_SEGMENT_NAME_SIZE, "%s.%04zu%s", segments->stem, index, segments->extension);
+
+    return length > 0 && (size_t)length < LOG_SEGMENT_NAME_SIZE;
+}
+
+static bool segment_pattern(const LogSegments* segments, char pattern[LOG_SEGMENT_NAME_SIZE],
+                            char prefix[LOG_SEGMENT_NAME_SIZE]) {
+    int pattern_length = snprintf(pattern, LOG_SEGMENT_NAME_SIZE, "%s.[0-9]*%s*", segments->stem, segments->extension);
+    int prefix_length = snprintf(prefix, LOG_SEGMENT_NAME_SIZE, "%s.", segments->stem);
+
+    return pattern_length > 0 && (size_t)pattern_length < LOG_SEGMENT_NAME_SIZE &&
+           prefix_length > 0 && (size_t)prefix_length < LOG_SEGMENT_NAME_SIZE;
+}
+
+static bool parse_index(const char* name, const char* prefix, size_t* index) {
+    size_t prefix_length = strlen(prefix);
+    if (strncmp(name, prefix, prefix_length)) return false;
+
+    const char* digits = name + prefix_length;
+    if (*digits < '0' || *digits > '9') return false;
+
+    *index = (size_t)strtoull(digits, NULL, 10);
+
+    return true;
+}
+
+static size_t last_index(const LogSegments* segments) {
+    char pattern[LOG_SEGMENT_NAME_SIZE] = "";
+    char prefix[LOG_SEGMENT_NAME_SIZE] = "";
+
+    size_t last = 0;
+    if (!segment_pattern(segments, pattern, prefix)) return last;
+
+    glob_t found = {};
+    if (!glob(pattern, 0, NULL, &found)) {
+        for (size_t id = 0; id < found.gl_pathc; ++id) {
+            size_t index = 0;
+            if (parse_index(found.gl_pathv[id], prefix, &index) && index > last) last = index;
+        }
+    }
+    globfree(&found);
+
+    return last;
+}
+
+static void remove_old(LogSegments* segments) {
+    if (segments->index < segments->max_count) return;
+
+    // Segments up to this one are removed.
+    size_t last_removed = segments->index - segments->max_count;
+
+    // Compressor would leave a part of the removed segment behind.
+    collect_compressors(segments, last_removed);
+
+    char pattern[LOG_SEGMENT_NAME_SIZE] = "";
+    char prefix[LOG_SEGMENT_NAME_SIZE] = "";
+
+    glob_t found = {};
+    if (segment_pattern(segments, pattern, prefix) && !glob(pattern, 0, NULL, &found)) {
+        for (size_t id = 0; id < found.gl_pathc; ++id) {
+            size_t index = 0;
+            if (parse_index(found.gl_pathv[id], prefix, &index) && index <= last_removed) remove(found.gl_pathv[id]);
+        }
+    }
+    globfree(&found);
+
+    if (!segments->asset_folder) return;
+
+    int pattern_length = snprintf(pattern, LOG_SEGMENT_NAME_SIZE, "%s/seg[0-9]*_*", segments->asset_folder);
+    int prefix_length = snprintf(prefix, LOG_SEGMENT_NAME_SIZE, "%s/seg", segments->asset_folder);
+
+    if (pattern_length < 0 || (size_t)pattern_length >= LOG_SEGMENT_NAME_SIZE) return;
+    if (prefix_length < 0 || (size_t)prefix_length >= LOG_SEGMENT_NAME_SIZE) return;
+
+    // The message with the asset may reach the file after the segment it was made in was closed,
+    // so the assets are kept one segment longer.
+    found = {};
+    if (!glob(pattern, 0, NULL, &found)) {
+        for (size_t id = 0; id < found.gl_pathc; ++id) {
+            size_t index = 0;
+            if (parse_index(found.gl_pathv[id], prefix, &index) && index < last_removed) remove(found.gl_pathv[id]);
+        }
+    }
+    globfree(&found);
+}
+
+static void compress_segment(LogSegments* segments, const char* name) {
+    collect_compressors(segments, 0);
+
+    if (segments->compressor_count == LOG_COMPRESSORS) collect_compressors(segments, segments->compressors[0].index);
+
+    char compressor[] = LOG_COMPRESSOR;
+    char force[] = "-f";
+    char segment[LOG_SEGMENT_NAME_SIZE] = "";
+    strcpy(segment, name);
+
+    char* arguments[] = { compressor, force, segment, NULL };
+
+    // Compressor is started directly, system() would change how the whole program handles signals while it waits.
+    pid_t process = 0;
+    if (posix_spawnp(&process, LOG_COMPRESSOR, NULL, NULL, arguments, environ)) return;
+
+    segments->compressors[segments->compressor_count++] = { process, segments->index - 1 };
+}
+
+static void collect_compressors(LogSegments* segments, size_t wait_index) {
+    size_t running = 0;
+
+    for (size_t id = 0; id < segments->compressor_count; ++id) {
+        LogCompressor compressor = segments->compressors[id];
+
+        if (waitpid(compressor.process, NULL, compressor.index <= wait_index ? 0 : WNOHANG) == 0) {
+            segments->compressors[running++] = compressor;
+        }
+    }
+
+    segments->compressor_count = running;
+}
@@ -0,0 +1,92 @@
+/**
+ * @file log_segments.h
+ * @author Ilya Kudryashov (kudriashov.it@phystech.edu)
+ * @brief Splitting the log into numbered segments of limited size.
+ * @version 0.1
+ * @date 2022-11-28
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef LOG_SEGMENTS_H
+#define LOG_SEGMENTS_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+const size_t LOG_SEGMENT_NAME_SIZE = 1024;
+const size_t LOG_COMPRESSORS = 8;           // <- Segments compressed at once, rotation waits for the oldest one above that.
+#define LOG_COMPRESSOR "gzip"
+
+/**
+ * @brief Segment being compressed.
+ */
+struct LogCompressor {
+    pid_t process = 0;
+    size_t index = 0;
+};
+
+/**
+ * @brief Files of the log. The file being written keeps the name the log was opened with,
+ * it is renamed to "<name>.<index>.<extension>" when the next segment starts.
+ * Assets of the segment are named "<asset folder>/seg<index>_<name>".
+ */
+struct LogSegments {
+    char stem[LOG_SEGMENT_NAME_SIZE] = "";              // <- Name of the log without the extension.
+    char extension[LOG_SEGMENT_NAME_SIZE] = "";         // <- Extension of the log, including the dot.
+    const char* asset_folder = NULL;
+
+    size_t max_size = 0;
+    size_t max_count = 0;
+    bool compress = false;
+
+    size_t index = 0;                                   // <- Index the current segment will have after rotation.
+    size_t size = 0;                                    // <- Bytes written to the current segment.
+
+    LogCompressor compressors[LOG_COMPRESSORS] = {};
+    size_t compressor_count = 0;
+};
+
+/**
+ * @brief Set up segments of the log and remove the ones beyond the limit.
+ *
+ * @param segments
+ * @param filename name of the log file
+ * @param size size of the current segment
+ * @param max_size size after which the segment is closed
+ * @param max_count number of segments to keep, the current one included
+ * @param compress compress closed segments
+ * @param asset_folder (optional) folder with the assets of the segments
+ * @param err_code variable to use as errno
+ */
+void LogSegments_ctor(LogSegments* segments, const char* filename, size_t size, size_t max_size, size_t max_count,
+                      bool compress, const char* asset_folder = NULL, int* const err_code = NULL);
+
+/**
+ * @brief Wait for the compression of the closed segments.
+ *
+ * @param segments
+ */
+void LogSegments_dtor(LogSegments* segments);
+
+/**
+ * @brief Check if the current segment has to be closed.
+ *
+ * @param segments
+ * @return true if it has
+ */
+bool LogSegments_full(const LogSegments* segments);
+
+/**
+ * @brief Close the current segment and continue writing the stream into the new one with the name of the log.
+ * Old segments and their assets are removed.
+ *
+ * @param segments
+ * @param file stream of the log, flushed and locked by the caller
+ * @param err_code variable to use as errno
+ */
+void LogSegments_rotate(LogSegments* segments, FILE* file, int* const err_code = NULL);
+
+#endif
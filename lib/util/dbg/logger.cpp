@@ -1,20 +1,83 @@
 #include "logger.h"
 
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 #include <time.h>
 
 #include "debug.h"
+#include "binary_log.h"
+#include "log_segments.h"
+
+/**
+ * @brief Message waiting in the ring for the flusher.
+ */
+struct LogSlot {
+    size_t sequence = 0;            // <- Position of the message in the slot plus one, or position of the free slot.
+    time_t time = 0;
+    size_t length = 0;              // <- Length of the binary record.
+    char* long_text = NULL;         // <- Message that did not fit into the slot.
+    char tag[LOG_TAG_SIZE] = "";
+    char text[LOG_MESSAGE_SIZE] = "";
+};
 
 static FILE* logfile = NULL;
+static const char* log_name = NULL;
 static unsigned int log_threshold = 0;
+static LogFormat log_format = LOG_FORMAT_TEXT;
+static BinaryLogSites sites = {};
+
+static LogSegments segments = {};
+static bool segmented = false;
+static size_t segment_index = 0;    // <- Index of the current segment for the writers.
+
+static LogSlot* ring = NULL;
+static size_t ring_head = 0;        // <- Next position to be taken by a writer.
+static size_t ring_tail = 0;        // <- Next position to be written to the file by the flusher.
+static size_t dropped = 0;
+static LogOverflowPolicy overflow = LOG_OVERFLOW_BLOCK;
+
+static pthread_t flusher = {};
+static pthread_mutex_t flusher_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t flusher_wake = PTHREAD_COND_INITIALIZER;
+static bool flusher_running = false;
+static pthread_mutex_t ring_lock = PTHREAD_MUTEX_INITIALIZER;  // <- Taken by the thread that writes the ring.
+
+// Signals that terminate the program, the buffer is written before their previous actions are taken.
+static const int LOG_FLUSHED_SIGNALS[] = {SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT, SIGINT, SIGTERM, SIGHUP, SIGQUIT};
+static const size_t LOG_FLUSHED_SIGNAL_COUNT = sizeof(LOG_FLUSHED_SIGNALS) / sizeof(*LOG_FLUSHED_SIGNALS);
+static struct sigaction old_actions[LOG_FLUSHED_SIGNAL_COUNT] = {};
+static bool signals_caught = false;
+
+static __thread bool flushing = false;  // <- The thread is writing the log file, a signal must not do it again.
+static bool dying = false;              // <- The ring is written from a signal handler, the heap may be locked.
+static const size_t LOG_SIGNAL_LOCK_ATTEMPTS = 1000;  // <- Other threads hold the locks only for a short time.
+
+// Timestamps change once a second, so the formatted one is reused. Only used with the log file locked.
+static time_t stamp_time = -1;
+static char stamp[32] = "";
 
 /**
  * @brief Prints out log line prefix (time and tag).
  * 
- * @param tag (optional) prefix tag
- * @param importance (optional) message importance
+ * @param moment time of the message
+ * @param tag prefix tag
+ * @return size_t number of characters printed
+ */
+static size_t log_prefix(time_t moment, const char* tag);
+
+/**
+ * @brief Write the beginning of the log segment.
  */
-static void log_prefix(const char* tag = "status", const unsigned int importance = ABSOLUTE_IMPORTANCE);
+static void start_segment();
+
+/**
+ * @brief Close the current segment of the log and start the next one if it is full. The file has to be locked.
+ */
+static void rotate_if_full();
 
 /**
  * @brief Returns currently opened log file by given importance.
@@ -25,52 +88,635 @@ static void log_prefix(const char* tag = "status", const unsigned int importance
  */
 static FILE* log_file(const unsigned int importance = ABSOLUTE_IMPORTANCE);
 
-void log_init(const char* filename, const unsigned int threshold, int* const error_code) {
+/**
+ * @brief Allocate the ring and start the flusher.
+ * 
+ * @return false if messages have to be written synchronously
+ */
+static bool start_flusher();
+
+/**
+ * @brief Stop the flusher after it writes all messages and free the ring.
+ */
+static void stop_flusher();
+
+/**
+ * @brief Write messages until the thread is stopped.
+ * 
+ * @param argument unused
+ * @return NULL
+ */
+static void* flush_periodically(void* argument);
+
+/**
+ * @brief Write all published messages from the ring to the file.
+ * 
+ * @param wait wait for the thread that is writing the ring or the file for as long as it takes,
+ * instead of giving up after LOG_SIGNAL_LOCK_ATTEMPTS attempts to take the locks
+ */
+static void flush_ring(bool wait = true);
+
+/**
+ * @brief Write messages from the ring until the one at the position is written.
+ * 
+ * @param position position of the message
+ */
+static void flush_through(size_t position);
+
+/**
+ * @brief Write the ring to the file before the terminating signals take effect.
+ */
+static void catch_signals();
+
+/**
+ * @brief Give the terminating signals back to their previous actions.
+ */
+static void release_signals();
+
+/**
+ * @brief Write the ring to the file and take the previous action of the signal.
+ * 
+ * @param signal_number
+ * @param info origin of the signal
+ * @param context unused
+ */
+static void flush_on_signal(int signal_number, siginfo_t* info, void* context);
+
+/**
+ * @brief Take the next free slot of the ring, applying the overflow policy if there is none.
+ * 
+ * @param position variable to put position of the slot to
+ * @param keep wait for the flusher regardless of the policy
+ * @return LogSlot* slot to fill, NULL if the message was dropped
+ */
+static LogSlot* reserve_slot(size_t* position, bool keep = false);
+
+/**
+ * @brief Give the filled slot to the flusher.
+ * 
+ * @param slot
+ * @param position position of the slot
+ */
+static void publish_slot(LogSlot* slot, size_t position);
+
+/**
+ * @brief Put the record of the site into the slot.
+ * 
+ * @param slot
+ * @param site index of the site
+ */
+static void fill_site(LogSlot* slot, uint32_t site);
+
+/**
+ * @brief Put the message into the slot in the format of the log.
+ * 
+ * @param slot
+ * @param site index of the site of the message, BINARY_LOG_SITE_CAPACITY to store it as text
+ * @param tag message tag
+ * @param format format string for printf()
+ * @param args arguments for printf()
+ */
+static void fill_message(LogSlot* slot, uint32_t site, const char* tag, const char* format, va_list args)
+    __attribute__((format (printf, 4, 0)));
+
+/**
+ * @brief Put the formatted message into the slot.
+ * 
+ * @param slot
+ * @param tag message tag
+ * @param format format string for printf()
+ * @param ... arguments for printf()
+ */
+static void fill_text(LogSlot* slot, const char* tag, const char* format, ...) __attribute__((format (printf, 3, 4)));
+
+/**
+ * @brief Write the message of the slot to the file and free its text. The file has to be locked.
+ * 
+ * @param slot
+ */
+static void write_slot(LogSlot* slot);
+
+/**
+ * @brief Format the message into the ring.
+ * 
+ * @param tag message tag
+ * @param format format string for printf()
+ * @param args arguments for printf()
+ * @param urgent never drop the message and write it to the file before returning
+ */
+static void enqueue(const char* tag, const char* format, va_list args, bool urgent)
+    __attribute__((format (printf, 2, 0)));
+
+/**
+ * @brief Write the message to the file right away.
+ * 
+ * @param tag message tag
+ * @param format format string for printf()
+ * @param args arguments for printf()
+ */
+static void write_now(const char* tag, const char* format, va_list args) __attribute__((format (printf, 2, 0)));
+
+void log_init(const char* filename, const unsigned int threshold, LogFormat format, int* const error_code) {
     log_threshold = threshold;
+    log_format = format;
+
+    if ((logfile = fopen(filename, format == LOG_FORMAT_BINARY ? "ab" : "a"))) {
+        log_name = filename;
+
+        // Without the table all messages are stored formatted.
+        if (format == LOG_FORMAT_BINARY) BinaryLogSites_ctor(&sites);
+
+        start_segment();
+        fflush(logfile);
+
+        bool buffered = start_flusher();
+        if (buffered) catch_signals();
 
-    if ((logfile = fopen(filename, "a"))) {
-        setvbuf(logfile, NULL, _IONBF, 0);
-        fprintf(logfile, "<pre>");
         log_printf(ABSOLUTE_IMPORTANCE, "open", "Log file %s was opened.\n", filename);
+        if (!buffered) log_printf(WARNINGS, "warning", "Failed to start the log flusher, writing synchronously.\n");
         return;
     }
 
     if (error_code) *error_code = FILE_ERROR;
 }
 
-static void log_prefix(const char* tag, const unsigned int importance) {
-    if (!log_file()) return;
-    time_t raw_time;
-    struct tm * time_info;
+void log_set_overflow(LogOverflowPolicy policy) {
+    __atomic_store_n(&overflow, policy, __ATOMIC_RELAXED);
+}
+
+void log_set_rotation(size_t max_size, size_t max_count, bool compress, const char* asset_folder, int* const error_code) {
+    if (!logfile || !max_size || __atomic_load_n(&segmented, __ATOMIC_ACQUIRE)) return;
+
+    flushing = true;
+    flockfile(logfile);
+
+    fflush(logfile);
+    fseek(logfile, 0, SEEK_END);
+    long size = ftell(logfile);
+
+    int segments_error = 0;
+    LogSegments_ctor(&segments, log_name, size > 0 ? (size_t)size : 0, max_size, max_count, compress,
+                     asset_folder, &segments_error);
+
+    if (!segments_error) {
+        __atomic_store_n(&segment_index, segments.index, __ATOMIC_RELAXED);
+        __atomic_store_n(&segmented, true, __ATOMIC_RELEASE);
+    }
+
+    funlockfile(logfile);
+    flushing = false;
+
+    if (segments_error && error_code) *error_code = segments_error;
+}
+
+size_t log_segment() {
+    return __atomic_load_n(&segment_index, __ATOMIC_RELAXED);
+}
+
+static size_t log_prefix(time_t moment, const char* tag) {
+    if (moment != stamp_time) {
+        struct tm time_info = {};
+        localtime_r(&moment, &time_info);
+
+        asctime_r(&time_info, stamp);
+        stamp[strlen(stamp) - 1] = '\0';
+        stamp_time = moment;
+    }
+
+    int length = fprintf(logfile, LOG_PREFIX_FORMAT, stamp, tag);
+
+    return length > 0 ? (size_t)length : 0;
+}
+
+static void start_segment() {
+    if (log_format == LOG_FORMAT_TEXT) {
+        fprintf(logfile, "<pre>");
+        return;
+    }
+
+    char start[BINARY_LOG_HEADER_SIZE + sizeof(uint32_t) + sizeof(BINARY_LOG_MAGIC)] = "";
+    fwrite(start, sizeof(*start), BinaryLog_encode_start(start, sizeof(start), time(NULL)), logfile);
 
-    time(&raw_time);
-    time_info = localtime (&raw_time);
-    char* pc_timestamp = asctime(time_info);
-    pc_timestamp[strlen(pc_timestamp) - 1] = '\0';
+    if (!sites.entries) return;
 
-    fprintf(log_file(importance), "%-20s [%s]:  ", pc_timestamp, tag);
+    // Sites are written again, so that every segment can be decoded on its own.
+    LogSlot record = {};
+
+    for (uint32_t site = 0; site < BINARY_LOG_SITE_CAPACITY; ++site) {
+        const BinaryLogSite* entry = &sites.entries[site];
+        if (!__atomic_load_n(&entry->format, __ATOMIC_ACQUIRE) || !entry->encodable) continue;
+
+        fill_site(&record, site);
+        write_slot(&record);
+    }
+}
+
+static void rotate_if_full() {
+    if (!__atomic_load_n(&segmented, __ATOMIC_ACQUIRE) || !LogSegments_full(&segments)) return;
+
+    if (log_format == LOG_FORMAT_TEXT) fputs("</pre>", logfile);
+    fflush(logfile);
+
+    int rotate_error = 0;
+    LogSegments_rotate(&segments, logfile, &rotate_error);
+
+    __atomic_store_n(&segment_index, segments.index, __ATOMIC_RELAXED);
+
+    start_segment();
+
+    // Header of the segment is not counted, small segments would hold nothing else.
+    // If the next segment could not be started, the current one is continued.
+    segments.size = 0;
+
+    if (rotate_error) {
+        LogSlot report = {};
+        fill_text(&report, "log", "Failed to start the next log segment (%s).\n", strerror(rotate_error));
+        write_slot(&report);
+    }
 }
 
 void _log_printf(const unsigned int importance, const char* tag, const char* format, ...) {
+    if (importance < log_threshold || !logfile) return;
+
     va_list args;
     va_start(args, format);
 
-    if (importance >= log_threshold && logfile) {
-        log_prefix(tag, importance);
-        vfprintf(log_file(importance), format, args);
-        fflush(log_file(importance));
-    }
+    if (__atomic_load_n(&flusher_running, __ATOMIC_ACQUIRE)) enqueue(tag, format, args, importance >= LOG_SYNC_IMPORTANCE);
+    else write_now(tag, format, args);
 
     va_end(args);
 }
 
+bool log_enabled(const unsigned int importance) {
+    return log_file(importance) != NULL;
+}
+
 static FILE* log_file(const unsigned int importance) {
     return importance >= log_threshold ? logfile : NULL;
 }
 
+void log_flush() {
+    if (!__atomic_load_n(&flusher_running, __ATOMIC_ACQUIRE)) return;
+
+    size_t head = __atomic_load_n(&ring_head, __ATOMIC_ACQUIRE);
+    if (head) flush_through(head - 1);
+}
+
 void log_close(int* error_code) {
     if (!log_file()) return;
     log_printf(ABSOLUTE_IMPORTANCE, "close", "Closing log file.\n\n");
-    fprintf(log_file(ABSOLUTE_IMPORTANCE), "</pre>");
+    release_signals();
+    stop_flusher();
+    if (log_format == LOG_FORMAT_TEXT) fprintf(log_file(ABSOLUTE_IMPORTANCE), "</pre>");
     if (!fclose(logfile) && error_code) *error_code = FILE_ERROR;
-}
\ No newline at end of file
+    logfile = NULL;
+    BinaryLogSites_dtor(&sites);
+
+    if (__atomic_exchange_n(&segmented, false, __ATOMIC_ACQ_REL)) LogSegments_dtor(&segments);
+}
+
+static bool start_flusher() {
+    ring = (LogSlot*) calloc(LOG_RING_CAPACITY, sizeof(*ring));
+    if (!ring) return false;
+
+    for (size_t position = 0; position < LOG_RING_CAPACITY; ++position) ring[position].sequence = position;
+
+    ring_head = 0;
+    ring_tail = 0;
+
+    __atomic_store_n(&flusher_running, true, __ATOMIC_RELEASE);
+
+    // Signals are left to the threads that expect them.
+    sigset_t all_signals = {}, old_mask = {};
+    sigfillset(&all_signals);
+
+    pthread_sigmask(SIG_BLOCK, &all_signals, &old_mask);
+    int create_error = pthread_create(&flusher, NULL, flush_periodically, NULL);
+    pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+
+    if (!create_error) return true;
+
+    __atomic_store_n(&flusher_running, false, __ATOMIC_RELEASE);
+    free(ring);
+    ring = NULL;
+
+    return false;
+}
+
+static void stop_flusher() {
+    if (!__atomic_load_n(&flusher_running, __ATOMIC_ACQUIRE)) return;
+
+    pthread_mutex_lock(&flusher_lock);
+    __atomic_store_n(&flusher_running, false, __ATOMIC_RELEASE);
+    pthread_cond_signal(&flusher_wake);
+    pthread_mutex_unlock(&flusher_lock);
+
+    pthread_join(flusher, NULL);
+
+    free(ring);
+    ring = NULL;
+}
+
+static void* flush_periodically(void* argument) {
+    SILENCE_UNUSED(argument);
+
+    pthread_mutex_lock(&flusher_lock);
+
+    while (__atomic_load_n(&flusher_running, __ATOMIC_ACQUIRE)) {
+        struct timespec deadline = {};
+        clock_gettime(CLOCK_REALTIME, &deadline);
+
+        deadline.tv_nsec += (long)LOG_FLUSH_PERIOD_MS * 1000000;
+        deadline.tv_sec += deadline.tv_nsec / 1000000000;
+        deadline.tv_nsec %= 1000000000;
+
+        pthread_cond_timedwait(&flusher_wake, &flusher_lock, &deadline);
+
+        pthread_mutex_unlock(&flusher_lock);
+        flush_ring();
+        pthread_mutex_lock(&flusher_lock);
+    }
+
+    pthread_mutex_unlock(&flusher_lock);
+
+    // Writers are done by the time the log is closed, the rest of their messages is written here.
+    flush_ring();
+
+    return NULL;
+}
+
+static void flush_ring(bool wait) {
+    flushing = true;
+
+    if (wait) {
+        pthread_mutex_lock(&ring_lock);
+        flockfile(logfile);
+    } else {
+        bool locked = false;
+
+        for (size_t attempt = 0; attempt < LOG_SIGNAL_LOCK_ATTEMPTS && !locked; ++attempt) {
+            if (!pthread_mutex_trylock(&ring_lock)) {
+                if (!ftrylockfile(logfile)) locked = true;
+                else pthread_mutex_unlock(&ring_lock);
+            }
+
+            if (!locked) sched_yield();
+        }
+
+        if (!locked) {
+            flushing = false;
+            return;
+        }
+    }
+
+    while (true) {
+        LogSlot* slot = &ring[ring_tail % LOG_RING_CAPACITY];
+
+        // Messages are written in the order of their positions, even if later ones are ready first.
+        if (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) != ring_tail + 1) break;
+
+        write_slot(slot);
+        rotate_if_full();
+
+        __atomic_store_n(&slot->sequence, ring_tail + LOG_RING_CAPACITY, __ATOMIC_RELEASE);
+        __atomic_store_n(&ring_tail, ring_tail + 1, __ATOMIC_RELEASE);
+    }
+
+    size_t lost = __atomic_exchange_n(&dropped, 0, __ATOMIC_RELAXED);
+    if (lost && __atomic_load_n(&overflow, __ATOMIC_RELAXED) == LOG_OVERFLOW_COUNT) {
+        LogSlot report = {};
+        fill_text(&report, "log", "%lld messages were dropped, the log was full.\n", (long long)lost);
+        write_slot(&report);
+    }
+
+    fflush(logfile);
+    funlockfile(logfile);
+    pthread_mutex_unlock(&ring_lock);
+    flushing = false;
+}
+
+static void flush_through(size_t position) {
+    // Writers take turns with the flusher in writing the ring.
+    while (__atomic_load_n(&ring_tail, __ATOMIC_ACQUIRE) <= position) {
+        flush_ring();
+
+        // Messages before this one are still being formatted by other threads.
+        if (__atomic_load_n(&ring_tail, __ATOMIC_ACQUIRE) <= position) sched_yield();
+    }
+}
+
+static void catch_signals() {
+    struct sigaction flush_action = {};
+    flush_action.sa_sigaction = flush_on_signal;
+    flush_action.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&flush_action.sa_mask);
+
+    for (size_t index = 0; index < LOG_FLUSHED_SIGNAL_COUNT; ++index) {
+        sigaction(LOG_FLUSHED_SIGNALS[index], &flush_action, &old_actions[index]);
+
+        // Ignored signals do not stop the program, so there is nothing to write.
+        if (old_actions[index].sa_handler == SIG_IGN) sigaction(LOG_FLUSHED_SIGNALS[index], &old_actions[index], NULL);
+    }
+
+    __atomic_store_n(&signals_caught, true, __ATOMIC_RELEASE);
+}
+
+static void release_signals() {
+    if (!__atomic_exchange_n(&signals_caught, false, __ATOMIC_ACQ_REL)) return;
+
+    struct sigaction current = {};
+
+    // Actions that were set after the log was opened are kept.
+    for (size_t index = 0; index < LOG_FLUSHED_SIGNAL_COUNT; ++index) {
+        sigaction(LOG_FLUSHED_SIGNALS[index], NULL, &current);
+        if (current.sa_sigaction == flush_on_signal) sigaction(LOG_FLUSHED_SIGNALS[index], &old_actions[index], NULL);
+    }
+}
+
+static void flush_on_signal(int signal_number, siginfo_t* info, void* context) {
+    SILENCE_UNUSED(context);
+
+    int old_errno = errno;
+
+    // The program is going down anyway, so the ring is written with the usual (not async-signal-safe) calls.
+    // Locks held by the interrupted code are not waited for, and the heap is left alone.
+    if (!flushing && __atomic_load_n(&flusher_running, __ATOMIC_ACQUIRE)) {
+        __atomic_store_n(&dying, true, __ATOMIC_RELAXED);
+        flush_ring(false);
+        __atomic_store_n(&dying, false, __ATOMIC_RELAXED);
+    }
+
+    for (size_t index = 0; index < LOG_FLUSHED_SIGNAL_COUNT; ++index) {
+        if (LOG_FLUSHED_SIGNALS[index] == signal_number) sigaction(signal_number, &old_actions[index], NULL);
+    }
+
+    // Faults happen again when the instruction is repeated, other signals are sent again
+    // (including the ones from the terminal, that come from the kernel too).
+    // The signal is blocked until the handler returns, so the previous action takes it after that.
+    bool is_fault = signal_number == SIGSEGV || signal_number == SIGBUS || signal_number == SIGFPE ||
+                    signal_number == SIGILL;
+    if (!is_fault || info->si_code <= 0) raise(signal_number);
+
+    errno = old_errno;
+}
+
+static LogSlot* reserve_slot(size_t* position, bool keep) {
+    size_t head = __atomic_load_n(&ring_head, __ATOMIC_RELAXED);
+
+    while (true) {
+        LogSlot* slot = &ring[head % LOG_RING_CAPACITY];
+        size_t sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+
+        if (sequence == head) {
+            if (__atomic_compare_exchange_n(&ring_head, &head, head + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                *position = head;
+                return slot;
+            }
+
+            continue;
+        }
+
+        // The slot still holds the message from the previous lap, so the ring is full.
+        if (sequence < head + 1) {
+            if (!keep && __atomic_load_n(&overflow, __ATOMIC_RELAXED) != LOG_OVERFLOW_BLOCK) {
+                __atomic_fetch_add(&dropped, 1, __ATOMIC_RELAXED);
+                return NULL;
+            }
+
+            pthread_cond_signal(&flusher_wake);
+            sched_yield();
+        }
+
+        head = __atomic_load_n(&ring_head, __ATOMIC_RELAXED);
+    }
+}
+
+static void publish_slot(LogSlot* slot, size_t position) {
+    __atomic_store_n(&slot->sequence, position + 1, __ATOMIC_RELEASE);
+
+    // The flusher wakes up on its own often enough, unless the ring fills up quickly.
+    if (position % (LOG_RING_CAPACITY / 4) == 0) pthread_cond_signal(&flusher_wake);
+}
+
+static void fill_site(LogSlot* slot, uint32_t site) {
+    slot->length = BinaryLog_encode_site(slot->text, LOG_MESSAGE_SIZE, &sites, site);
+    if (slot->length <= LOG_MESSAGE_SIZE) return;
+
+    slot->long_text = (char*) calloc(slot->length, sizeof(*slot->long_text));
+
+    if (slot->long_text) BinaryLog_encode_site(slot->long_text, slot->length, &sites, site);
+    else slot->length = 0;
+}
+
+static void fill_message(LogSlot* slot, uint32_t site, const char* tag, const char* format, va_list args) {
+    slot->time = time(NULL);
+
+    va_list copy;
+    va_copy(copy, args);
+
+    if (log_format == LOG_FORMAT_TEXT) {
+        snprintf(slot->tag, LOG_TAG_SIZE, "%s", tag);
+
+        int length = vsnprintf(slot->text, LOG_MESSAGE_SIZE, format, args);
+        if (length >= (int)LOG_MESSAGE_SIZE) {
+            slot->long_text = (char*) calloc((size_t)length + 1, sizeof(*slot->long_text));
+            if (slot->long_text) vsnprintf(slot->long_text, (size_t)length + 1, format, copy);
+        }
+    } else if (site < BINARY_LOG_SITE_CAPACITY) {
+        slot->length = BinaryLog_encode_message(slot->text, LOG_MESSAGE_SIZE, &sites, site, slot->time, args);
+        if (slot->length > LOG_MESSAGE_SIZE) {
+            slot->long_text = (char*) calloc(slot->length, sizeof(*slot->long_text));
+            if (slot->long_text) BinaryLog_encode_message(slot->long_text, slot->length, &sites, site, slot->time, copy);
+        }
+    } else {
+        slot->length = BinaryLog_encode_text(slot->text, LOG_MESSAGE_SIZE, slot->time, tag, format, args);
+        if (slot->length > LOG_MESSAGE_SIZE) {
+            slot->long_text = (char*) calloc(slot->length, sizeof(*slot->long_text));
+            if (slot->long_text) BinaryLog_encode_text(slot->long_text, slot->length, slot->time, tag, format, copy);
+        }
+    }
+
+    va_end(copy);
+
+    // Truncated record would break the rest of the binary log, so it is not written at all.
+    if (slot->length > LOG_MESSAGE_SIZE && !slot->long_text) slot->length = 0;
+}
+
+static void fill_text(LogSlot* slot, const char* tag, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+
+    fill_message(slot, BINARY_LOG_SITE_CAPACITY, tag, format, args);
+
+    va_end(args);
+}
+
+static void write_slot(LogSlot* slot) {
+    const char* text = slot->long_text ? slot->long_text : slot->text;
+
+    size_t written = 0;
+
+    if (log_format == LOG_FORMAT_TEXT) {
+        size_t length = strlen(text);
+
+        written = log_prefix(slot->time, slot->tag) + length;
+        fwrite(text, sizeof(*text), length, logfile);
+    } else {
+        written = slot->length;
+        fwrite(text, sizeof(*text), slot->length, logfile);
+    }
+
+    // Until the log is split the segment is not set up, and the size is counted by LogSegments_ctor().
+    if (__atomic_load_n(&segmented, __ATOMIC_ACQUIRE)) segments.size += written;
+
+    if (!__atomic_load_n(&dying, __ATOMIC_RELAXED)) free(slot->long_text);
+    slot->long_text = NULL;
+}
+
+static void enqueue(const char* tag, const char* format, va_list args, bool urgent) {
+    uint32_t site = BINARY_LOG_SITE_CAPACITY;
+    bool is_new = false;
+
+    if (log_format == LOG_FORMAT_BINARY) site = BinaryLogSites_find(&sites, tag, format, &is_new);
+
+    size_t position = 0;
+
+    // Messages of the site cannot be decoded without its record, so it is never dropped.
+    if (is_new) {
+        LogSlot* site_slot = reserve_slot(&position, true);
+        fill_site(site_slot, site);
+        publish_slot(site_slot, position);
+    }
+
+    LogSlot* slot = reserve_slot(&position, urgent);
+    if (!slot) return;
+
+    fill_message(slot, site, tag, format, args);
+    publish_slot(slot, position);
+
+    if (urgent) flush_through(position);
+}
+
+static void write_now(const char* tag, const char* format, va_list args) {
+    uint32_t site = BINARY_LOG_SITE_CAPACITY;
+    bool is_new = false;
+
+    if (log_format == LOG_FORMAT_BINARY) site = BinaryLogSites_find(&sites, tag, format, &is_new);
+
+    LogSlot slot = {};
+
+    // Keep the prefix and the message of one thread together.
+    flockfile(logfile);
+
+    if (is_new) {
+        fill_site(&slot, site);
+        write_slot(&slot);
+    }
+
+    fill_message(&slot, site, tag, format, args);
+    write_slot(&slot);
+    rotate_if_full();
+
+    fflush(logfile);
+    funlockfile(logfile);
+}
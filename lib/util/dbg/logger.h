@@ -14,6 +14,14 @@
 
 #include <stdio.h>
 
+const size_t LOG_RING_CAPACITY = 2048;          // <- Messages waiting for the flusher.
+const size_t LOG_MESSAGE_SIZE = 512;            // <- Longer messages are copied to the heap.
+const size_t LOG_TAG_SIZE = 24;
+const unsigned int LOG_FLUSH_PERIOD_MS = 50;
+
+#define LOG_PREFIX_FORMAT "%-20s [%s]:  "
+#define LOG_ASSET_PREFIX_FORMAT "seg%04zu_"
+
 enum IMPORTANCES {
     DATA_UPDATES = 0,
     STATUS_REPORTS = 1,
@@ -24,6 +32,28 @@ enum IMPORTANCES {
     ABSOLUTE_IMPORTANCE = 1000,
 };
 
+const unsigned int LOG_SYNC_IMPORTANCE = ERROR_REPORTS;  // <- Messages that are in the file before log_printf() returns.
+
+#ifndef LOG_MIN_IMPORTANCE
+/**
+ * @brief Importance below which log_printf() calls are removed at compile time.
+ */
+#define LOG_MIN_IMPORTANCE DATA_UPDATES
+#endif
+
+const unsigned int LOG_COMPILED_IMPORTANCE = LOG_MIN_IMPORTANCE;
+
+/**
+ * @brief Check if messages of the importance are built into the program.
+ * Arguments of the messages that are not are never evaluated, runtime threshold only applies to the rest.
+ * 
+ * @param importance importance of the message
+ * @return true if they are
+ */
+constexpr bool log_compiled(const unsigned int importance) {
+    return importance >= LOG_COMPILED_IMPORTANCE;
+}
+
 #include <stdarg.h>
 
 #ifndef NDEBUG
@@ -36,8 +66,10 @@ enum IMPORTANCES {
  * @param __VA_ARGS__ arguments as if they were in printf()
  */
 #define log_printf(importance, tag, ...) do {                                                            \
-    _log_printf(importance, tag, " ----- Called from %s:%d. -----\n", __FILE__, __LINE__);  \
-    _log_printf(importance, tag, __VA_ARGS__);                                                           \
+    if constexpr (log_compiled(importance)) {                                                            \
+        _log_printf(importance, tag, " ----- Called from %s:%d. -----\n", __FILE__, __LINE__);          \
+        _log_printf(importance, tag, __VA_ARGS__);                                                       \
+    }                                                                                                    \
 } while(0)
 #else
 /**
@@ -47,8 +79,10 @@ enum IMPORTANCES {
  * @param tag prefix of the message
  * @param __VA_ARGS__ arguments as if they were in printf()
  */
-#define log_printf(importance, tag, ...) do { \
-    _log_printf(importance, tag, __VA_ARGS__);\
+#define log_printf(importance, tag, ...) do {           \
+    if constexpr (log_compiled(importance)) {           \
+        _log_printf(importance, tag, __VA_ARGS__);      \
+    }                                                   \
 } while(0)
 #endif
 #else
@@ -63,14 +97,37 @@ enum IMPORTANCES {
 
 #endif
 
+/**
+ * @brief What writers do when the flusher falls behind and the log is full.
+ */
+enum LogOverflowPolicy {
+    LOG_OVERFLOW_BLOCK = 0,     // <- Wait for the flusher, nothing is lost.
+    LOG_OVERFLOW_DROP = 1,      // <- Throw the message away.
+    LOG_OVERFLOW_COUNT = 2,     // <- Throw the message away and write the number of lost messages to the log.
+};
+
+/**
+ * @brief Formats of the log file.
+ */
+enum LogFormat {
+    LOG_FORMAT_TEXT = 0,        // <- HTML page with formatted messages.
+    LOG_FORMAT_BINARY = 1,      // <- Raw arguments of the messages, formatted later by the log decoder.
+};
+
 /**
  * @brief Open log file or creates empty one.
+ * Messages are put into a ring buffer and written to the file by a background thread,
+ * if the thread cannot be started they are written right away.
+ * Messages of LOG_SYNC_IMPORTANCE and above are written together with all messages before them right away,
+ * the rest of the buffer is also written when the program crashes, aborts or is stopped by a signal.
  * 
- * @param filename (optional) log file name
+ * @param filename (optional) log file name, has to stay valid until the log is closed
  * @param threshold (optional) value, below which program would print log lines into dummy file.
+ * @param format (optional) format of the log file
  * @param error_code (optional) variable to put function execution code in
  */
-void log_init(const char* filename = "log", const unsigned int threshold = 0, int* const error_code = NULL);
+void log_init(const char* filename = "log", const unsigned int threshold = 0, LogFormat format = LOG_FORMAT_TEXT,
+              int* const error_code = NULL);
 
 /**
  * @brief Print line to logs with automatic prefix.
@@ -83,8 +140,50 @@ void log_init(const char* filename = "log", const unsigned int threshold = 0, in
 void _log_printf(const unsigned int importance, const char* tag, const char* format, ...)
     __attribute__((format (printf, 3, 4)));
 
+/**
+ * @brief Check if messages of the importance get into the log.
+ * 
+ * @param importance importance of the message
+ * @return true if they do
+ */
+bool log_enabled(const unsigned int importance);
+
+/**
+ * @brief Set what to do with messages when the log is full (LOG_OVERFLOW_BLOCK by default).
+ * 
+ * @param policy
+ */
+void log_set_overflow(LogOverflowPolicy policy);
+
+/**
+ * @brief Split the log into segments of about the given size, keeping only the latest ones.
+ * The file the log was opened with is always the current segment, closed ones are numbered.
+ * Segments are switched by the flusher, so the writers do not wait for it.
+ * 
+ * @param max_size size of the segment in bytes after which the next one is started
+ * @param max_count number of segments to keep, the current one included
+ * @param compress compress closed segments in the background
+ * @param asset_folder (optional) folder with files of the segments, named with log_segment(), removed with them
+ * @param error_code (optional) variable to put function execution code in
+ */
+void log_set_rotation(size_t max_size, size_t max_count, bool compress = false, const char* asset_folder = NULL,
+                      int* const error_code = NULL);
+
+/**
+ * @brief Get index of the segment being written, files that belong to it are named "seg<index>_<name>".
+ * 
+ * @return size_t index of the segment, 0 if the log is not split
+ */
+size_t log_segment();
+
+/**
+ * @brief Write messages that are waiting in the buffer to the file before returning.
+ */
+void log_flush();
+
 /**
  * @brief Close opened log file.
+ * Messages that are still in the buffer are written first.
  * 
  * @param error_code (optional) variable to put function execution code in
  */
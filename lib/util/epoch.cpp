@@ -0,0 +1,161 @@
+#include "epoch.h"
+
+#include <pthread.h>
+
+#include "dbg/debug.h"
+
+/**
+ * @brief Announcement of the reading thread, each one takes its own cache line.
+ */
+struct alignas(EPOCH_CACHE_LINE) EpochSlot {
+    uint64_t epoch = 0;     // <- Epoch the thread entered its read section at (0 - not reading).
+    bool taken = false;
+};
+
+static EpochSlot slots[EPOCH_MAX_READERS] = {};
+static size_t slot_count = 0;           // <- Slots past this one were never taken.
+
+static uint64_t global_epoch = 1;
+
+// Readers that did not get a slot block all reclamation while they read.
+static size_t unregistered_readers = 0;
+
+static __thread EpochSlot* own_slot = NULL;
+static __thread size_t nesting = 0;
+
+static pthread_once_t slot_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t slot_key = {};
+
+/**
+ * @brief Create the key that releases slots of finished threads.
+ */
+static void create_slot_key();
+
+/**
+ * @brief Give the slot of the finished thread to other threads.
+ * 
+ * @param slot EpochSlot* of the thread
+ */
+static void release_slot(void* slot);
+
+/**
+ * @brief Take a free slot for the current thread.
+ * 
+ * @return EpochSlot* taken slot, NULL if all of them are taken
+ */
+static EpochSlot* claim_slot();
+
+/**
+ * @brief Find the oldest epoch any thread reads at.
+ * 
+ * @return uint64_t oldest epoch (UINT64_MAX if nobody reads, 0 if the oldest epoch is unknown)
+ */
+static uint64_t oldest_reader();
+
+void epoch_enter() {
+    if (nesting++) return;
+
+    if (!own_slot) own_slot = claim_slot();
+
+    if (own_slot) __atomic_store_n(&own_slot->epoch, __atomic_load_n(&global_epoch, __ATOMIC_SEQ_CST), __ATOMIC_SEQ_CST);
+    else __atomic_add_fetch(&unregistered_readers, 1, __ATOMIC_SEQ_CST);
+
+    // The announcement has to be visible before any shared pointer is read.
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+void epoch_exit() {
+    if (!nesting || --nesting) return;
+
+    if (own_slot) __atomic_store_n(&own_slot->epoch, 0, __ATOMIC_RELEASE);
+    else __atomic_sub_fetch(&unregistered_readers, 1, __ATOMIC_RELEASE);
+}
+
+void EpochList_retire(EpochList* list, void* object, int* const err_code) {
+    if (!list || !object) return;
+
+    if (list->size == list->capacity) {
+        size_t capacity = list->capacity ? 2 * list->capacity : EPOCH_LIST_MIN_CAPACITY;
+
+        // The object can not be reclaimed safely without its epoch, so it is leaked on failure.
+        EpochRetiredObject* objects = (EpochRetiredObject*) realloc(list->objects, capacity * sizeof(*objects));
+        _LOG_FAIL_CHECK_(objects, "error", ERROR_REPORTS, return, err_code, ENOMEM);
+
+        list->objects = objects;
+        list->capacity = capacity;
+    }
+
+    // Readers that enter after the increment can not reach the object anymore.
+    list->objects[list->size].object = object;
+    list->objects[list->size].epoch = __atomic_fetch_add(&global_epoch, 1, __ATOMIC_SEQ_CST);
+    ++list->size;
+}
+
+void EpochList_collect(EpochList* list, void (*reclaim)(void* object, void* context), void* context) {
+    if (!list || !list->size) return;
+
+    uint64_t oldest = oldest_reader();
+
+    size_t kept = 0;
+
+    for (size_t id = 0; id < list->size; ++id) {
+        if (list->objects[id].epoch < oldest) {
+            if (reclaim) reclaim(list->objects[id].object, context);
+        } else {
+            list->objects[kept++] = list->objects[id];
+        }
+    }
+
+    list->size = kept;
+}
+
+void EpochList_dtor(EpochList* list, void (*reclaim)(void* object, void* context), void* context) {
+    if (!list) return;
+
+    for (size_t id = 0; reclaim && id < list->size; ++id) reclaim(list->objects[id].object, context);
+
+    free(list->objects);
+    *list = {};
+}
+
+static void create_slot_key() {
+    pthread_key_create(&slot_key, release_slot);
+}
+
+static void release_slot(void* slot) {
+    __atomic_store_n(&((EpochSlot*) slot)->epoch, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&((EpochSlot*) slot)->taken, false, __ATOMIC_RELEASE);
+}
+
+static EpochSlot* claim_slot() {
+    pthread_once(&slot_key_once, create_slot_key);
+
+    for (size_t id = 0; id < EPOCH_MAX_READERS; ++id) {
+        bool expected = false;
+        if (!__atomic_compare_exchange_n(&slots[id].taken, &expected, true, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) continue;
+
+        size_t count = __atomic_load_n(&slot_count, __ATOMIC_RELAXED);
+        while (count <= id && !__atomic_compare_exchange_n(&slot_count, &count, id + 1, true, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED));
+
+        pthread_setspecific(slot_key, &slots[id]);
+        return &slots[id];
+    }
+
+    return NULL;
+}
+
+static uint64_t oldest_reader() {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n(&unregistered_readers, __ATOMIC_SEQ_CST)) return 0;
+
+    uint64_t oldest = UINT64_MAX;
+    size_t count = __atomic_load_n(&slot_count, __ATOMIC_SEQ_CST);
+
+    for (size_t id = 0; id < count; ++id) {
+        uint64_t epoch = __atomic_load_n(&slots[id].epoch, __ATOMIC_SEQ_CST);
+        if (epoch && epoch < oldest) oldest = epoch;
+    }
+
+    return oldest;
+}
@@ -0,0 +1,79 @@
+/**
+ * @file epoch.h
+ * @author Kudryashov Ilya (kudriashov.it@phystech.edu)
+ * @brief Epoch-based reclamation of memory read without locks.
+ * @version 0.1
+ * @date 2022-11-22
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#ifndef EPOCH_H
+#define EPOCH_H
+
+#include <stdlib.h>
+#include <stdint.h>
+
+const size_t EPOCH_MAX_READERS = 512;
+const size_t EPOCH_CACHE_LINE = 64;
+const size_t EPOCH_LIST_MIN_CAPACITY = 64;
+
+/**
+ * @brief Start reading shared data. Objects retired after this call are not reclaimed until epoch_exit().
+ * Calls can be nested, every thread has its own read section.
+ */
+void epoch_enter();
+
+/**
+ * @brief Stop reading shared data, pointers obtained since the matching epoch_enter() must not be used anymore.
+ */
+void epoch_exit();
+
+/**
+ * @brief Object that is no longer reachable but can still be read by threads that found it earlier.
+ */
+struct EpochRetiredObject {
+    void* object = NULL;
+    uint64_t epoch = 0;
+};
+
+/**
+ * @brief List of retired objects of one owner. Functions of the list are not thread-safe,
+ * the owner calls them from its writer (the one that unlinks objects).
+ */
+struct EpochList {
+    EpochRetiredObject* objects = NULL;
+    size_t size = 0;
+    size_t capacity = 0;
+};
+
+/**
+ * @brief Remember the object that was just unlinked. It is reclaimed by EpochList_collect()
+ * once all threads that could have seen it leave their read sections.
+ * 
+ * @param list
+ * @param object unlinked object
+ * @param err_code variable to use as errno
+ */
+void EpochList_retire(EpochList* list, void* object, int* const err_code = NULL);
+
+/**
+ * @brief Reclaim retired objects that no reader can see anymore.
+ * 
+ * @param list
+ * @param reclaim function to call for every safe object
+ * @param context second argument of the reclaim function
+ */
+void EpochList_collect(EpochList* list, void (*reclaim)(void* object, void* context), void* context);
+
+/**
+ * @brief Destroy the list, reclaiming all of its objects without waiting for readers.
+ * 
+ * @param list
+ * @param reclaim function to call for every object (can be NULL)
+ * @param context second argument of the reclaim function
+ */
+void EpochList_dtor(EpochList* list, void (*reclaim)(void* object, void* context) = NULL, void* context = NULL);
+
+#endif
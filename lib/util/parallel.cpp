@@ -0,0 +1,63 @@
+#include "parallel.h"
+
+#include <atomic>
+#include <thread>
+#include <system_error>
+
+/**
+ * @brief Shared state of the loop workers.
+ */
+struct ParallelLoop {
+    std::atomic<size_t> next_index {0};
+    size_t count = 0;
+    void (*task)(size_t index, void* context) = NULL;
+    void* context = NULL;
+};
+
+/**
+ * @brief Take indices from the loop and execute them until there are none left.
+ * 
+ * @param loop
+ */
+static void run_worker(ParallelLoop* loop);
+
+size_t parallel_thread_count() {
+    unsigned int count = std::thread::hardware_concurrency();
+    return count ? (size_t)count : 1;
+}
+
+void parallel_for(size_t count, void (*task)(size_t index, void* context), void* context, size_t thread_limit) {
+    if (!task || !count) return;
+
+    if (!thread_limit) thread_limit = parallel_thread_count();
+    if (thread_limit > count) thread_limit = count;
+
+    ParallelLoop loop = {};
+    loop.count = count;
+    loop.task = task;
+    loop.context = context;
+
+    std::thread* workers = new (std::nothrow) std::thread[thread_limit - 1];
+    size_t started = 0;
+
+    // The calling thread is a worker too. If threads can not be created, it does the rest of the work itself.
+    for (; workers && started < thread_limit - 1; ++started) {
+        try {
+            workers[started] = std::thread(run_worker, &loop);
+        } catch (const std::system_error&) {
+            break;
+        }
+    }
+
+    run_worker(&loop);
+
+    for (size_t id = 0; id < started; ++id) workers[id].join();
+
+    delete[] workers;
+}
+
+static void run_worker(ParallelLoop* loop) {
+    for (size_t index = loop->next_index++; index < loop->count; index = loop->next_index++) {
+        loop->task(index, loop->context);
+    }
+}
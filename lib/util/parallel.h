@@ -0,0 +1,35 @@
+/**
+ * @file parallel.h
+ * @author Kudryashov Ilya (kudriashov.it@phystech.edu)
+ * @brief Minimal thread pool for data-parallel loops.
+ * @version 0.1
+ * @date 2022-11-18
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <cstddef>
+
+/**
+ * @brief Get number of threads worth spawning on this machine.
+ * 
+ * @return size_t number of hardware threads (at least 1)
+ */
+size_t parallel_thread_count();
+
+/**
+ * @brief Call the task for every index in [0, count) using all available cores.
+ * Indices are handed out to worker threads one by one, the call returns after all of them are processed.
+ * 
+ * @param count number of tasks
+ * @param task function to call, receives index of the task and the context
+ * @param context pointer to pass to every task call
+ * @param thread_limit maximal number of threads to use (0 = parallel_thread_count())
+ */
+void parallel_for(size_t count, void (*task)(size_t index, void* context), void* context, size_t thread_limit = 0);
+
+#endif
@@ -0,0 +1,140 @@
+#include "word_index.h"
+
+#include <string.h>
+
+/**
+ * @brief Calculate hash of the word.
+ * 
+ * @param key zero-terminated word
+ * @return hash_t 
+ */
+static hash_t hash_word(const char* key);
+
+/**
+ * @brief Get the slot where the word is located or should be placed.
+ * 
+ * @param table
+ * @param key word
+ * @param hash hash of the word
+ * @return WordIndexEntry* 
+ */
+static WordIndexEntry* find_slot(const WordIndexTable* table, const char* key, hash_t hash);
+
+/**
+ * @brief Allocate the table with the new capacity, move all entries to it and publish it.
+ * 
+ * @param index
+ * @param capacity new capacity (power of 2)
+ * @param err_code variable to use as errno
+ */
+static void rehash(WordIndex* index, size_t capacity, int* const err_code);
+
+/**
+ * @brief Free the replaced table (EpochList reclaim function).
+ * 
+ * @param table WordIndexTable* to free
+ * @param context unimportant
+ */
+static void free_table(void* table, void* context);
+
+void WordIndex_ctor(WordIndex* index, size_t capacity, int* const err_code) {
+    _LOG_FAIL_CHECK_(index, "error", ERROR_REPORTS, return, err_code, EINVAL);
+
+    index->table = NULL;
+    index->size = 0;
+    index->retired = {};
+
+    size_t table_size = WORD_INDEX_MIN_CAPACITY;
+    while (table_size < capacity * 2) table_size *= 2;
+
+    rehash(index, table_size, err_code);
+}
+
+void WordIndex_dtor(WordIndex* index) {
+    if (!index) return;
+
+    EpochList_dtor(&index->retired, free_table, NULL);
+
+    free(index->table);
+    index->table = NULL;
+    index->size = 0;
+}
+
+void WordIndex_insert(WordIndex* index, const char* key, TreeNode* node, int* const err_code) {
+    _LOG_FAIL_CHECK_(index, "error", ERROR_REPORTS, return, err_code, EINVAL);
+    _LOG_FAIL_CHECK_(key,   "error", ERROR_REPORTS, return, err_code, EINVAL);
+
+    // Table is kept at most half full, so probe sequences stay short.
+    size_t capacity = index->table ? index->table->capacity : 0;
+    if (2 * (index->size + 1) > capacity) {
+        rehash(index, capacity ? 2 * capacity : WORD_INDEX_MIN_CAPACITY, err_code);
+        if (!index->table || 2 * (index->size + 1) > index->table->capacity) return;
+    }
+
+    hash_t hash = hash_word(key);
+    WordIndexEntry* slot = find_slot(index->table, key, hash);
+
+    // Readers see the key only after the rest of the entry, keys of taken slots never change.
+    if (!slot->key) {
+        ++index->size;
+
+        slot->hash = hash;
+        __atomic_store_n(&slot->node, node, __ATOMIC_RELAXED);
+        __atomic_store_n(&slot->key, key, __ATOMIC_RELEASE);
+    } else {
+        __atomic_store_n(&slot->node, node, __ATOMIC_RELEASE);
+    }
+}
+
+TreeNode* WordIndex_find(const WordIndex* index, const char* key) {
+    if (!index || !key) return NULL;
+
+    const WordIndexTable* table = __atomic_load_n(&index->table, __ATOMIC_ACQUIRE);
+    if (!table) return NULL;
+
+    return __atomic_load_n(&find_slot(table, key, hash_word(key))->node, __ATOMIC_ACQUIRE);
+}
+
+static hash_t hash_word(const char* key) {
+    return get_simple_hash(key, key + strlen(key));
+}
+
+static WordIndexEntry* find_slot(const WordIndexTable* table, const char* key, hash_t hash) {
+    size_t mask = table->capacity - 1;
+
+    for (size_t position = (size_t)(hash ^ (hash >> 32)) & mask;; position = (position + 1) & mask) {
+        WordIndexEntry* slot = &table->entries[position];
+
+        const char* slot_key = __atomic_load_n(&slot->key, __ATOMIC_ACQUIRE);
+        if (!slot_key) return slot;
+        if (slot->hash == hash && strcmp(slot_key, key) == 0) return slot;
+    }
+}
+
+static void rehash(WordIndex* index, size_t capacity, int* const err_code) {
+    WordIndexTable* table = (WordIndexTable*) calloc(1, sizeof(*table) + capacity * sizeof(*table->entries));
+    _LOG_FAIL_CHECK_(table, "error", ERROR_REPORTS, return, err_code, ENOMEM);
+
+    table->entries = (WordIndexEntry*)(table + 1);
+    table->capacity = capacity;
+
+    WordIndexTable* old_table = index->table;
+
+    for (size_t position = 0; old_table && position < old_table->capacity; ++position) {
+        const WordIndexEntry* entry = &old_table->entries[position];
+        if (entry->key) *find_slot(table, entry->key, entry->hash) = *entry;
+    }
+
+    __atomic_store_n(&index->table, table, __ATOMIC_RELEASE);
+
+    if (!old_table) return;
+
+    // Readers may still probe the old table.
+    EpochList_retire(&index->retired, old_table, err_code);
+    EpochList_collect(&index->retired, free_table, NULL);
+}
+
+static void free_table(void* table, void* context) {
+    SILENCE_UNUSED(context);
+    free(table);
+}
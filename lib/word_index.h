@@ -0,0 +1,86 @@
+/**
+ * @file word_index.h
+ * @author Kudryashov Ilya (kudriashov.it@phystech.edu)
+ * @brief Open-addressing hash index from words to tree nodes.
+ * @version 0.1
+ * @date 2022-11-16
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#ifndef WORD_INDEX_H
+#define WORD_INDEX_H
+
+#include <stdlib.h>
+
+#include "util/dbg/debug.h"
+#include "util/epoch.h"
+
+struct TreeNode;
+
+const size_t WORD_INDEX_MIN_CAPACITY = 64;
+
+struct WordIndexEntry {
+    const char* key = NULL;
+    hash_t hash = 0;
+    TreeNode* node = NULL;
+};
+
+/**
+ * @brief Table of the index, entries are allocated right after it.
+ */
+struct WordIndexTable {
+    WordIndexEntry* entries = NULL;
+    size_t capacity = 0;
+};
+
+/**
+ * @brief Hash table with linear probing. Keys are not copied, so they have to outlive the index.
+ * Zero-initialized index is empty and ready to use.
+ * One thread can insert words while others search them: entries are published atomically
+ * and grown tables replace old ones, which are freed once no reader can see them (see epoch.h).
+ */
+struct WordIndex {
+    WordIndexTable* table = NULL;
+    size_t size = 0;
+    EpochList retired = {};     // <- Replaced tables.
+};
+
+/**
+ * @brief Initialize empty index.
+ * 
+ * @param index
+ * @param capacity expected number of words
+ * @param err_code variable to use as errno
+ */
+void WordIndex_ctor(WordIndex* index, size_t capacity = 0, int* const err_code = NULL);
+
+/**
+ * @brief Free the table of the index.
+ * 
+ * @param index
+ */
+void WordIndex_dtor(WordIndex* index);
+
+/**
+ * @brief Assign node to the word, replacing the previous one if the word is already in the index.
+ * 
+ * @param index
+ * @param key word (zero-terminated)
+ * @param node node to assign
+ * @param err_code variable to use as errno
+ */
+void WordIndex_insert(WordIndex* index, const char* key, TreeNode* node, int* const err_code = NULL);
+
+/**
+ * @brief Find the node assigned to the word.
+ * Can be called while the index is modified if the caller is inside of epoch_enter() section.
+ * 
+ * @param index
+ * @param key word (zero-terminated)
+ * @return TreeNode* assigned node, NULL if the word is not in the index
+ */
+TreeNode* WordIndex_find(const WordIndex* index, const char* key);
+
+#endif
@@ -14,6 +14,62 @@
 
 { {'I', ""}, { log_threshold_wrapper, 1, edit_int },
     "set log threshold to the specified number.\n"
+    "\tMessages below LOG_MIN_IMPORTANCE the program was built with are never written.\n"
     "\tDoes not check if integer was specified." },
 
-{ {'S', "silent"}, { {}, 0, mute_speaker } }
+{ {'L', ""}, { log_overflow_wrapper, 1, edit_int },
+    "set what to do when the log is written faster than it is saved:\n"
+    "\t0 - wait (default), 1 - drop messages, 2 - drop messages and write their number to the log." },
+
+{ {'E', "binary-log"}, { binary_log_wrapper, 1, set_true },
+    "write raw arguments of log messages to " BINARY_LOG_NAME " instead of formatting them.\n"
+    "\tThe log is turned into program_log.html by the log decoder." },
+
+{ {'X', ""}, { log_segment_size_wrapper, 1, edit_int },
+    "start the next log file after the current one grows to the specified number of kilobytes.\n"
+    "\tOlder files are numbered, pictures of the tree are removed together with the files they are shown in." },
+
+{ {'Y', ""}, { log_segment_count_wrapper, 1, edit_int },
+    "keep the specified number of the latest log files (4 by default)." },
+
+{ {'G', "gzip-log"}, { compress_log_wrapper, 1, set_true },
+    "compress log files with gzip after the next one is started." },
+
+{ {'S', "silent"}, { {}, 0, mute_speaker } },
+
+{ {'T', "convert"}, { convert_wrapper, 1, set_true },
+    "convert the database between text and binary formats.\n"
+    "\tResult is written to the file specified as the second argument." },
+
+{ {'R', "restructure"}, { restructure_wrapper, 1, set_true },
+    "rebuild the database so that popular words take fewer questions to guess.\n"
+    "\tPopularity of the words is read from the \"count word\" lines of the file specified as the second argument." },
+
+{ {'Z', "compact"}, { compact_wrapper, 1, set_true },
+    "save text databases without line breaks and indentation." },
+
+{ {'B', "batch"}, { batch_wrapper, 1, set_true },
+    "answer \"D word\" and \"C word_a word_b\" queries without interaction.\n"
+    "\tQueries are read from the file specified as the second argument (standard input by default)." },
+
+{ {'N', ""}, { sessions_wrapper, 1, edit_int },
+    "play the specified number of guessing games against simulated players and print statistics.\n"
+    "\tWords learned during the games are not saved." },
+
+{ {'W', ""}, { threads_wrapper, 1, edit_int },
+    "set the number of threads to play simulated games on (1 by default)." },
+
+{ {'U', "serve"}, { serve_wrapper, 1, set_true },
+    "serve players connecting to the Unix domain socket until interrupted.\n"
+    "\tSocket path is the second argument (" DEFAULT_SOCKET_NAME " by default), learned words are saved on exit." },
+
+{ {'K', ""}, { checkpoint_period_wrapper, 1, edit_int },
+    "write learned words into the database in the background every specified number of seconds.\n"
+    "\tUntil then they are kept in the journal of the database." },
+
+{ {'M', ""}, { checkpoint_splits_wrapper, 1, edit_int },
+    "write learned words into the database in the background after the specified number of them." },
+
+{ {'H', ""}, { stats_wrapper, 1, edit_int },
+    "print the specified number of the most accessed nodes of the tree, average number of questions\n"
+    "\tper game and the histogram of game lengths before exiting." }
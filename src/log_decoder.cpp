@@ -0,0 +1,51 @@
+/**
+ * @file log_decoder.cpp
+ * @author Kudryashov Ilya (kudriashov.it@phystech.edu)
+ * @brief Turns binary log of the program into the HTML log.
+ * @version 0.1
+ * @date 2022-11-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "lib/util/dbg/debug.h"
+#include "lib/util/dbg/binary_log.h"
+
+#include "utils/config.h"
+
+int main(const int argc, const char** argv) {
+    const char* input_name = argc > 1 ? argv[1] : BINARY_LOG_NAME;
+    const char* output_name = argc > 2 ? argv[2] : DECODED_LOG_NAME;
+
+    FILE* input = fopen(input_name, "rb");
+    if (!input) {
+        printf("Failed to open file %s.\n", input_name);
+        return EXIT_FAILURE;
+    }
+
+    FILE* output = fopen(output_name, "a");
+    if (!output) {
+        printf("Failed to open file %s.\n", output_name);
+        fclose(input);
+        return EXIT_FAILURE;
+    }
+
+    int error_code = 0;
+    BinaryLog_decode(input, output, &error_code);
+
+    fclose(input);
+    fclose(output);
+
+    if (error_code) {
+        printf("Log %s is damaged, only its beginning was decoded.\n", input_name);
+        return EXIT_FAILURE;
+    }
+
+    printf("Log %s was decoded into %s.\n", input_name, output_name);
+
+    return EXIT_SUCCESS;
+}
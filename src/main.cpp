@@ -23,8 +23,12 @@
 #include "utils/config.h"
 
 #include "lib/bin_tree.h"
+#include "lib/tree_journal.h"
+#include "lib/tree_saver.h"
+#include "lib/tree_dump.h"
 
 #include "utils/main_utils.h"
+#include "utils/game_server.h"
 
 #define MAIN
 
@@ -36,14 +40,65 @@ int main(const int argc, const char** argv) {
     unsigned int log_threshold = STATUS_REPORTS + 1;
     void* log_threshold_wrapper[] = { &log_threshold };
 
+    bool convert = false;
+    void* convert_wrapper[] = { &convert };
+
+    bool restructure_tree = false;
+    void* restructure_wrapper[] = { &restructure_tree };
+
+    bool compact = false;
+    void* compact_wrapper[] = { &compact };
+
+    bool batch = false;
+    void* batch_wrapper[] = { &batch };
+
+    int simulated_sessions = 0;
+    void* sessions_wrapper[] = { &simulated_sessions };
+
+    int simulation_threads = 1;
+    void* threads_wrapper[] = { &simulation_threads };
+
+    bool serve = false;
+    void* serve_wrapper[] = { &serve };
+
+    int checkpoint_period = 0;
+    void* checkpoint_period_wrapper[] = { &checkpoint_period };
+
+    int checkpoint_splits = 0;
+    void* checkpoint_splits_wrapper[] = { &checkpoint_splits };
+
+    int stats_top_count = 0;
+    void* stats_wrapper[] = { &stats_top_count };
+
+    int log_overflow = LOG_OVERFLOW_BLOCK;
+    void* log_overflow_wrapper[] = { &log_overflow };
+
+    bool binary_log = false;
+    void* binary_log_wrapper[] = { &binary_log };
+
+    int log_segment_size = 0;
+    void* log_segment_size_wrapper[] = { &log_segment_size };
+
+    int log_segment_count = LOG_SEGMENT_COUNT;
+    void* log_segment_count_wrapper[] = { &log_segment_count };
+
+    bool compress_log = false;
+    void* compress_log_wrapper[] = { &compress_log };
+
     ActionTag line_tags[] = {
         #include "cmd_flags/main_flags.h"
     };
     const int number_of_tags = sizeof(line_tags) / sizeof(*line_tags);
 
     parse_args(argc, argv, number_of_tags, line_tags);
-    log_init("program_log.html", log_threshold, &errno);
-    print_label();
+    if (binary_log) log_init(BINARY_LOG_NAME, log_threshold, LOG_FORMAT_BINARY, &errno);
+    else log_init("program_log.html", log_threshold, LOG_FORMAT_TEXT, &errno);
+    log_set_overflow((LogOverflowPolicy)clamp(log_overflow, LOG_OVERFLOW_BLOCK, LOG_OVERFLOW_COUNT));
+    if (log_segment_size > 0) {
+        size_t segment_count = log_segment_count > 0 ? (size_t)log_segment_count : 1;
+        log_set_rotation((size_t)log_segment_size * 1024, segment_count, compress_log, TREE_LOG_ASSET_FOLD_NAME, &errno);
+    }
+    if (!batch) print_label();
 
     const char* f_name = DEFAULT_DB_NAME;
     const char* suggested_name = get_input_file_name(argc, argv);
@@ -60,18 +115,125 @@ int main(const int argc, const char** argv) {
     }, &errno, ENOENT);
     track_allocation(source_db, fclose_void);
 
-    setvbuf(source_db, NULL, _IOFBF, get_file_size(fileno(source_db)));
-
     BinaryTree decision_tree = {};
 
-    BinaryTree_read(&decision_tree, source_db, &errno);
+    TreeFormat db_format = BinaryTree_get_format(source_db);
+
+    // Errors of loading are kept apart from errno, as unrelated earlier calls (like opening the log) may have set it.
+    int read_error = 0;
+    if (db_format == TREE_FORMAT_BINARY) BinaryTree_read_binary(&decision_tree, source_db, &read_error);
+    else BinaryTree_read(&decision_tree, source_db, &read_error);
 
     track_allocation(decision_tree, BinaryTree_dtor);
 
-    BinaryTree_dump(&decision_tree, STATUS_REPORTS);
+    TreeJournal journal = {};
+    int journal_error = 0;
+    TreeJournal_open(&journal, f_name, db_format, compact, &journal_error);
+    track_allocation(journal, TreeJournal_close);
+
+    // Journal that was not replayed refuses to be compacted or rolled back, so its words are never dropped.
+    if (!read_error && !journal_error) TreeJournal_replay(&journal, &decision_tree, &journal_error);
+    decision_tree.journal = &journal;
+
+    if (read_error) errno = read_error;
+    else if (journal_error) errno = journal_error;
+
+    if (convert) {
+        const char* out_name = get_output_file_name(argc, argv);
+        _LOG_FAIL_CHECK_(out_name, "error", ERROR_REPORTS, {
+            puts("Output file was not specified.");
+            return_clean(EXIT_FAILURE);
+        }, &errno, EINVAL);
+
+        TreeFormat out_format = db_format == TREE_FORMAT_BINARY ? TREE_FORMAT_TEXT : TREE_FORMAT_BINARY;
+
+        BinaryTree_save(&decision_tree, out_name, out_format, compact, &errno);
+
+        return_clean(errno == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    if (restructure_tree) {
+        const char* frequencies_name = get_output_file_name(argc, argv);
+
+        FILE* frequencies = frequencies_name ? fopen(frequencies_name, "r") : NULL;
+        _LOG_FAIL_CHECK_(frequencies || !frequencies_name, "error", ERROR_REPORTS, {
+            printf("Failed to open file %s.\n", frequencies_name);
+            return_clean(EXIT_FAILURE);
+        }, &errno, ENOENT);
+        track_allocation(frequencies, fclose_void);
+
+        if (frequencies) load_frequencies(&decision_tree, frequencies, &errno);
+
+        restructure(&decision_tree, stdout, &errno);
+
+        return_clean(errno == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    if (batch) {
+        const char* queries_name = get_output_file_name(argc, argv);
+
+        FILE* queries = queries_name ? fopen(queries_name, "r") : stdin;
+        _LOG_FAIL_CHECK_(queries, "error", ERROR_REPORTS, {
+            printf("Failed to open file %s.\n", queries_name);
+            return_clean(EXIT_FAILURE);
+        }, &errno, ENOENT);
+        track_allocation(queries, fclose_void);
+
+        run_batch(&decision_tree, queries, &errno);
+
+        if (stats_top_count > 0) print_stats(&decision_tree, stdout, (size_t)stats_top_count, &errno);
+
+        return_clean(errno == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    if (simulated_sessions > 0) {
+        // Simulated players should not teach the database anything, even if the program is killed midway.
+        decision_tree.journal = NULL;
+
+        run_simulation(&decision_tree, (size_t)simulated_sessions, (size_t)clamp(simulation_threads, 1, INT32_MAX), &errno);
+
+        if (stats_top_count > 0) print_stats(&decision_tree, stdout, (size_t)stats_top_count, &errno);
+
+        return_clean(errno == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    TreeDumpView startup_view = {};
+    startup_view.radius = STARTUP_DUMP_DEPTH;
+    BinaryTree_dump_view(&decision_tree, STATUS_REPORTS, &startup_view);
 
     _LOG_FAIL_CHECK_(!BinaryTree_status(&decision_tree), "error", ERROR_REPORTS, return_clean(EXIT_FAILURE), NULL, 0);
 
+    TreeSaver saver = {};
+    TreeSaver_start(&saver, &journal, &decision_tree, (unsigned int)clamp(checkpoint_period, 0, INT32_MAX),
+                    (uint64_t)clamp(checkpoint_splits, 0, INT32_MAX), &errno);
+    track_allocation(saver, TreeSaver_stop);
+
+    if (serve) {
+        const char* socket_name = get_output_file_name(argc, argv);
+
+        // Voice lines would be played on the server, not to the players.
+        speaker_set_mute(true);
+
+        run_server(&decision_tree, socket_name ? socket_name : DEFAULT_SOCKET_NAME, &errno);
+
+        TreeSaver_stop(&saver);
+
+        if (stats_top_count > 0) print_stats(&decision_tree, stdout, (size_t)stats_top_count, &errno);
+
+        _LOG_FAIL_CHECK_(!BinaryTree_status(&decision_tree), "error", ERROR_REPORTS, {
+            BinaryTree_dump(&decision_tree, ERROR_REPORTS);
+            return_clean(EXIT_FAILURE);
+        }, NULL, 0);
+
+        TreeJournal_compact(&journal, &decision_tree, &errno);
+
+        return_clean(errno == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    Player console = {};
+    console.in = stdin;
+    console.out = stdout;
+
     log_printf(STATUS_REPORTS, "status", "Entering main interaction loop.\n");
 
     say("Here we go.");
@@ -82,7 +244,7 @@ int main(const int argc, const char** argv) {
 
         say("What would you like me to do?");
 
-        printf("Command (Q - quit, G - guess, D - definition, C - compare, P - print the graph into logs)\n>>> ");
+        printf("Command (Q - quit, G - guess, D - definition, C - compare, P - print the graph into logs, V - verify the tree, H - statistics, R - restructure, J - compact the journal)\n>>> ");
         scanf(" %c", &command);
         while (getc(stdin) != '\n');
         command = (char)toupper(command);
@@ -90,7 +252,7 @@ int main(const int argc, const char** argv) {
         log_printf(STATUS_REPORTS, "status", "Encountered command %c.\n", command);
 
         if (command == 'Q') running = false;
-        else execute_command(command, &decision_tree);
+        else execute_command(command, &decision_tree, &console);
         
         _LOG_FAIL_CHECK_(!BinaryTree_status(&decision_tree), "error", ERROR_REPORTS, {
             BinaryTree_dump(&decision_tree, ERROR_REPORTS);
@@ -100,22 +262,20 @@ int main(const int argc, const char** argv) {
 
     log_printf(STATUS_REPORTS, "status", "Exiting main interaction loop.\n");
 
-    say("How sad. Anyway, do you want me to save what you have done to the database?");
-
-    printf("Save the graph to the same file if was read from?\n>>> ");
-    yn_branch({
-        log_printf(STATUS_REPORTS, "status", "Saving data to the file %s.\n", f_name);
-
-        FILE* file = fopen(f_name, "w");
+    TreeSaver_stop(&saver);
 
-        _LOG_FAIL_CHECK_(file, "error", ERROR_REPORTS, {
-            puts("Failed to open the file for writing.");
-            break;
-        }, &errno, ENOENT);
+    if (stats_top_count > 0) print_stats(&decision_tree, stdout, (size_t)stats_top_count, &errno);
 
-        BinaryTree_write_content(&decision_tree, file, &errno);
+    say("How sad. Anyway, do you want me to save what you have done to the database?");
 
-    }, {});
+    // Checkpoints (background ones and commands J and R) have already put the earlier words into the base file.
+    if (journal.compacted) printf("Words learned before the last save are already in the database. Save the rest of them too?\n>>> ");
+    else printf("Save the graph to the same file if was read from?\n>>> ");
+    yn_branch({
+        TreeJournal_compact(&journal, &decision_tree, &errno);
+    }, {
+        TreeJournal_rollback(&journal, &errno);
+    });
 
     return_clean(errno == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
 }
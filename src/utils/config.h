@@ -17,10 +17,27 @@
 const int NUMBER_OF_OWLS = 10;
 
 const size_t MAX_INPUT_LENGTH = 256;
-const size_t MAX_TREE_DEPTH = 128;
 const size_t MAX_ANSWER_LENGTH = 16;
 
+const size_t MIN_PHRASE_CAPACITY = 256;
+const size_t BATCH_BLOCK_SIZE = 1 << 16;
+const size_t BATCH_TASK_SIZE = 256;
+
+const size_t SIMULATION_NEW_WORD_PERCENT = 10;
+
+const size_t STATS_TOP_NODES = 10;
+
+const size_t STARTUP_DUMP_DEPTH = 8;
+
+const size_t SERVER_MAX_SESSIONS = 256;
+const int SERVER_BACKLOG = 64;
+#define DEFAULT_SOCKET_NAME "guesser.sock"
+
 const size_t MAX_NAME_LENGTH = 1024;
 #define DEFAULT_DB_NAME "empty.db"
 
+#define BINARY_LOG_NAME "program_log.bin"
+#define DECODED_LOG_NAME "program_log.html"
+const int LOG_SEGMENT_COUNT = 4;
+
 #endif
\ No newline at end of file
@@ -0,0 +1,283 @@
+#include "game_server.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "config.h"
+#include "main_utils.h"
+#include "lib/util/dbg/debug.h"
+
+/**
+ * @brief Connection of one player.
+ */
+struct Session {
+    pthread_t thread = {};
+    int socket = -1;
+    bool active = false;        // <- The slot is taken by the running or not yet joined thread.
+    bool finished = false;      // <- The thread is done and can be joined (accessed only through atomic builtins).
+    BinaryTree* tree = NULL;
+};
+
+/**
+ * @brief Set when the server is asked to stop.
+ */
+static volatile sig_atomic_t server_stopped = 0;
+
+/**
+ * @brief Ask the server to stop (SIGINT and SIGTERM handler).
+ * 
+ * @param signal_id unimportant
+ */
+static void stop_server(int signal_id);
+
+/**
+ * @brief Play with the player of the session until they quit or the connection is closed.
+ * 
+ * @param session_ptr Session* to serve
+ * @return NULL
+ */
+static void* serve_session(void* session_ptr);
+
+/**
+ * @brief Start the thread for the new connection in a free session slot.
+ * The connection is closed if there are no free slots.
+ * 
+ * @param sessions list of sessions
+ * @param socket connection
+ * @param tree tree to play on
+ */
+static void start_session(Session* sessions, int socket, BinaryTree* tree);
+
+/**
+ * @brief Join the thread of the session and close its connection.
+ * 
+ * @param session
+ */
+static void finish_session(Session* session);
+
+void run_server(BinaryTree* tree, const char* socket_path, int* const err_code) {
+    _LOG_FAIL_CHECK_(tree, "error", ERROR_REPORTS, return, err_code, EFAULT);
+    _LOG_FAIL_CHECK_(socket_path, "error", ERROR_REPORTS, return, err_code, EINVAL);
+
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+
+    _LOG_FAIL_CHECK_(strlen(socket_path) < sizeof(address.sun_path), "error", ERROR_REPORTS, {
+        log_printf(ERROR_REPORTS, "error", "Socket path %s is too long.\n", socket_path);
+        return;
+    }, err_code, ENAMETOOLONG);
+
+    strncpy(address.sun_path, socket_path, sizeof(address.sun_path) - 1);
+
+    int saved_errno = errno;
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    _LOG_FAIL_CHECK_(listener >= 0, "error", ERROR_REPORTS, return, err_code, errno);
+
+    // Socket file may be left by the server that was killed.
+    unlink(socket_path);
+    errno = saved_errno;
+
+    if (bind(listener, (const sockaddr*) &address, sizeof(address)) || listen(listener, SERVER_BACKLOG)) {
+        int listen_error = errno;
+        close(listener);
+
+        log_printf(ERROR_REPORTS, "error", "Failed to listen on %s.\n", socket_path);
+        if (err_code) *err_code = listen_error;
+        return;
+    }
+
+    Session* sessions = (Session*) calloc(SERVER_MAX_SESSIONS, sizeof(*sessions));
+    _LOG_FAIL_CHECK_(sessions, "error", ERROR_REPORTS, {
+        close(listener);
+        unlink(socket_path);
+        return;
+    }, err_code, ENOMEM);
+
+    // Handlers are set without SA_RESTART so that the signal interrupts accept().
+    struct sigaction stop_action = {};
+    stop_action.sa_handler = stop_server;
+    sigemptyset(&stop_action.sa_mask);
+
+    struct sigaction old_pipe = {};
+    sigaction(SIGINT, &stop_action, NULL);
+    sigaction(SIGTERM, &stop_action, NULL);
+
+    // Players that leave in the middle of the answer should not kill the server.
+    struct sigaction ignore_action = {};
+    ignore_action.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &ignore_action, &old_pipe);
+
+    server_stopped = 0;
+
+    int server_error = 0;
+
+    log_printf(STATUS_REPORTS, "status", "Serving players at %s.\n", socket_path);
+    printf("Serving players at %s, press Ctrl+C to stop.\n", socket_path);
+    fflush(stdout);
+
+    while (!server_stopped) {
+        int connection = accept(listener, NULL, NULL);
+
+        if (connection < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+
+            server_error = errno;
+            log_printf(ERROR_REPORTS, "error", "Failed to accept the connection, errno = %d.\n", server_error);
+            break;
+        }
+
+        for (size_t id = 0; id < SERVER_MAX_SESSIONS; ++id) {
+            if (sessions[id].active && __atomic_load_n(&sessions[id].finished, __ATOMIC_ACQUIRE)) {
+                finish_session(&sessions[id]);
+            }
+        }
+
+        start_session(sessions, connection, tree);
+    }
+
+    log_printf(STATUS_REPORTS, "status", "Stopping the server.\n");
+    // Saving the tree takes long, the log of the session should already be in the file if it is killed meanwhile.
+    log_flush();
+
+    // Players that are still connected get end of input and their threads finish.
+    for (size_t id = 0; id < SERVER_MAX_SESSIONS; ++id) {
+        if (sessions[id].active) shutdown(sessions[id].socket, SHUT_RDWR);
+    }
+
+    for (size_t id = 0; id < SERVER_MAX_SESSIONS; ++id) {
+        if (sessions[id].active) finish_session(&sessions[id]);
+    }
+
+    free(sessions);
+
+    close(listener);
+    unlink(socket_path);
+
+    // Stop signals stay caught, so that repeated Ctrl+C does not kill the caller while it saves the tree.
+    // Interrupting system calls is no longer needed.
+    stop_action.sa_flags = SA_RESTART;
+    sigaction(SIGINT, &stop_action, NULL);
+    sigaction(SIGTERM, &stop_action, NULL);
+    sigaction(SIGPIPE, &old_pipe, NULL);
+
+    // Interrupted accept() and shutdown() of closed connections are expected, they should not be reported as errors.
+    errno = saved_errno;
+    if (server_error && err_code) *err_code = server_error;
+}
+
+static void stop_server(int signal_id) {
+    SILENCE_UNUSED(signal_id);
+    server_stopped = 1;
+}
+
+static void start_session(Session* sessions, int socket, BinaryTree* tree) {
+    Session* session = NULL;
+
+    for (size_t id = 0; id < SERVER_MAX_SESSIONS && !session; ++id) {
+        if (!sessions[id].active) session = &sessions[id];
+    }
+
+    if (!session) {
+        log_printf(WARNINGS, "warning", "Connection was refused, all %lu sessions are taken.\n", (unsigned long) SERVER_MAX_SESSIONS);
+
+        static const char message[] = "Server is full, try again later.\n";
+        if (write(socket, message, sizeof(message) - 1) < 0) log_printf(WARNINGS, "warning", "Failed to refuse the connection.\n");
+
+        close(socket);
+        return;
+    }
+
+    session->socket = socket;
+    session->tree = tree;
+    session->finished = false;
+
+    // Only the accepting thread has to be interrupted by the stop signals.
+    sigset_t stop_signals = {}, old_mask = {};
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+
+    pthread_sigmask(SIG_BLOCK, &stop_signals, &old_mask);
+    int create_error = pthread_create(&session->thread, NULL, serve_session, session);
+    pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+
+    if (create_error) {
+        log_printf(ERROR_REPORTS, "error", "Failed to start the session thread, error %d.\n", create_error);
+        close(socket);
+        return;
+    }
+
+    session->active = true;
+
+    log_printf(STATUS_REPORTS, "status", "Session %ld was started.\n", session - sessions);
+}
+
+static void finish_session(Session* session) {
+    pthread_join(session->thread, NULL);
+
+    close(session->socket);
+
+    session->socket = -1;
+    session->active = false;
+}
+
+static void* serve_session(void* session_ptr) {
+    Session* session = (Session*) session_ptr;
+
+    // Streams work on copies of the socket, so that it stays valid for shutdown() until the session is joined.
+    int in_fd = dup(session->socket);
+    int out_fd = dup(session->socket);
+
+    Player player = {};
+    player.in = in_fd >= 0 ? fdopen(in_fd, "r") : NULL;
+    player.out = out_fd >= 0 ? fdopen(out_fd, "w") : NULL;
+
+    if (player.in && player.out) {
+        char line[MAX_INPUT_LENGTH] = "";
+
+        while (true) {
+            fputs("Command (Q - quit, G - guess, D - definition, C - compare, H - statistics)\n>>> ", player.out);
+
+            if (!read_line(&player, line, MAX_INPUT_LENGTH)) break;
+
+            const char* command_start = line;
+            while (isspace(*command_start)) ++command_start;
+
+            char command = (char)toupper(*command_start);
+            if (!command) continue;
+
+            log_printf(STATUS_REPORTS, "status", "Encountered command %c from a remote player.\n", command);
+
+            if (command == 'Q') break;
+
+            if (command == 'G' || command == 'D' || command == 'C' || command == 'H') {
+                int command_error = 0;
+                execute_command(command, session->tree, &player, &command_error);
+
+                if (command_error) log_printf(ERROR_REPORTS, "error", "Command %c failed with error %d.\n", command, command_error);
+            } else {
+                fputs("Incorrect command, enter command from the list.\n", player.out);
+            }
+        }
+    } else {
+        log_printf(ERROR_REPORTS, "error", "Failed to open streams of the connection.\n");
+    }
+
+    if (player.in) fclose(player.in);
+    else if (in_fd >= 0) close(in_fd);
+
+    if (player.out) fclose(player.out);
+    else if (out_fd >= 0) close(out_fd);
+
+    // The socket itself is closed when the session is joined, but the player should see the end of the game now.
+    shutdown(session->socket, SHUT_RDWR);
+
+    __atomic_store_n(&session->finished, true, __ATOMIC_RELEASE);
+
+    return NULL;
+}
@@ -0,0 +1,28 @@
+/**
+ * @file game_server.h
+ * @author Kudryashov Ilya (kudriashov.it@phystech.edu)
+ * @brief Server that lets many players use one tree at once.
+ * @version 0.1
+ * @date 2022-11-21
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#ifndef GAME_SERVER_H
+#define GAME_SERVER_H
+
+#include "lib/bin_tree.h"
+
+/**
+ * @brief Serve players connecting to the Unix domain socket until SIGINT or SIGTERM is received.
+ * Every connection is served by its own thread with G/D/C commands of the interactive mode.
+ * SIGINT and SIGTERM have no effect after the return, so the caller can save the tree without being interrupted.
+ * 
+ * @param tree tree to play on
+ * @param socket_path path to create the socket at (existing file is replaced)
+ * @param err_code variable to use as errno
+ */
+void run_server(BinaryTree* tree, const char* socket_path, int* const err_code = NULL);
+
+#endif
@@ -2,21 +2,229 @@
 
 #include <stdlib.h>
 #include <stdarg.h>
+#include <time.h>
 
 #include "lib/util/dbg/logger.h"
 #include "lib/util/dbg/debug.h"
 
 #include "lib/speaker.h"
+#include "lib/tree_journal.h"
+#include "lib/tree_stats.h"
+#include "lib/tree_restructure.h"
+#include "lib/tree_dump.h"
+#include "lib/flat_tree.h"
+#include "lib/util/parallel.h"
 
 /**
- * @brief Print one parameter of the object in the form of "is (not) an object(, )"
+ * @brief Question on the path from the root to the word with the answer that leads to the word.
+ */
+struct PathStep {
+    const char* question = NULL;
+    bool is_not = false;
+};
+
+/**
+ * @brief Print the steps of the path in the form of "is (not) an object, is (not) another object"
+ * 
+ * @param phrase phrase to append the steps to
+ * @param path
+ * @param from index of the first printed step
+ * @param to index after the last printed step
+ */
+static void print_steps(Phrase* phrase, const PathStep* path, size_t from, size_t to);
+
+/**
+ * @brief Collect the questions leading from the root to the node.
+ * 
+ * @param node
+ * @return PathStep* node->depth steps (free with free()), NULL on allocation failure
+ */
+static PathStep* node_path(const TreeNode* node);
+
+/**
+ * @brief Collect the questions leading from the root to the node of the flat tree.
+ * 
+ * @param flat
+ * @param node index of the node
+ * @param length variable to put the number of steps to
+ * @return PathStep* steps (free with free()), NULL on allocation failure
+ */
+static PathStep* flat_path(const FlatTree* flat, uint32_t node, size_t* length);
+
+/**
+ * @brief Append the definition made of the path to the phrase.
+ * 
+ * @param phrase
+ * @param path questions leading to the word
+ * @param length number of questions
+ */
+static void print_definition(Phrase* phrase, const PathStep* path, size_t length);
+
+/**
+ * @brief Append the comparison made of the paths to the phrase.
+ * 
+ * @param phrase
+ * @param word_a first word
+ * @param path_a questions leading to the first word
+ * @param length_a number of questions leading to the first word
+ * @param word_b second word
+ * @param path_b questions leading to the second word
+ * @param length_b number of questions leading to the second word
+ * @param prefix_length number of questions the paths share
+ */
+static void print_comparison(Phrase* phrase, const char* word_a, const PathStep* path_a, size_t length_a,
+                             const char* word_b, const PathStep* path_b, size_t length_b, size_t prefix_length);
+
+/**
+ * @brief Finish the game at the guessed leaf, learning the word if the guess was wrong.
+ * Has to be called inside of the read section, which is left while the oracle answers.
+ * 
+ * @param tree tree the game is played on
+ * @param oracle source of answers
+ * @param node guessed leaf
+ * @param err_code variable to use as errno
+ * @return GuessOutcome
+ */
+static GuessOutcome guess_outcome(BinaryTree* tree, const GuessOracle* oracle, TreeNode* node, int* const err_code);
+
+/**
+ * @brief Check that the node the game stopped at is still in the tree after the read section was left.
+ * 
+ * @param tree
+ * @param node node read in the previous read section
+ * @param version version of the node read in that section
+ * @param seen version of the tree at the start of that section, updated to the current one
+ * @return true if the game can go on from the node
+ */
+static bool node_is_current(const BinaryTree* tree, const TreeNode* node, uint64_t version, uint64_t* seen);
+
+/**
+ * @brief Oracle that asks the player and its input buffers.
+ */
+struct PlayerOracle {
+    Player* player = NULL;
+    char word[MAX_INPUT_LENGTH] = "";
+    char question[MAX_INPUT_LENGTH] = "";
+};
+
+/**
+ * @brief Ask the player the question of the node or whether the guess is right (see GuessOracle::confirm).
+ */
+static bool player_confirm(void* context, const char* value, bool is_guess);
+
+/**
+ * @brief Ask the player for the word that was meant (see GuessOracle::name).
+ */
+static const char* player_name(void* context, const char* guess);
+
+/**
+ * @brief Ask the player what distinguishes the word from the guessed one (see GuessOracle::distinguish).
+ */
+static const char* player_distinguish(void* context, const char* word, const char* guess);
+
+/**
+ * @brief Shared state of simulated guessing sessions.
+ */
+struct Simulation {
+    BinaryTree* tree = NULL;
+    const char** words = NULL;
+    size_t word_count = 0;
+
+    // Counters below are updated by several threads, only through atomic builtins.
+    size_t new_word_id = 0;
+    size_t played = 0;
+    size_t questions = 0;
+    size_t guessed = 0;
+    size_t learned = 0;
+    size_t conflicts = 0;
+    bool failed = false;
+};
+
+/**
+ * @brief Simulated player that thinks of the target word and answers according to its place in the tree.
+ * Players that think of a word unknown to the tree answer questions at random.
+ */
+struct SimulatedOracle {
+    const char* target = NULL;
+    const TreeNode* target_node = NULL;     // <- Leaf of the target at the start of the game (inner nodes do not change).
+    size_t depth = 0;                       // <- Depth of the node that is asked about.
+    uint64_t random_state = 0;
+    char word[MAX_INPUT_LENGTH] = "";
+    char question[MAX_INPUT_LENGTH] = "";
+};
+
+/**
+ * @brief Play one simulated session.
  * 
- * @param destination the string where to print the argument.
- * @param node argument to print
- * @param next_node nex node in definition path
- * @param is_last is the curent node the last one in the list
+ * @param index index of the session
+ * @param simulation_ptr Simulation* with the shared state
  */
-static size_t print_argument(char* destination, const TreeNode* node, const TreeNode* next_node, bool is_last);
+static void simulate_session(size_t index, void* simulation_ptr);
+
+/**
+ * @brief Answer as the simulated player (see GuessOracle::confirm).
+ */
+static bool simulated_confirm(void* context, const char* value, bool is_guess);
+
+/**
+ * @brief Name the target word (see GuessOracle::name).
+ */
+static const char* simulated_name(void* context, const char* guess);
+
+/**
+ * @brief Make up the criteria of the target word (see GuessOracle::distinguish).
+ */
+static const char* simulated_distinguish(void* context, const char* word, const char* guess);
+
+/**
+ * @brief Queries of the current batch block and their answers.
+ */
+struct BatchState {
+    const FlatTree* flat = NULL;
+    uint64_t* lookups = NULL;   // <- Lookups of the nodes of the flat tree, added to the tree after the batch.
+    char** lines = NULL;
+    size_t* line_capacities = NULL;     // <- Sizes of the line buffers, which are reused by the next blocks.
+    Phrase* answers = NULL;
+    size_t line_count = 0;
+};
+
+/**
+ * @brief Answer one task-sized group of queries of the batch block.
+ * 
+ * @param index index of the group
+ * @param batch_ptr BatchState* of the batch
+ */
+static void answer_queries(size_t index, void* batch_ptr);
+
+/**
+ * @brief Answer single batch query line.
+ * 
+ * @param batch batch the query belongs to
+ * @param query zero-terminated query line (modified in place)
+ * @param answer phrase to put the answer to
+ */
+static void answer_query(const BatchState* batch, char* query, Phrase* answer);
+
+/**
+ * @brief Append definition of the word to the phrase (see build_definition).
+ * 
+ * @param batch batch with the tree to search in
+ * @param word word to define
+ * @param phrase phrase to append the definition to
+ * @return PhraseStatus
+ */
+static PhraseStatus build_flat_definition(const BatchState* batch, const char* word, Phrase* phrase);
+
+/**
+ * @brief Append comparison of two words to the phrase (see build_comparison).
+ * 
+ * @param batch batch with the tree to search in
+ * @param word_a first word
+ * @param word_b second word
+ * @param phrase phrase to append the comparison to
+ * @return PhraseStatus
+ */
+static PhraseStatus build_flat_comparison(const BatchState* batch, const char* word_a, const char* word_b, Phrase* phrase);
 
 void MemorySegment_ctor(MemorySegment* segment) {
     segment->content = (int*) calloc(segment->size, sizeof(*segment->content));
@@ -93,260 +301,1013 @@ const char* get_output_file_name(const int argc, const char** argv) {
     return NULL;
 }
 
-void execute_command(char cmd, BinaryTree* tree, int* const err_code) {
+void execute_command(char cmd, BinaryTree* tree, Player* player, int* const err_code) {
+    _LOG_FAIL_CHECK_(player, "error", ERROR_REPORTS, return, err_code, EINVAL);
+
     switch(cmd) {
     case 'G': {
-        guess(tree, err_code);
+        guess(tree, player, err_code);
         break;
     }
     case 'D': {
         say("What do you need to know more about?");
 
-        printf("Which word do you want me to give definition of?\n>>> ");
+        fprintf(player->out, "Which word do you want me to give definition of?\n>>> ");
         char word[MAX_INPUT_LENGTH] = "";
-        fgets(word, MAX_INPUT_LENGTH - 1, stdin);
-        word[strlen(word) - 1] = '\0';
-        define(tree, word, err_code);
+        if (!read_line(player, word, MAX_INPUT_LENGTH)) break;
+        define(tree, word, player, err_code);
         break;
     }
     case 'P': {
+        say("Which part of me do you want to see?");
+
+        fprintf(player->out, "Which word should the picture show? (empty line for the whole tree)\n>>> ");
+        char word[MAX_INPUT_LENGTH] = "";
+        if (!read_line(player, word, MAX_INPUT_LENGTH)) break;
+
+        TreeDumpView view = {};
+
+        if (*word) {
+            view.focus = BinaryTree_find(tree, word);
+            if (!view.focus) {
+                fprintf(player->out, "Word was not found!\n");
+                break;
+            }
+
+            fprintf(player->out, "How many questions around it should I draw? (empty line for its path from the root)\n>>> ");
+            char radius[MAX_INPUT_LENGTH] = "";
+            if (!read_line(player, radius, MAX_INPUT_LENGTH)) break;
+
+            view.mode = *radius ? TREE_DUMP_NEIGHBORHOOD : TREE_DUMP_PATH;
+            view.radius = (size_t)strtoull(radius, NULL, 10);
+        }
+
         say("Trust me, I passed this task over to my friend.");
 
         log_printf(ABSOLUTE_IMPORTANCE, "dump_info", "Called dump on user request.\n");
-        BinaryTree_dump(tree, ABSOLUTE_IMPORTANCE);
+        BinaryTree_dump_view(tree, ABSOLUTE_IMPORTANCE, &view);
+        break;
+    }
+    case 'V': {
+        say("Let me take a closer look at myself.");
+
+        BinaryTree_status_t status = BinaryTree_full_status(tree);
+        log_printf(STATUS_REPORTS, "status", "Full tree check on user request returned status %d.\n", status);
+
+        if (status) BinaryTree_dump(tree, ERROR_REPORTS);
+        fprintf(player->out, status ? "Tree is broken (status = %d).\n" : "Tree is fine.\n", status);
+        break;
+    }
+    case 'H': {
+        say("Let me see what you people like.");
+
+        log_printf(STATUS_REPORTS, "status", "Statistics on user request.\n");
+
+        print_stats(tree, player->out, STATS_TOP_NODES, err_code);
+        break;
+    }
+    case 'R': {
+        say("Let me put my thoughts in order.");
+
+        log_printf(STATUS_REPORTS, "status", "Tree restructure on user request.\n");
+
+        restructure(tree, player->out, err_code);
+        break;
+    }
+    case 'J': {
+        say("Let me write all of this down.");
+
+        log_printf(STATUS_REPORTS, "status", "Journal compaction on user request.\n");
+
+        if (tree->journal) TreeJournal_compact(tree->journal, tree, err_code);
+        else fputs("There is no journal to compact.\n", player->out);
         break;
     }
     case 'C': {
         say("What is the first thingy you want me to compare?");
 
-        printf("What is the first thing to compare?\n>>> ");
+        fprintf(player->out, "What is the first thing to compare?\n>>> ");
 
         char word_a[MAX_INPUT_LENGTH] = "";
-        fgets(word_a, MAX_INPUT_LENGTH - 1, stdin);
-        word_a[strlen(word_a) - 1] = '\0';
+        if (!read_line(player, word_a, MAX_INPUT_LENGTH)) break;
 
         say("And what do you want to compare %s to?", word_a);
 
-        printf("What to compare %s to?\n>>> ", word_a);
+        fprintf(player->out, "What to compare %s to?\n>>> ", word_a);
 
         char word_b[MAX_INPUT_LENGTH] = "";
-        fgets(word_b, MAX_INPUT_LENGTH - 1, stdin);
-        word_b[strlen(word_b) - 1] = '\0';
+        if (!read_line(player, word_b, MAX_INPUT_LENGTH)) break;
 
-        compare(tree, word_a, word_b, err_code);
+        compare(tree, word_a, word_b, player, err_code);
         break;
     }
     default: {
         say("This task is too easy. Try something harder.");
 
-        printf("Incorrect command, enter command from the list.\n");
+        fprintf(player->out, "Incorrect command, enter command from the list.\n");
         break;
     }
     }
 }
 
-void guess(BinaryTree* tree, int* const err_code) {
-    _LOG_FAIL_CHECK_(!BinaryTree_status(tree), "error", ERROR_REPORTS, return, err_code, EFAULT);
+bool read_line(Player* player, char* buffer, size_t size) {
+    fflush(player->out);
 
-    log_printf(STATUS_REPORTS, "status", "Starting guessing...\n");
+    if (!fgets(buffer, (int)size, player->in)) return false;
 
-    TreeNode* node = tree->root;
+    buffer[strcspn(buffer, "\r\n")] = '\0';
+    return true;
+}
+
+bool ask_yes_no(Player* player) {
+    while (true) {
+        fflush(player->out);
+
+        int answer = EOF;
+        do answer = getc(player->in); while (answer != EOF && isspace(answer));
 
-    while (node->left && node->right) {
-        say("Is it %s?", node->value);
+        if (answer == EOF) return false;
 
-        printf("Is it %s? (yes/no)\n>>> ", node->value);
-        log_printf(STATUS_REPORTS, "status", "Made a suggestion of \"%s\".\n", node->value);
-        yn_branch({ node = node->left; }, { node = node->right; });
+        for (int skipped = answer; skipped != '\n' && skipped != EOF;) skipped = getc(player->in);
+
+        answer = tolower(answer);
+
+        if (answer == 'y') {
+            log_printf(STATUS_REPORTS, "status", "User answered with YES.\n");
+            return true;
+        }
+        if (answer == 'n') {
+            log_printf(STATUS_REPORTS, "status", "User answered with NO.\n");
+            return false;
+        }
+
+        fprintf(player->out, "yes/no expected, try again.\n>>> ");
     }
+}
 
-    log_printf(STATUS_REPORTS, "errno", "Suggested answer: \"%s\".\n",node->value);
+GuessOutcome play_guess(BinaryTree* tree, const GuessOracle* oracle, size_t* questions, int* const err_code) {
+    _LOG_FAIL_CHECK_(tree, "error", ERROR_REPORTS, return GUESS_FAILED, err_code, EFAULT);
+    _LOG_FAIL_CHECK_(oracle && oracle->confirm && oracle->name && oracle->distinguish,
+                     "error", ERROR_REPORTS, return GUESS_FAILED, err_code, EINVAL);
 
-    say("It has to be %s. Am I right?", node->value);
+    size_t asked = 0;
 
-    printf("It must be %s. Is it? (yes/no)\n>>> ", node->value);
-    yn_branch({
-        log_printf(STATUS_REPORTS, "errno", "Word \"%s\" was guessed correctly.\n",node->value);
-        puts("Yay!");
-        say("How boring.");
-    }, /* else */ {
-        char new_name[MAX_INPUT_LENGTH] = "";
+    // The tree is read without locking, but only between the answers: a player who does not answer
+    // must not keep retired nodes from being reused. After each answer the node is checked again.
+    // Only the split itself is serialized with other writers.
+    epoch_enter();
 
-        say("You must have been mistaking. Are you sure that you are right? "
-            "If so, enter what you thought was the correct answer below.");
+    uint64_t seen = __atomic_load_n(&tree->version, __ATOMIC_ACQUIRE);
+    TreeNode* node = BinaryTree_root(tree);
 
-        printf("What was the correct answer?\n>>> ");
+    while (TreeNode_child(node, false)) {
+        ++asked;
+        TreeNode_count(&node->visits);
 
-        fgets(new_name, MAX_INPUT_LENGTH, stdin);
+        // Values are never freed before the tree, unlike the nodes.
+        const char* question = node->value;
+        uint64_t version = node->version;
 
-        char* value_buffer = (char*) calloc(strnlen(new_name, MAX_INPUT_LENGTH) + 1, sizeof(*value_buffer));
-        _LOG_FAIL_CHECK_(value_buffer, "error", ERROR_REPORTS, return, err_code, ENOMEM);
-        memcpy(value_buffer, new_name, strnlen(new_name, MAX_INPUT_LENGTH) - 1);
+        epoch_exit();
+        bool is_yes = oracle->confirm(oracle->context, question, false);
+        epoch_enter();
 
-        log_printf(STATUS_REPORTS, "status", "Correct answer according to the user: \"%s\".\n", new_name);
+        if (!node_is_current(tree, node, version, &seen)) {
+            epoch_exit();
 
-        if (BinaryTree_find(tree, value_buffer)) {
-            log_printf(STATUS_REPORTS, "status", "New word \"%s\" was already defined. Insertion aborted.\n", value_buffer);
-            say("Nah, word %s has another meaning. You are wrong!", value_buffer);
-            printf("Word %s already exists.\n", value_buffer);
+            if (questions) *questions = asked;
+            return GUESS_CONFLICT;
         }
 
-        TreeNode* alpha_node = (TreeNode*) calloc(1, sizeof(*alpha_node));
-        TreeNode_ctor(alpha_node, value_buffer, true, node, false, err_code);
+        node = TreeNode_child(node, !is_yes);
+    }
+
+    TreeNode_count(&node->visits);
 
-        TreeNode* beta_node = (TreeNode*) calloc(1, sizeof(*beta_node));
-        TreeNode_ctor(beta_node, node->value, node->free_value, node, true, err_code);
+    if (questions) *questions = asked + 1;
 
-        say("What is the difference between %s and %s?", value_buffer, node->value);
+    GuessOutcome outcome = guess_outcome(tree, oracle, node, err_code);
 
-        printf("What is %s that %s is not?\nIt is ", value_buffer, node->value);
+    epoch_exit();
 
-        char new_question[MAX_INPUT_LENGTH] = "";
-        fgets(new_question, MAX_INPUT_LENGTH, stdin);
+    return outcome;
+}
+
+void guess(BinaryTree* tree, Player* player, int* const err_code) {
+    _LOG_FAIL_CHECK_(tree, "error", ERROR_REPORTS, return, err_code, EFAULT);
+    _LOG_FAIL_CHECK_(player, "error", ERROR_REPORTS, return, err_code, EINVAL);
+
+    log_printf(STATUS_REPORTS, "status", "Starting guessing...\n");
 
-        char* criteria = (char*) calloc(strnlen(new_question, MAX_INPUT_LENGTH) + 1, sizeof(*criteria));
-        _LOG_FAIL_CHECK_(criteria, "error", ERROR_REPORTS, return, err_code, ENOMEM);
-        memcpy(criteria, new_question, strnlen(new_question, MAX_INPUT_LENGTH) - 1);
+    PlayerOracle answers = {};
+    answers.player = player;
 
-        log_printf(STATUS_REPORTS, "status", "Suggested criteria of selection between \"%s\" (as YES) and \"%s\" (as NO) is \"%s\".\n",
-                value_buffer, node->value, criteria);
+    GuessOracle oracle = {};
+    oracle.confirm = player_confirm;
+    oracle.name = player_name;
+    oracle.distinguish = player_distinguish;
+    oracle.context = &answers;
 
-        node->value = criteria;
-        node->free_value = true;
-    });
+    switch (play_guess(tree, &oracle, NULL, err_code)) {
+    case GUESS_CORRECT: {
+        fputs("Yay!\n", player->out);
+        say("How boring.");
+        break;
+    }
+    case GUESS_DUPLICATE: {
+        log_printf(STATUS_REPORTS, "status", "New word \"%s\" was already defined. Insertion aborted.\n", answers.word);
+        say("Nah, word %s has another meaning. You are wrong!", answers.word);
+        fprintf(player->out, "Word %s already exists.\n", answers.word);
+        break;
+    }
+    case GUESS_CONFLICT: {
+        log_printf(STATUS_REPORTS, "status", "Word \"%s\" was not learned, the leaf was changed by another player.\n", answers.word);
+        fprintf(player->out, "Someone has just taught me something new about it. Let's play again.\n");
+        break;
+    }
+    case GUESS_LEARNED: {
+        log_printf(STATUS_REPORTS, "status", "Word \"%s\" was learned.\n", answers.word);
+        break;
+    }
+    case GUESS_GAVE_UP:
+    case GUESS_FAILED:
+    default: break;
+    }
 }
 
-void define(BinaryTree* tree, const char* word, int* const err_code) {
+void run_simulation(BinaryTree* tree, size_t sessions, size_t threads, int* const err_code) {
     _LOG_FAIL_CHECK_(!BinaryTree_status(tree), "error", ERROR_REPORTS, return, err_code, EFAULT);
-    _LOG_FAIL_CHECK_(word, "error", ERROR_REPORTS, return, err_code, EFAULT);
 
-    log_printf(STATUS_REPORTS, "status", "Asked for the definition of the word %s.\n", word);
+    Simulation simulation = {};
+    simulation.tree = tree;
 
-    const TreeNode* node = BinaryTree_find(tree, word, err_code);
+    foreach_leaf(leaf, tree->root) ++simulation.word_count;
 
-    if (!node) {
+    simulation.words = (const char**) calloc(simulation.word_count, sizeof(*simulation.words));
+    _LOG_FAIL_CHECK_(simulation.words, "error", ERROR_REPORTS, return, err_code, ENOMEM);
 
-        log_printf(STATUS_REPORTS, "errno", "Word \"%s\" was not found.\n", word);
-        say("You must have made a mistake spelling this word. It does not exist.");
-        printf("Word was not found!\n");
+    size_t word_id = 0;
+    foreach_leaf(leaf, tree->root) simulation.words[word_id++] = leaf->value;
 
-    } else if (node == tree->root) {
+    log_printf(STATUS_REPORTS, "status", "Starting %lld simulated sessions on %lld threads.\n",
+               (long long)sessions, (long long)threads);
 
-        log_printf(STATUS_REPORTS, "errno", "Word \"%s\" was the only word in the tree.\n", word);
-        say("It is the only word humanity knows about at this point in time.");
-        printf("It is the only known word...\n");
+    struct timespec start = {}, end = {};
+    clock_gettime(CLOCK_MONOTONIC, &start);
 
-    } else {
+    parallel_for(sessions, simulate_session, &simulation, threads);
 
-        char phrase[MAX_PHRASE_LENGTH] = "";
-        char* phrase_typer = phrase;
+    clock_gettime(CLOCK_MONOTONIC, &end);
 
-        phrase_typer += sprintf(phrase_typer, "It ");
+    double seconds = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+    size_t played = simulation.played;
 
-        const TreeNode* chain[MAX_TREE_DEPTH] = {};
-        size_t depth = 0;
+    printf("Played %lld sessions in %.3f s (%.0f sessions/s).\n",
+           (long long)played, seconds, seconds > 0 ? (double)played / seconds : 0.0);
+    printf("Average number of questions per session: %.2f.\n",
+           played ? (double)simulation.questions / (double)played : 0.0);
+    printf("Words guessed: %lld, learned: %lld, lost to concurrent insertions: %lld.\n",
+           (long long)simulation.guessed, (long long)simulation.learned, (long long)simulation.conflicts);
 
-        BinaryTree_fill_path(node, chain, &depth, MAX_TREE_DEPTH, err_code);
+    free(simulation.words);
 
-        --depth; // <- Account for the answer node at the end of each path.
+    _LOG_FAIL_CHECK_(!simulation.failed, "error", ERROR_REPORTS, {}, err_code, EFAULT);
+    _LOG_FAIL_CHECK_(!BinaryTree_full_status(tree), "error", ERROR_REPORTS, {}, err_code, EFAULT);
+}
 
-        for (size_t index = 0; index < depth; ++index) {
-            phrase_typer += print_argument(phrase_typer, chain[index], chain[index + 1], index == depth - 1);
-        }
+void define(BinaryTree* tree, const char* word, Player* player, int* const err_code) {
+    _LOG_FAIL_CHECK_(tree, "error", ERROR_REPORTS, return, err_code, EFAULT);
+    _LOG_FAIL_CHECK_(word, "error", ERROR_REPORTS, return, err_code, EFAULT);
+    _LOG_FAIL_CHECK_(player, "error", ERROR_REPORTS, return, err_code, EINVAL);
 
-        phrase_typer += sprintf(phrase_typer, ".\n");
+    log_printf(STATUS_REPORTS, "status", "Asked for the definition of the word %s.\n", word);
+
+    Phrase phrase = {};
 
-        log_printf(STATUS_REPORTS, "status", "Assembled definition - \"%s\".\n", phrase);
+    TreeSnapshot snapshot = {};
+    BinaryTree_snapshot(tree, &snapshot);
+    PhraseStatus status = build_definition(&snapshot, word, &phrase);
+    TreeSnapshot_release(&snapshot);
 
-        printf("%s", phrase);
-        say("%s", phrase);
+    switch (status) {
+    case PHRASE_UNKNOWN_WORD: {
+        log_printf(STATUS_REPORTS, "errno", "Word \"%s\" was not found.\n", word);
+        say("You must have made a mistake spelling this word. It does not exist.");
+        fprintf(player->out, "Word was not found!\n");
+        break;
     }
+    case PHRASE_ONLY_WORD: {
+        log_printf(STATUS_REPORTS, "errno", "Word \"%s\" was the only word in the tree.\n", word);
+        say("It is the only word humanity knows about at this point in time.");
+        fprintf(player->out, "It is the only known word...\n");
+        break;
+    }
+    case PHRASE_OK: {
+        _LOG_FAIL_CHECK_(!phrase.failed, "error", ERROR_REPORTS, {}, err_code, ENOMEM);
+        if (phrase.failed) break;
+
+        log_printf(STATUS_REPORTS, "status", "Assembled definition - \"%s\".\n", phrase.text);
+
+        fputs(phrase.text, player->out);
+        say("%s", phrase.text);
+        break;
+    }
+    case PHRASE_SAME_WORD:
+    default: break;
+    }
+
+    Phrase_dtor(&phrase);
 }
 
-void compare(BinaryTree* tree, const char* word_a, const char* word_b, int* const err_code) {
-    _LOG_FAIL_CHECK_(!BinaryTree_status(tree),   "error", ERROR_REPORTS, return, err_code, EFAULT);
+void compare(BinaryTree* tree, const char* word_a, const char* word_b, Player* player, int* const err_code) {
+    _LOG_FAIL_CHECK_(tree,   "error", ERROR_REPORTS, return, err_code, EFAULT);
     _LOG_FAIL_CHECK_(word_a, "error", ERROR_REPORTS, return, err_code, EFAULT);
     _LOG_FAIL_CHECK_(word_b, "error", ERROR_REPORTS, return, err_code, EFAULT);
+    _LOG_FAIL_CHECK_(player, "error", ERROR_REPORTS, return, err_code, EINVAL);
 
     log_printf(STATUS_REPORTS, "status", "Asked for the comparison of words \"%s\", \"%s\".\n", word_a, word_b);
 
-    const TreeNode* node_a = BinaryTree_find(tree, word_a, err_code);
-    const TreeNode* node_b = BinaryTree_find(tree, word_b, err_code);
+    Phrase phrase = {};
 
-    if (node_a == NULL || node_b == NULL) {
+    TreeSnapshot snapshot = {};
+    BinaryTree_snapshot(tree, &snapshot);
+    PhraseStatus status = build_comparison(&snapshot, word_a, word_b, &phrase);
+    TreeSnapshot_release(&snapshot);
 
+    switch (status) {
+    case PHRASE_UNKNOWN_WORD: {
         log_printf(STATUS_REPORTS, "errno", "One of the words was not found.\n");
         say("One of the words is unknown to mankind. You must have made a mistake.");
-        puts("One of the words was not found.");
+        fputs("One of the words was not found.\n", player->out);
+        break;
+    }
+    case PHRASE_SAME_WORD: {
+        log_printf(STATUS_REPORTS, "errno", "They were the same word.\n");
+        say("They are the same object. Or at least the title says so.");
+        fputs("They are the same objects...\n", player->out);
+        break;
+    }
+    case PHRASE_OK: {
+        _LOG_FAIL_CHECK_(!phrase.failed, "error", ERROR_REPORTS, {}, err_code, ENOMEM);
+        if (phrase.failed) break;
+
+        log_printf(STATUS_REPORTS, "status", "Assembled phrase - \"%s\".\n", phrase.text);
+
+        fputs(phrase.text, player->out);
+        say("%s", phrase.text);
+        break;
+    }
+    case PHRASE_ONLY_WORD:
+    default: break;
+    }
+
+    Phrase_dtor(&phrase);
+}
+
+void print_stats(const BinaryTree* tree, FILE* out, size_t top_count, int* const err_code) {
+    _LOG_FAIL_CHECK_(tree, "error", ERROR_REPORTS, return, err_code, EFAULT);
+    _LOG_FAIL_CHECK_(out,  "error", ERROR_REPORTS, return, err_code, EINVAL);
+
+    TreeSnapshot snapshot = {};
+    BinaryTree_snapshot(tree, &snapshot);
 
+    TreeStats stats = {};
+    TreeStats_collect(&stats, &snapshot, top_count, err_code);
+
+    TreeSnapshot_release(&snapshot);
+
+    TreeStats_print(&stats, out);
+    TreeStats_dtor(&stats);
+}
+
+void load_frequencies(BinaryTree* tree, FILE* frequencies, int* const err_code) {
+    _LOG_FAIL_CHECK_(tree && tree->root, "error", ERROR_REPORTS, return, err_code, EFAULT);
+    _LOG_FAIL_CHECK_(frequencies, "error", ERROR_REPORTS, return, err_code, EINVAL);
+
+    foreach_node(node, tree->root) {
+        node->visits = 0;
+        node->lookups = 0;
+    }
+
+    size_t known = 0;
+    size_t unknown = 0;
+
+    char line[MAX_INPUT_LENGTH] = "";
+    while (fgets(line, (int)MAX_INPUT_LENGTH, frequencies)) {
+        line[strcspn(line, "\r\n")] = '\0';
+
+        unsigned long long count = 0;
+        int word_start = 0;
+        if (sscanf(line, "%llu %n", &count, &word_start) < 1 || !line[word_start]) continue;
+
+        TreeNode* leaf = BinaryTree_find(tree, line + word_start);
+        if (!leaf) {
+            ++unknown;
+            continue;
+        }
+
+        leaf->visits = count;
+        ++known;
+    }
+
+    log_printf(STATUS_REPORTS, "status", "Loaded frequencies of %lld words, %lld words were not found.\n",
+               (long long)known, (long long)unknown);
+}
+
+void restructure(BinaryTree* tree, FILE* out, int* const err_code) {
+    _LOG_FAIL_CHECK_(out, "error", ERROR_REPORTS, return, err_code, EINVAL);
+
+    RestructureReport report = {};
+    BinaryTree_restructure(tree, &report, err_code);
+    if (!report.leaf_count) return;
+
+    if (report.ambiguous) {
+        fprintf(out, "Some words have the same answers to all of their questions, the tree was kept "
+                     "(%.2f questions per game).\n", report.questions_before);
         return;
+    }
 
+    // Only questions that all words below them know are asked, so the rebuilt tree is often not better.
+    if (!report.rebuilt) {
+        fprintf(out, "The rebuilt tree would take %.2f questions per game instead of %.2f, the tree was kept.\n",
+                report.questions_after, report.questions_before);
+        return;
     }
 
-    if (node_a == node_b) {
+    fprintf(out, "Expected number of questions per game: %.2f -> %.2f (%lld words).\n",
+            report.questions_before, report.questions_after, (long long)report.leaf_count);
 
-        log_printf(STATUS_REPORTS, "errno", "They were the same word.\n");
-        say("They are the same object. Or at least the title says so.");
-        puts("They are the same objects...");
+    // Paths in the journal do not lead anywhere in the new tree.
+    if (tree->journal) TreeJournal_compact(tree->journal, tree, err_code);
+}
+
+PhraseStatus build_definition(const TreeSnapshot* snapshot, const char* word, Phrase* phrase) {
+    const TreeNode* node = TreeSnapshot_find(snapshot, word);
 
+    if (!node) return PHRASE_UNKNOWN_WORD;
+
+    TreeNode_count(&node->lookups);
+
+    if (!node->parent) return PHRASE_ONLY_WORD;
+
+    PathStep* path = node_path(node);
+    if (!path) {
+        phrase->failed = true;
+        return PHRASE_OK;
+    }
+
+    print_definition(phrase, path, node->depth);
+
+    free(path);
+
+    return PHRASE_OK;
+}
+
+PhraseStatus build_comparison(const TreeSnapshot* snapshot, const char* word_a, const char* word_b, Phrase* phrase) {
+    const TreeNode* node_a = TreeSnapshot_find(snapshot, word_a);
+    const TreeNode* node_b = TreeSnapshot_find(snapshot, word_b);
+
+    if (node_a == NULL || node_b == NULL) return PHRASE_UNKNOWN_WORD;
+
+    TreeNode_count(&node_a->lookups);
+    if (node_b != node_a) TreeNode_count(&node_b->lookups);
+
+    if (node_a == node_b) return PHRASE_SAME_WORD;
+
+    // Criteria shared by both objects are the ones on the path from the root to their common ancestor.
+    const TreeNode* ancestor = TreeNode_common_ancestor(node_a, node_b);
+    if (!ancestor) return PHRASE_UNKNOWN_WORD;
+
+    PathStep* path_a = node_path(node_a);
+    PathStep* path_b = node_path(node_b);
+    if (!path_a || !path_b) {
+        free(path_a);
+        free(path_b);
+        phrase->failed = true;
+        return PHRASE_OK;
+    }
+
+    print_comparison(phrase, word_a, path_a, node_a->depth, word_b, path_b, node_b->depth, ancestor->depth);
+
+    free(path_a);
+    free(path_b);
+
+    return PHRASE_OK;
+}
+
+void Phrase_printf(Phrase* phrase, const char* format, ...) {
+    if (phrase->failed) return;
+
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(phrase->text ? phrase->text + phrase->length : NULL, phrase->capacity - phrase->length, format, args);
+    va_end(args);
+
+    if (length < 0) {
+        phrase->failed = true;
         return;
+    }
+
+    if (phrase->length + (size_t)length >= phrase->capacity) {
+        size_t new_capacity = phrase->capacity ? phrase->capacity : MIN_PHRASE_CAPACITY;
+        while (new_capacity <= phrase->length + (size_t)length) new_capacity *= 2;
 
+        char* new_text = (char*) realloc(phrase->text, new_capacity);
+        if (!new_text) {
+            phrase->failed = true;
+            return;
+        }
+
+        phrase->text = new_text;
+        phrase->capacity = new_capacity;
+
+        va_start(args, format);
+        vsnprintf(phrase->text + phrase->length, phrase->capacity - phrase->length, format, args);
+        va_end(args);
     }
 
-    // TODO: Can anyone see what is the problem here?
-    // TODO: Can anyone see what is the problem here?
-    const TreeNode* path_a[MAX_TREE_DEPTH] = {};
-    const TreeNode* path_b[MAX_TREE_DEPTH] = {};
-    size_t depth_a = 0;
-    size_t depth_b = 0;
-    BinaryTree_fill_path(node_a, path_a, &depth_a, MAX_TREE_DEPTH, err_code);
-    BinaryTree_fill_path(node_b, path_b, &depth_b, MAX_TREE_DEPTH, err_code);
+    phrase->length += (size_t)length;
+}
 
-    size_t prefix_length = 0;
+void Phrase_dtor(Phrase* phrase) {
+    free(phrase->text);
+    *phrase = {};
+}
 
-    for (size_t index = 1; index < depth_a && index < depth_b; ++index) {
-        if (path_a[index] == path_b[index]) continue;
-        prefix_length = index - 1;
-        break;
+void run_batch(const BinaryTree* tree, FILE* queries, int* const err_code) {
+    _LOG_FAIL_CHECK_(!BinaryTree_status(tree), "error", ERROR_REPORTS, return, err_code, EFAULT);
+    _LOG_FAIL_CHECK_(queries, "error", ERROR_REPORTS, return, err_code, EINVAL);
+
+    BatchState batch = {};
+
+    batch.answers = (Phrase*) calloc(BATCH_BLOCK_SIZE, sizeof(*batch.answers));
+    batch.lines = (char**) calloc(BATCH_BLOCK_SIZE, sizeof(*batch.lines));
+    batch.line_capacities = (size_t*) calloc(BATCH_BLOCK_SIZE, sizeof(*batch.line_capacities));
+    _LOG_FAIL_CHECK_(batch.answers && batch.lines && batch.line_capacities, "error", ERROR_REPORTS, {
+        free(batch.answers);
+        free(batch.lines);
+        free(batch.line_capacities);
+        return;
+    }, err_code, ENOMEM);
+
+    WriteBuffer out = {};
+    WriteBuffer_ctor(&out, fileno(stdout), 0, err_code);
+
+    // Whole batch is answered against one version, copied into the flat storage that is cheaper to walk.
+    TreeSnapshot snapshot = {};
+    BinaryTree_snapshot(tree, &snapshot);
+
+    FlatTree flat = {};
+    FlatTree_ctor(&flat, TreeSnapshot_root(&snapshot), FLAT_LAYOUT_VEB, snapshot.version, err_code);
+    if (flat.size) FlatTree_index_words(&flat, err_code);
+
+    uint64_t* lookups = (uint64_t*) calloc(flat.size ? flat.size : 1, sizeof(*lookups));
+
+    _LOG_FAIL_CHECK_(flat.word_capacity && lookups, "error", ERROR_REPORTS, {
+        free(lookups);
+        FlatTree_dtor(&flat);
+        TreeSnapshot_release(&snapshot);
+        WriteBuffer_dtor(&out);
+        free(batch.answers);
+        free(batch.lines);
+        free(batch.line_capacities);
+        return;
+    }, err_code, ENOMEM);
+
+    batch.flat = &flat;
+    batch.lookups = lookups;
+
+    size_t query_count = 0;
+
+    // Queries are read and answered in blocks: lines of the block are processed in parallel, then printed in order
+    // before the next block is read, so answers to a stream come out without waiting for its end.
+    while (true) {
+        batch.line_count = 0;
+
+        while (batch.line_count < BATCH_BLOCK_SIZE) {
+            size_t id = batch.line_count;
+
+            ssize_t length = getline(&batch.lines[id], &batch.line_capacities[id], queries);
+            if (length < 0) break;
+
+            if (length > 0 && batch.lines[id][length - 1] == '\n') batch.lines[id][length - 1] = '\0';
+            ++batch.line_count;
+        }
+
+        if (!batch.line_count) break;
+
+        parallel_for((batch.line_count + BATCH_TASK_SIZE - 1) / BATCH_TASK_SIZE, answer_queries, &batch);
+
+        for (size_t id = 0; id < batch.line_count; ++id) {
+            if (batch.answers[id].length) WriteBuffer_put(&out, batch.answers[id].text, batch.answers[id].length);
+            batch.answers[id].length = 0;
+        }
+
+        WriteBuffer_flush(&out);
+
+        query_count += batch.line_count;
+    }
+
+    _LOG_FAIL_CHECK_(!ferror(queries), "error", ERROR_REPORTS, {}, err_code, EIO);
+
+    // Lookups are kept in the nodes of the tree for the statistics.
+    for (uint32_t node = 0; node < flat.size; ++node) {
+        if (!lookups[node]) continue;
+
+        TreeNode* leaf = BinaryTree_find(tree, flat.value[node]);
+        if (leaf) __atomic_fetch_add(&leaf->lookups, lookups[node], __ATOMIC_RELAXED);
+    }
+
+    free(lookups);
+    FlatTree_dtor(&flat);
+    TreeSnapshot_release(&snapshot);
+
+    log_printf(STATUS_REPORTS, "status", "Answered %lld batch queries.\n", (long long)query_count);
+
+    WriteBuffer_dtor(&out);
+    _LOG_FAIL_CHECK_(!out.failed, "error", ERROR_REPORTS, {}, err_code, EIO);
+
+    for (size_t id = 0; id < BATCH_BLOCK_SIZE; ++id) {
+        Phrase_dtor(&batch.answers[id]);
+        free(batch.lines[id]);
+    }
+
+    free(batch.answers);
+    free(batch.lines);
+    free(batch.line_capacities);
+}
+
+static void print_steps(Phrase* phrase, const PathStep* path, size_t from, size_t to) {
+    for (size_t index = from; index < to; ++index) {
+        Phrase_printf(phrase, "is%s %s%s", path[index].is_not ? " not" : "", path[index].question,
+                      index == to - 1 ? "" : ", ");
+    }
+}
+
+static PathStep* node_path(const TreeNode* node) {
+    PathStep* path = (PathStep*) calloc(node->depth ? node->depth : 1, sizeof(*path));
+    if (!path) return NULL;
+
+    size_t index = node->depth;
+    for (const TreeNode* current = node; current->parent && index; current = current->parent) {
+        path[--index] = { current->parent->value, current->is_right };
+    }
+
+    return path;
+}
+
+static PathStep* flat_path(const FlatTree* flat, uint32_t node, size_t* length) {
+    size_t depth = 0;
+    for (uint32_t current = node; flat->parent[current] != FLAT_TREE_NO_NODE; current = flat->parent[current]) ++depth;
+
+    PathStep* path = (PathStep*) calloc(depth ? depth : 1, sizeof(*path));
+    if (!path) return NULL;
+
+    *length = depth;
+
+    for (uint32_t current = node; flat->parent[current] != FLAT_TREE_NO_NODE; current = flat->parent[current]) {
+        uint32_t parent = flat->parent[current];
+        path[--depth] = { flat->value[parent], flat->right[parent] == current };
     }
 
-    log_printf(STATUS_REPORTS, "errno", "Found %lld criteria matches.\n", (long long)prefix_length);
+    return path;
+}
+
+static void print_definition(Phrase* phrase, const PathStep* path, size_t length) {
+    Phrase_printf(phrase, "It ");
+    print_steps(phrase, path, 0, length);
+    Phrase_printf(phrase, ".\n");
+}
 
-    char phrase[MAX_PHRASE_LENGTH] = "";
-    char* phrase_typer = phrase;
-    
+static void print_comparison(Phrase* phrase, const char* word_a, const PathStep* path_a, size_t length_a,
+                             const char* word_b, const PathStep* path_b, size_t length_b, size_t prefix_length) {
     if (prefix_length == 0) {
-        phrase_typer += sprintf(phrase_typer, "These objects have nothing in common, as\n");
+        Phrase_printf(phrase, "These objects have nothing in common, as\n");
+    } else {
+        Phrase_printf(phrase, "These objects are similar to each other as they both can be described as \'");
+        print_steps(phrase, path_a, 0, prefix_length);
+        Phrase_printf(phrase, "\', while\n");
+    }
+
+    Phrase_printf(phrase, "object %s ", word_a);
+    print_steps(phrase, path_a, prefix_length, length_a);
+
+    Phrase_printf(phrase, ", and\nobject %s ", word_b);
+    print_steps(phrase, path_b, prefix_length, length_b);
+    Phrase_printf(phrase, ".\n");
+}
+
+static bool player_confirm(void* context, const char* value, bool is_guess) {
+    Player* player = ((PlayerOracle*) context)->player;
+
+    if (is_guess) {
+        log_printf(STATUS_REPORTS, "errno", "Suggested answer: \"%s\".\n", value);
+
+        say("It has to be %s. Am I right?", value);
+        fprintf(player->out, "It must be %s. Is it? (yes/no)\n>>> ", value);
+    } else {
+        say("Is it %s?", value);
+
+        fprintf(player->out, "Is it %s? (yes/no)\n>>> ", value);
+        log_printf(STATUS_REPORTS, "status", "Made a suggestion of \"%s\".\n", value);
+    }
+
+    bool answer = ask_yes_no(player);
+
+    if (is_guess && answer) log_printf(STATUS_REPORTS, "errno", "Word \"%s\" was guessed correctly.\n", value);
+
+    return answer;
+}
+
+static const char* player_name(void* context, const char* guess) {
+    SILENCE_UNUSED(guess);
+
+    PlayerOracle* answers = (PlayerOracle*) context;
+
+    say("You must have been mistaking. Are you sure that you are right? "
+        "If so, enter what you thought was the correct answer below.");
+
+    fprintf(answers->player->out, "What was the correct answer?\n>>> ");
+
+    if (!read_line(answers->player, answers->word, MAX_INPUT_LENGTH)) return NULL;
+
+    log_printf(STATUS_REPORTS, "status", "Correct answer according to the user: \"%s\".\n", answers->word);
+
+    return answers->word;
+}
+
+static const char* player_distinguish(void* context, const char* word, const char* guess) {
+    PlayerOracle* answers = (PlayerOracle*) context;
+
+    say("What is the difference between %s and %s?", word, guess);
+
+    fprintf(answers->player->out, "What is %s that %s is not?\nIt is ", word, guess);
+
+    if (!read_line(answers->player, answers->question, MAX_INPUT_LENGTH)) return NULL;
+
+    log_printf(STATUS_REPORTS, "status", "Suggested criteria of selection between \"%s\" (as YES) and \"%s\" (as NO) is \"%s\".\n",
+            word, guess, answers->question);
+
+    return answers->question;
+}
+
+static void simulate_session(size_t index, void* simulation_ptr) {
+    Simulation* simulation = (Simulation*) simulation_ptr;
+
+    SimulatedOracle player = {};
+    player.random_state = index * 0x9E3779B97F4A7C15ull + 1;
+
+    if (simulation->word_count && index % 100 >= SIMULATION_NEW_WORD_PERCENT) {
+        player.target = simulation->words[player.random_state % simulation->word_count];
     } else {
-        phrase_typer += sprintf(phrase_typer, "These objects are similar to each other as they both can be described as \'");
-        for (size_t index = 0; index < prefix_length; ++index) {
-            phrase_typer += print_argument(phrase_typer, path_a[index], path_a[index + 1], index == prefix_length - 1);
+        snprintf(player.word, MAX_INPUT_LENGTH, "simulated word %lld",
+                 (long long)__atomic_fetch_add(&simulation->new_word_id, 1, __ATOMIC_RELAXED));
+        player.target = player.word;
+    }
+
+    epoch_enter();
+
+    player.target_node = WordIndex_find(&simulation->tree->index, player.target);
+
+    GuessOracle oracle = {};
+    oracle.confirm = simulated_confirm;
+    oracle.name = simulated_name;
+    oracle.distinguish = simulated_distinguish;
+    oracle.context = &player;
+
+    size_t questions = 0;
+    int err_code = 0;
+
+    switch (play_guess(simulation->tree, &oracle, &questions, &err_code)) {
+        case GUESS_CORRECT:  __atomic_add_fetch(&simulation->guessed,   1, __ATOMIC_RELAXED); break;
+        case GUESS_LEARNED:  __atomic_add_fetch(&simulation->learned,   1, __ATOMIC_RELAXED); break;
+        case GUESS_CONFLICT: __atomic_add_fetch(&simulation->conflicts, 1, __ATOMIC_RELAXED); break;
+        case GUESS_FAILED:   __atomic_store_n(&simulation->failed, true, __ATOMIC_RELAXED);   break;
+        case GUESS_DUPLICATE:
+        case GUESS_GAVE_UP:
+        default: break;
+    }
+
+    epoch_exit();
+
+    __atomic_add_fetch(&simulation->played, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&simulation->questions, questions, __ATOMIC_RELAXED);
+}
+
+static bool simulated_confirm(void* context, const char* value, bool is_guess) {
+    SimulatedOracle* player = (SimulatedOracle*) context;
+
+    if (is_guess) return !strcmp(value, player->target);
+
+    // Player that knows the word follows its path, the one that does not answers at random (xorshift).
+    // If the leaf of the word was split during the game, the word went to the NO branch.
+    if (player->target_node) {
+        size_t depth = player->depth++;
+        if (depth >= player->target_node->depth) return false;
+
+        return !TreeNode_ancestor(player->target_node, depth + 1)->is_right;
+    }
+
+    player->random_state ^= player->random_state << 13;
+    player->random_state ^= player->random_state >> 7;
+    player->random_state ^= player->random_state << 17;
+
+    return player->random_state & 1;
+}
+
+static const char* simulated_name(void* context, const char* guess) {
+    SILENCE_UNUSED(guess);
+    return ((SimulatedOracle*) context)->target;
+}
+
+static const char* simulated_distinguish(void* context, const char* word, const char* guess) {
+    SILENCE_UNUSED(guess);
+
+    SimulatedOracle* player = (SimulatedOracle*) context;
+    snprintf(player->question, MAX_INPUT_LENGTH, "like %s", word);
+
+    return player->question;
+}
+
+static void answer_queries(size_t index, void* batch_ptr) {
+    BatchState* batch = (BatchState*) batch_ptr;
+
+    size_t last = (index + 1) * BATCH_TASK_SIZE;
+    if (last > batch->line_count) last = batch->line_count;
+
+    for (size_t id = index * BATCH_TASK_SIZE; id < last; ++id) {
+        answer_query(batch, batch->lines[id], &batch->answers[id]);
+    }
+}
+
+static void answer_query(const BatchState* batch, char* query, Phrase* answer) {
+    query += strspn(query, " \t");
+
+    size_t length = strcspn(query, "\r");
+    while (length && (query[length - 1] == ' ' || query[length - 1] == '\t')) --length;
+    query[length] = '\0';
+
+    if (!length) return;
+
+    char command = (char)toupper(*query);
+    char* words = query + 1;
+    words += strspn(words, " \t");
+
+    if (command == 'D' && *words) {
+        switch (build_flat_definition(batch, words, answer)) {
+            case PHRASE_UNKNOWN_WORD: Phrase_printf(answer, "Word was not found!\n");       break;
+            case PHRASE_ONLY_WORD:    Phrase_printf(answer, "It is the only known word...\n"); break;
+            case PHRASE_OK: case PHRASE_SAME_WORD: default: break;
+        }
+    } else if (command == 'C' && *words) {
+        // Words are separated by a tab, or by the first space if there is no tab in the query.
+        char* separator = strchr(words, '\t');
+        if (!separator) separator = strchr(words, ' ');
+
+        if (!separator) {
+            Phrase_printf(answer, "Second word was not specified.\n");
+            return;
+        }
+
+        *separator = '\0';
+        char* word_b = separator + 1 + strspn(separator + 1, " \t");
+
+        switch (build_flat_comparison(batch, words, word_b, answer)) {
+            case PHRASE_UNKNOWN_WORD: Phrase_printf(answer, "One of the words was not found.\n"); break;
+            case PHRASE_SAME_WORD:    Phrase_printf(answer, "They are the same objects...\n");    break;
+            case PHRASE_OK: case PHRASE_ONLY_WORD: default: break;
         }
-        phrase_typer += sprintf(phrase_typer, "\', while\n");
+    } else {
+        Phrase_printf(answer, "Unknown query \"%s\".\n", query);
+    }
+
+    if (answer->failed) {
+        answer->failed = false;
+        answer->length = 0;
+        Phrase_printf(answer, "Not enough memory to answer the query.\n");
+    }
+}
+
+static PhraseStatus build_flat_definition(const BatchState* batch, const char* word, Phrase* phrase) {
+    const FlatTree* flat = batch->flat;
+
+    uint32_t node = FlatTree_find(flat, word);
+    if (node == FLAT_TREE_NO_NODE) return PHRASE_UNKNOWN_WORD;
+
+    TreeNode_count(&batch->lookups[node]);
+
+    if (flat->parent[node] == FLAT_TREE_NO_NODE) return PHRASE_ONLY_WORD;
+
+    size_t length = 0;
+    PathStep* path = flat_path(flat, node, &length);
+    if (!path) {
+        phrase->failed = true;
+        return PHRASE_OK;
+    }
+
+    print_definition(phrase, path, length);
+
+    free(path);
+
+    return PHRASE_OK;
+}
+
+static PhraseStatus build_flat_comparison(const BatchState* batch, const char* word_a, const char* word_b, Phrase* phrase) {
+    const FlatTree* flat = batch->flat;
+
+    uint32_t node_a = FlatTree_find(flat, word_a);
+    uint32_t node_b = FlatTree_find(flat, word_b);
+
+    if (node_a == FLAT_TREE_NO_NODE || node_b == FLAT_TREE_NO_NODE) return PHRASE_UNKNOWN_WORD;
+
+    TreeNode_count(&batch->lookups[node_a]);
+    if (node_b != node_a) TreeNode_count(&batch->lookups[node_b]);
+
+    if (node_a == node_b) return PHRASE_SAME_WORD;
+
+    size_t length_a = 0, length_b = 0;
+    PathStep* path_a = flat_path(flat, node_a, &length_a);
+    PathStep* path_b = flat_path(flat, node_b, &length_b);
+    if (!path_a || !path_b) {
+        free(path_a);
+        free(path_b);
+        phrase->failed = true;
+        return PHRASE_OK;
     }
 
-    --depth_a;
-    --depth_b;
+    // Paths lead through the same nodes until the first different answer, leaves are never ancestors of each other.
+    size_t prefix_length = 0;
+    while (prefix_length < length_a && prefix_length < length_b &&
+           path_a[prefix_length].is_not == path_b[prefix_length].is_not) ++prefix_length;
+
+    print_comparison(phrase, word_a, path_a, length_a, word_b, path_b, length_b, prefix_length);
+
+    free(path_a);
+    free(path_b);
+
+    return PHRASE_OK;
+}
+
+static GuessOutcome guess_outcome(BinaryTree* tree, const GuessOracle* oracle, TreeNode* node, int* const err_code) {
+    const char* value = node->value;
+    uint64_t version = node->version;
+
+    epoch_exit();
+
+    bool is_correct = oracle->confirm(oracle->context, value, true);
+    const char* word = is_correct ? NULL : oracle->name(oracle->context, value);
+
+    epoch_enter();
 
-    phrase_typer += sprintf(phrase_typer, "object %s ", word_a);
-    for (size_t index = prefix_length; index < depth_a; ++index) {
-        phrase_typer += print_argument(phrase_typer, path_a[index], path_a[index + 1], index == depth_a - 1);
+    if (is_correct) return GUESS_CORRECT;
+    if (!word) return GUESS_GAVE_UP;
+
+    if (WordIndex_find(&tree->index, word)) return GUESS_DUPLICATE;
+
+    epoch_exit();
+    const char* question = oracle->distinguish(oracle->context, word, value);
+    epoch_enter();
+
+    if (!question) return GUESS_GAVE_UP;
+
+    BinaryTree_lock(tree);
+
+    // The leaf may have been reclaimed and reused meanwhile, reused nodes get newer versions.
+    if (node->version != version || !BinaryTree_is_linked(tree, node) || WordIndex_find(&tree->index, word)) {
+        BinaryTree_unlock(tree);
+        return GUESS_CONFLICT;
     }
 
-    phrase_typer += sprintf(phrase_typer, ", and\nobject %s ", word_b);
-    for (size_t index = prefix_length; index < depth_b; ++index) {
-        phrase_typer += print_argument(phrase_typer, path_b[index], path_b[index + 1], index == depth_b - 1);
+    GuessOutcome outcome = GUESS_FAILED;
+
+    char* new_word = BinaryTree_new_value(tree, word, strlen(word), err_code);
+    char* criteria = BinaryTree_new_value(tree, question, strlen(question), err_code);
+
+    if (new_word && criteria) {
+        int split_error = 0;
+        BinaryTree_split_leaf(tree, node, criteria, new_word, &split_error);
+
+        if (split_error && err_code) *err_code = split_error;
+        if (!split_error) outcome = GUESS_LEARNED;
     }
-    phrase_typer += sprintf(phrase_typer, ".\n");
 
-    log_printf(STATUS_REPORTS, "status", "Assembled phrase - \"%s\".\n", phrase);
+    BinaryTree_unlock(tree);
 
-    printf("%s", phrase);
-    say("%s", phrase);
+    return outcome;
 }
 
-static size_t print_argument(char* destination, const TreeNode* node, const TreeNode* next_node, bool is_last) {
-    return (size_t)sprintf(destination, "is%s %s%s", 
-            node->right == next_node ? " not" : "",
-            node->value, is_last ? "" : ", ");
+static bool node_is_current(const BinaryTree* tree, const TreeNode* node, uint64_t version, uint64_t* seen) {
+    uint64_t current = __atomic_load_n(&tree->version, __ATOMIC_ACQUIRE);
+
+    // Nodes are only retired by splits and rebuilds, which change the version of the tree.
+    if (current == *seen) return true;
+
+    *seen = current;
+
+    // Writers are kept away, so the node can be read even if it was reclaimed.
+    BinaryTree_lock_shared(tree);
+    bool is_current = node->version == version && BinaryTree_is_linked(tree, node);
+    BinaryTree_unlock(tree);
+
+    return is_current;
 }
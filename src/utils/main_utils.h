@@ -117,31 +117,186 @@ const char* get_output_file_name(const int argc, const char** argv);
     printf("yes/no expected, try again.\n>>> ");                            \
 } while(true)
 
+/**
+ * @brief Pair of streams the game talks to the player through.
+ */
+struct Player {
+    FILE* in = NULL;
+    FILE* out = NULL;
+};
+
+/**
+ * @brief Read a line from the player, stripping the line break.
+ * 
+ * @param player
+ * @param buffer buffer to put the line to
+ * @param size size of the buffer
+ * @return false if the player has closed the input
+ */
+bool read_line(Player* player, char* buffer, size_t size);
+
+/**
+ * @brief Read yes or no answer from the player, asking again on anything else.
+ * 
+ * @param player
+ * @return true on YES, false on NO or closed input
+ */
+bool ask_yes_no(Player* player);
+
 /**
  * @brief Execute user command.
  * 
  * @param cmd command
  * @param tree decision tree
+ * @param player player that entered the command
  * @param err_code variable to use as errno
  */
-void execute_command(char cmd, BinaryTree* tree, int* const err_code = NULL);
+void execute_command(char cmd, BinaryTree* tree, Player* player, int* const err_code = NULL);
+
+/**
+ * @brief Source of answers for the guessing game.
+ * The tree is not locked while the oracle is asked, so it only gets values of the nodes.
+ */
+struct GuessOracle {
+    /**
+     * @brief Answer "Is it <value>?", either to the question of the node or to the final guess.
+     */
+    bool (*confirm)(void* context, const char* value, bool is_guess) = NULL;
+
+    /**
+     * @brief Name the word that was meant after a wrong guess (NULL to give up).
+     */
+    const char* (*name)(void* context, const char* guess) = NULL;
+
+    /**
+     * @brief Name the criteria the word satisfies and the wrongly guessed one does not (NULL to give up).
+     */
+    const char* (*distinguish)(void* context, const char* word, const char* guess) = NULL;
+
+    void* context = NULL;
+};
 
 /**
- * @brief Guess the word using user input.
+ * @brief Outcome of a single guessing game.
+ */
+enum GuessOutcome {
+    GUESS_CORRECT,      // <- The word was guessed.
+    GUESS_LEARNED,      // <- The word was added to the tree.
+    GUESS_DUPLICATE,    // <- The named word is already present in another place of the tree.
+    GUESS_CONFLICT,     // <- Another thread changed the guessed leaf first.
+    GUESS_GAVE_UP,      // <- The oracle did not name the word or the criteria.
+    GUESS_FAILED,       // <- Error, see err_code.
+};
+
+/**
+ * @brief Play one game of guessing with the given oracle, learning the word if it was not guessed.
+ * Several games can be played on the same tree at once.
+ * 
+ * @param tree tree to guess the word in
+ * @param oracle source of answers
+ * @param questions variable to put number of asked questions to (can be NULL)
+ * @param err_code variable to use as errno
+ * @return GuessOutcome
+ */
+GuessOutcome play_guess(BinaryTree* tree, const GuessOracle* oracle, size_t* questions = NULL, int* const err_code = NULL);
+
+/**
+ * @brief Guess the word the player thought of.
  * 
  * @param tree tree to guess the word in
+ * @param player player to ask
+ * @param err_code variable to use as errno
+ */
+void guess(BinaryTree* tree, Player* player, int* const err_code = NULL);
+
+/**
+ * @brief Play guessing games against simulated players and print throughput statistics.
+ * Players think of a random word of the tree or, sometimes, of a new word the tree has to learn.
+ * 
+ * @param tree tree to play on
+ * @param sessions number of games
+ * @param threads number of threads to play on
+ * @param err_code variable to use as errno
+ */
+void run_simulation(BinaryTree* tree, size_t sessions, size_t threads, int* const err_code = NULL);
+
+/**
+ * @brief Growable text buffer for assembled answers.
+ */
+struct Phrase {
+    char* text = NULL;
+    size_t length = 0;
+    size_t capacity = 0;
+    bool failed = false;
+};
+
+/**
+ * @brief Append formatted text to the phrase.
+ * 
+ * @param phrase
+ * @param format format string, same as for printf
+ */
+void Phrase_printf(Phrase* phrase, const char* format, ...) __attribute__((format (printf, 2, 3)));
+
+/**
+ * @brief Free the phrase.
+ * 
+ * @param phrase
+ */
+void Phrase_dtor(Phrase* phrase);
+
+/**
+ * @brief Result of the phrase assembly.
+ */
+enum PhraseStatus {
+    PHRASE_OK,              // <- The answer was appended to the phrase.
+    PHRASE_UNKNOWN_WORD,
+    PHRASE_ONLY_WORD,
+    PHRASE_SAME_WORD,
+};
+
+/**
+ * @brief Append definition of the word to the phrase.
+ * Does not modify or log anything but access counters, so it can be called from several threads at once.
+ * 
+ * @param snapshot tree version to search in
+ * @param word word to define
+ * @param phrase phrase to append the definition to
+ * @return PhraseStatus
+ */
+PhraseStatus build_definition(const TreeSnapshot* snapshot, const char* word, Phrase* phrase);
+
+/**
+ * @brief Append comparison of two words to the phrase.
+ * Does not modify or log anything but access counters, so it can be called from several threads at once.
+ * 
+ * @param snapshot tree version to search in
+ * @param word_a first word
+ * @param word_b second word
+ * @param phrase phrase to append the comparison to
+ * @return PhraseStatus
+ */
+PhraseStatus build_comparison(const TreeSnapshot* snapshot, const char* word_a, const char* word_b, Phrase* phrase);
+
+/**
+ * @brief Answer "D word" and "C word_a word_b" queries from the stream and print answers to stdout in input order.
+ * All queries are answered against the version of the tree at the start of the batch.
+ * 
+ * @param tree tree to search in
+ * @param queries stream with one query per line
  * @param err_code variable to use as errno
  */
-void guess(BinaryTree* tree, int* const err_code = NULL);
+void run_batch(const BinaryTree* tree, FILE* queries, int* const err_code = NULL);
 
 /**
  * @brief Give definition of the word.
  * 
  * @param tree tree to search in
  * @param word word to define
+ * @param player player to answer to
  * @param err_code variable to use as errno
  */
-void define(BinaryTree* tree, const char* word, int* const err_code = NULL);
+void define(BinaryTree* tree, const char* word, Player* player, int* const err_code = NULL);
 
 /**
  * @brief Compare definitions of two words.
@@ -149,8 +304,38 @@ void define(BinaryTree* tree, const char* word, int* const err_code = NULL);
  * @param tree tree to search in
  * @param word_a first word
  * @param word_b second word
+ * @param player player to answer to
+ * @param err_code variable to use as errno
+ */
+void compare(BinaryTree* tree, const char* word_a, const char* word_b, Player* player, int* const err_code = NULL);
+
+/**
+ * @brief Print the hottest nodes, average number of questions per game and the histogram of game lengths.
+ * 
+ * @param tree tree to print statistics of
+ * @param out stream to print to
+ * @param top_count number of the hottest nodes to list
+ * @param err_code variable to use as errno
+ */
+void print_stats(const BinaryTree* tree, FILE* out, size_t top_count, int* const err_code = NULL);
+
+/**
+ * @brief Set popularity of the words from the stream of "count word" lines, replacing numbers of played games.
+ * Words that are not listed get no games, listed words that are not in the tree are skipped.
+ * 
+ * @param tree tree to set popularity in
+ * @param frequencies stream with one word per line
+ * @param err_code variable to use as errno
+ */
+void load_frequencies(BinaryTree* tree, FILE* frequencies, int* const err_code = NULL);
+
+/**
+ * @brief Rebuild the tree so that popular words take fewer questions, then write it into the database.
+ * 
+ * @param tree tree to rebuild
+ * @param out stream to print expected numbers of questions to
  * @param err_code variable to use as errno
  */
-void compare(BinaryTree* tree, const char* word_a, const char* word_b, int* const err_code = NULL);
+void restructure(BinaryTree* tree, FILE* out, int* const err_code = NULL);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,234 @@
+/**
+ * @file tree_stress.cpp
+ * @author Kudryashov Ilya (kudriashov.it@phystech.edu)
+ * @brief Stress test of splits published while other threads read the tree without locking.
+ * Meant to be run in the sanitizer build (make test).
+ * @version 0.1
+ * @date 2022-11-22
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "lib/bin_tree.h"
+#include "lib/util/epoch.h"
+
+const size_t STRESS_WRITERS = 2;
+const size_t STRESS_READERS = 4;
+const size_t STRESS_SPLITS = 3000;     // <- Splits made by every writer.
+const size_t STRESS_NAME_SIZE = 64;
+
+/**
+ * @brief State shared by all threads of the test.
+ */
+struct StressTest {
+    BinaryTree tree = {};
+    size_t next_word = 1;           // <- Number of the next word to learn, word 0 is in the tree from the start.
+    size_t learned = 0;
+    size_t writers_left = 0;
+    size_t failures = 0;
+};
+
+/**
+ * @brief Report the failed check of the test.
+ *
+ * @param test
+ * @param description what went wrong
+ */
+static void fail(StressTest* test, const char* description);
+
+/**
+ * @brief Get the next pseudo-random number.
+ *
+ * @param state state of the generator
+ * @return uint64_t
+ */
+static uint64_t next_random(uint64_t* state);
+
+/**
+ * @brief Split leaves of randomly chosen words, the way the game learns new words.
+ *
+ * @param test_ptr StressTest*
+ * @return NULL
+ */
+static void* write_words(void* test_ptr);
+
+/**
+ * @brief Descend the tree along random paths and look the words up until the writers finish.
+ *
+ * @param test_ptr StressTest*
+ * @return NULL
+ */
+static void* read_paths(void* test_ptr);
+
+/**
+ * @brief Walk the whole snapshot of the tree and check that its words are found in it.
+ *
+ * @param test
+ * @param random random number state
+ */
+static void check_snapshot(StressTest* test, uint64_t* random);
+
+int main() {
+    StressTest test = {};
+
+    BinaryTree_ctor(&test.tree);
+    test.tree.root->value = BinaryTree_new_value(&test.tree, "word 0", strlen("word 0"));
+    BinaryTree_build_index(&test.tree);
+
+    test.writers_left = STRESS_WRITERS;
+
+    pthread_t threads[STRESS_WRITERS + STRESS_READERS] = {};
+
+    for (size_t id = 0; id < STRESS_WRITERS + STRESS_READERS; ++id) {
+        if (pthread_create(&threads[id], NULL, id < STRESS_WRITERS ? write_words : read_paths, &test)) {
+            fail(&test, "thread was not started");
+            return EXIT_FAILURE;
+        }
+    }
+
+    for (size_t id = 0; id < STRESS_WRITERS + STRESS_READERS; ++id) pthread_join(threads[id], NULL);
+
+    size_t leaves = 0;
+    foreach_leaf(leaf, test.tree.root) {
+        ++leaves;
+        if (BinaryTree_find(&test.tree, leaf->value) != leaf) fail(&test, "word of the leaf is not indexed");
+    }
+
+    if (leaves != test.learned + 1) fail(&test, "number of the leaves does not match the number of the splits");
+    if (BinaryTree_full_status(&test.tree)) fail(&test, "tree is broken");
+
+    // Readers leave their sections between the lookups, so the leaves replaced by splits are reused.
+    if (test.tree.retired.size >= test.learned) fail(&test, "replaced leaves were never reclaimed");
+
+    printf("%lld words learned by %lld writers next to %lld readers, %lld leaves wait for reclamation.\n",
+           (long long)test.learned, (long long)STRESS_WRITERS, (long long)STRESS_READERS,
+           (long long)test.tree.retired.size);
+
+    BinaryTree_dtor(&test.tree);
+
+    if (test.failures) {
+        printf("%lld checks failed.\n", (long long)test.failures);
+        return EXIT_FAILURE;
+    }
+
+    printf("Passed.\n");
+    return EXIT_SUCCESS;
+}
+
+static void fail(StressTest* test, const char* description) {
+    __atomic_add_fetch(&test->failures, 1, __ATOMIC_RELAXED);
+    fprintf(stderr, "Failed: %s.\n", description);
+}
+
+static uint64_t next_random(uint64_t* state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+static void* write_words(void* test_ptr) {
+    StressTest* test = (StressTest*) test_ptr;
+    BinaryTree* tree = &test->tree;
+
+    uint64_t random = (uint64_t)&random | 1;
+
+    for (size_t split = 0; split < STRESS_SPLITS; ++split) {
+        size_t known = __atomic_load_n(&test->next_word, __ATOMIC_ACQUIRE);
+        size_t number = __atomic_fetch_add(&test->next_word, 1, __ATOMIC_ACQ_REL);
+
+        char target[STRESS_NAME_SIZE] = "";
+        snprintf(target, STRESS_NAME_SIZE, "word %lld", (long long)(next_random(&random) % known));
+
+        char word[STRESS_NAME_SIZE] = "";
+        char question[STRESS_NAME_SIZE] = "";
+        snprintf(word, STRESS_NAME_SIZE, "word %lld", (long long)number);
+        snprintf(question, STRESS_NAME_SIZE, "question %lld", (long long)number);
+
+        BinaryTree_lock(tree);
+
+        // Words that are still being learned by the other writer are not in the tree yet.
+        TreeNode* leaf = WordIndex_find(&tree->index, target);
+
+        if (leaf && BinaryTree_is_linked(tree, leaf)) {
+            char* word_value = BinaryTree_new_value(tree, word, strlen(word));
+            char* question_value = BinaryTree_new_value(tree, question, strlen(question));
+
+            int split_error = 0;
+            BinaryTree_split_leaf(tree, leaf, question_value, word_value, &split_error);
+
+            if (split_error) fail(test, "split failed");
+            else __atomic_add_fetch(&test->learned, 1, __ATOMIC_RELAXED);
+        }
+
+        BinaryTree_unlock(tree);
+    }
+
+    __atomic_sub_fetch(&test->writers_left, 1, __ATOMIC_RELEASE);
+
+    return NULL;
+}
+
+static void* read_paths(void* test_ptr) {
+    StressTest* test = (StressTest*) test_ptr;
+    BinaryTree* tree = &test->tree;
+
+    uint64_t random = (uint64_t)&random | 1;
+
+    for (size_t round = 0; __atomic_load_n(&test->writers_left, __ATOMIC_ACQUIRE); ++round) {
+        epoch_enter();
+
+        const TreeNode* node = BinaryTree_root(tree);
+
+        while (TreeNode_child(node, false)) {
+            const TreeNode* child = TreeNode_child(node, next_random(&random) & 1);
+
+            if (child->depth != node->depth + 1 || child->parent != node) fail(test, "child is not linked to its parent");
+            if (!child->value) fail(test, "node has no value");
+
+            node = child;
+        }
+
+        if (strncmp(node->value, "word ", strlen("word ")) != 0) fail(test, "leaf holds a question");
+
+        // The leaf may be replaced by a split meanwhile, but the index always has a copy of the word.
+        const TreeNode* found = WordIndex_find(&tree->index, node->value);
+        if (!found || strcmp(found->value, node->value) != 0) fail(test, "word of the leaf is not found");
+
+        epoch_exit();
+
+        if (round % 64 == 0) check_snapshot(test, &random);
+    }
+
+    return NULL;
+}
+
+static void check_snapshot(StressTest* test, uint64_t* random) {
+    TreeSnapshot snapshot = {};
+    BinaryTree_snapshot(&test->tree, &snapshot);
+
+    const TreeNode* root = TreeSnapshot_root(&snapshot);
+
+    size_t leaves = 0;
+    foreach_node_at(node, root, snapshot.version) {
+        if (node->version > snapshot.version) fail(test, "snapshot shows a newer node");
+        if (TreeNode_child(node, false)) continue;
+
+        ++leaves;
+
+        // Looking every word up would make the readers too slow to overlap with the writers.
+        if (next_random(random) % 16) continue;
+
+        if (TreeSnapshot_find(&snapshot, node->value) != node) fail(test, "snapshot finds another leaf of the word");
+    }
+
+    if (leaves > __atomic_load_n(&test->next_word, __ATOMIC_ACQUIRE)) fail(test, "snapshot has too many words");
+
+    TreeSnapshot_release(&snapshot);
+}